@@ -0,0 +1,463 @@
+// Benchmarks of reading/writing/validating synthetic data of configurable size.
+//
+// Usage:
+//     scribe_bench [--size=N] [--depth=D] [google-benchmark options]
+//
+//   --size=N   number of values in large arrays (default 2^20). Dicts and
+//              arrays of Tomes are scaled down from that.
+//   --depth=D  nesting depth of the 'deep_dict' case (default 256)
+//   --threads=T  number of threads for 'hdf5/read_parallel' (default 4)
+//
+// Reported counters:
+//   * bytes_per_second: size of the file on disk per time. For 'base64/...',
+//     the size of the binary (not encoded) data.
+//   * items_per_second: number of atomic values (numbers/strings) per time
+//   * peak_rss_MB: peak resident memory of the whole process so far. Use
+//     '--benchmark_filter=...' to run a single benchmark for accurate numbers.
+// Additionally, 'sizeof(Tome)' is reported in the context header.
+
+#include "benchmark/benchmark.h"
+#include "scribe/io_hdf5.h"
+#include "scribe/io_json.h"
+#include "scribe/tome.h"
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <filesystem>
+#include <sys/resource.h>
+
+namespace {
+using namespace scribe;
+
+struct Case
+{
+    std::string name;
+    Tome data;
+    Schema schema;
+    size_t elements = 0;
+    bool hdf5 = true; // not all types are supported by the HDF5 backend yet
+};
+
+// number of atomic values in a Tome
+size_t count_elements(Tome const &tome)
+{
+    return tome.visit<size_t>(overloaded{
+        [](Tome::dict_type const &d) -> size_t {
+            size_t n = 0;
+            for (auto const &[key, value] : d)
+                n += count_elements(value);
+            return n;
+        },
+        [](Tome::array_type const &a) -> size_t {
+            size_t n = 0;
+            for (auto const &value : a)
+                n += count_elements(value);
+            return n;
+        },
+        [](NumericArrayType auto const &a) -> size_t { return a.size(); },
+        [](auto const &) -> size_t { return 1; }});
+}
+
+// schema of a dict with a single item 'data'
+Schema wrap_schema(nlohmann::json item)
+{
+    item["key"] = "data";
+    return Schema::from_json(
+        {{"type", "dict"}, {"items", nlohmann::json::array({item})}});
+}
+
+// many keys with small values of different types
+Case wide_dict(size_t n)
+{
+    Case c;
+    c.name = fmt::format("wide_dict/{}", n);
+    auto items = nlohmann::json::array();
+    for (size_t i = 0; i < n; ++i)
+    {
+        auto key = fmt::format("item_{}", i);
+        switch (i % 3)
+        {
+        case 0:
+            c.data[key] = 0.5 * i;
+            items.push_back({{"key", key}, {"type", "float64"}});
+            break;
+        case 1:
+            c.data[key] = int64_t(i);
+            items.push_back({{"key", key}, {"type", "int64"}});
+            break;
+        default:
+            c.data[key] = fmt::format("value {}", i);
+            items.push_back({{"key", key}, {"type", "string"}});
+            break;
+        }
+    }
+    c.schema = Schema::from_json({{"type", "dict"}, {"items", items}});
+    return c;
+}
+
+// dicts nested 'depth' levels deep, one number on each level
+Case deep_dict(size_t depth)
+{
+    Case c;
+    c.name = fmt::format("deep_dict/{}", depth);
+    nlohmann::json value_item = {{"key", "value"}, {"type", "int32"}};
+    auto schema = nlohmann::json{
+        {"type", "dict"}, {"items", nlohmann::json::array({value_item})}};
+    c.data["value"] = int32_t(0);
+    for (size_t i = 1; i < depth; ++i)
+    {
+        auto child_item = std::move(schema);
+        child_item["key"] = "child";
+        schema = {{"type", "dict"},
+                  {"items", nlohmann::json::array({value_item, child_item})}};
+
+        Tome parent;
+        parent["value"] = int32_t(i);
+        parent["child"] = std::move(c.data);
+        c.data = std::move(parent);
+    }
+    c.schema = Schema::from_json(schema);
+    return c;
+}
+
+// 2D array of float64
+Case float_array(size_t n)
+{
+    size_t cols = 1024;
+    size_t rows = std::max(size_t(1), n / cols);
+    Case c;
+    c.name = fmt::format("float_array/{}x{}", rows, cols);
+    auto a = Array<double>::from_shape({rows, cols});
+    for (size_t i = 0; i < a.size(); ++i)
+        a.data()[i] = std::sin(0.001 * i);
+    c.data["data"] = Tome::array(std::move(a));
+    c.schema = wrap_schema({{"type", "array"},
+                            {"shape", {rows, cols}},
+                            {"elements", {{"type", "float64"}}}});
+    return c;
+}
+
+// same as 'float_array', stored as base64 in JSON (see 'JsonStorageHints')
+Case float_array_base64(size_t n)
+{
+    auto c = float_array(n);
+    c.name = "float_array_base64" + c.name.substr(c.name.find('/'));
+    auto j = c.schema.to_json();
+    j["items"][0]["json"] = {{"encoding", "base64"}};
+    c.schema = Schema::from_json(j);
+    c.hdf5 = false; // the hint does not change anything for HDF5
+    return c;
+}
+
+// 1D array of complex_float64
+Case complex_array(size_t n)
+{
+    Case c;
+    c.name = fmt::format("complex_array/{}", n);
+    auto a = Array<std::complex<double>>::from_shape({n});
+    for (size_t i = 0; i < n; ++i)
+        a(i) = std::polar(1.0, 0.001 * i);
+    c.data["data"] = Tome::array(std::move(a));
+    c.schema = wrap_schema({{"type", "array"},
+                            {"shape", {-1}},
+                            {"elements", {{"type", "complex_float64"}}}});
+    return c;
+}
+
+// many medium-sized arrays, similar to a simulation checkpoint
+Case many_arrays(size_t n)
+{
+    size_t count = 64;
+    size_t length = std::max(size_t(1), n / count);
+    Case c;
+    c.name = fmt::format("many_arrays/{}x{}", count, length);
+    auto items = nlohmann::json::array();
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto key = fmt::format("field_{}", i);
+        auto a = Array<double>::from_shape({length});
+        for (size_t j = 0; j < length; ++j)
+            a(j) = std::cos(0.001 * (i + j));
+        c.data[key] = Tome::array(std::move(a));
+        items.push_back({{"key", key},
+                         {"type", "array"},
+                         {"shape", {length}},
+                         {"elements", {{"type", "float64"}}}});
+    }
+    c.schema = Schema::from_json({{"type", "dict"}, {"items", items}});
+    return c;
+}
+
+// Array<Tome> of float64, i.e. one full Tome per number
+Case number_tome_array(size_t n)
+{
+    Case c;
+    c.name = fmt::format("number_tome_array/{}", n);
+    std::vector<Tome> elements;
+    elements.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+        elements.push_back(0.25 * i);
+    c.data["data"] = Tome::array(std::move(elements));
+    c.schema = wrap_schema({{"type", "array"},
+                            {"shape", {-1}},
+                            {"elements", {{"type", "float64"}}}});
+    return c;
+}
+
+// Array<Tome> of small dicts
+Case dict_tome_array(size_t n)
+{
+    Case c;
+    c.name = fmt::format("dict_tome_array/{}", n);
+    std::vector<Tome> elements(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        elements[i]["x"] = 0.5 * i;
+        elements[i]["y"] = int32_t(i);
+    }
+    c.data["data"] = Tome::array(std::move(elements));
+    c.schema = wrap_schema(
+        {{"type", "array"},
+         {"shape", {-1}},
+         {"elements",
+          {{"type", "dict"},
+           {"items",
+            {{{"key", "x"}, {"type", "float64"}},
+             {{"key", "y"}, {"type", "int32"}}}}}}});
+    c.hdf5 = false;
+    return c;
+}
+
+std::string temp_filename(Case const &c, std::string_view suffix)
+{
+    auto name = "scribe_bench_" + c.name + std::string(suffix);
+    std::replace(name.begin(), name.end(), '/', '_');
+    return (std::filesystem::temp_directory_path() / name).string();
+}
+
+// peak resident set size of the process in MB (ru_maxrss is in KB on linux)
+double peak_rss_mb()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+}
+
+void set_counters(benchmark::State &state, Case const &c,
+                  std::string const &filename)
+{
+    auto bytes = std::filesystem::file_size(filename);
+    state.SetBytesProcessed(int64_t(state.iterations() * bytes));
+    state.SetItemsProcessed(int64_t(state.iterations() * c.elements));
+    state.counters["file_MB"] = bytes / 1.0e6;
+    state.counters["peak_rss_MB"] = peak_rss_mb();
+}
+
+void bench_write(benchmark::State &state, Case const &c,
+                 std::string const &filename)
+{
+    for (auto _ : state)
+        write_file(filename, c.data, c.schema);
+    set_counters(state, c, filename);
+}
+
+void bench_read(benchmark::State &state, Case const &c,
+                std::string const &filename, ReadOptions const &options = {})
+{
+    write_file(filename, c.data, c.schema);
+    for (auto _ : state)
+    {
+        Tome tome;
+        read_file(tome, filename, c.schema, options);
+        benchmark::DoNotOptimize(tome);
+    }
+    set_counters(state, c, filename);
+}
+
+void bench_validate(benchmark::State &state, Case const &c,
+                    std::string const &filename)
+{
+    write_file(filename, c.data, c.schema);
+    for (auto _ : state)
+    {
+        if (filename.ends_with(".json"))
+            validate_file(filename, c.schema);
+        else
+        {
+            auto file = HighFive::File(filename, HighFive::File::ReadOnly);
+            internal::read_hdf5(nullptr, file, "/", c.schema);
+        }
+    }
+    set_counters(state, c, filename);
+}
+
+// same as 'scribe convert data.json data.h5'
+void bench_convert(benchmark::State &state, Case const &c,
+                   std::string const &json_filename,
+                   std::string const &hdf5_filename)
+{
+    write_file(json_filename, c.data, c.schema);
+    for (auto _ : state)
+    {
+        Tome tome;
+        read_file(tome, json_filename, c.schema);
+        write_file(hdf5_filename, tome, c.schema);
+    }
+    set_counters(state, c, json_filename);
+}
+
+void bench_guess_schema(benchmark::State &state, Case const &c)
+{
+    for (auto _ : state)
+        benchmark::DoNotOptimize(guess_schema(c.data));
+    state.SetItemsProcessed(int64_t(state.iterations() * c.elements));
+    state.counters["peak_rss_MB"] = peak_rss_mb();
+}
+
+// same as 'scribe guess-schema data.h5', which only reads metadata
+void bench_guess_schema_hdf5(benchmark::State &state, Case const &c,
+                             std::string const &filename)
+{
+    write_file(filename, c.data, c.schema);
+    for (auto _ : state)
+    {
+        Tome tome;
+        read_file(tome, filename, Schema::any(), {.lazy = true});
+        benchmark::DoNotOptimize(guess_schema(tome));
+    }
+    set_counters(state, c, filename);
+}
+
+// the raw base64 codec on 'n' bytes, without any JSON around it
+void bench_base64_encode(benchmark::State &state, size_t n)
+{
+    auto data = std::vector<std::byte>(n);
+    for (size_t i = 0; i < n; ++i)
+        data[i] = std::byte(i * 2654435761u >> 13);
+    auto text = std::string((n + 2) / 3 * 4, '\0');
+    for (auto _ : state)
+    {
+        internal::base64_encode(data, text.data());
+        benchmark::DoNotOptimize(text.data());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations() * n));
+}
+
+void bench_base64_decode(benchmark::State &state, size_t n)
+{
+    auto data = std::vector<std::byte>(n);
+    for (size_t i = 0; i < n; ++i)
+        data[i] = std::byte(i * 2654435761u >> 13);
+    auto text = std::string((n + 2) / 3 * 4, '\0');
+    internal::base64_encode(data, text.data());
+    for (auto _ : state)
+    {
+        internal::base64_decode(text, data);
+        benchmark::DoNotOptimize(data.data());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations() * n));
+}
+
+// parses and removes '--name=value' from the command line
+size_t parse_flag(int &argc, char **argv, std::string_view name,
+                  size_t default_value)
+{
+    auto prefix = fmt::format("--{}=", name);
+    size_t value = default_value;
+    for (int i = 1; i < argc; ++i)
+    {
+        auto arg = std::string_view(argv[i]);
+        if (!arg.starts_with(prefix))
+            continue;
+        value = std::stoull(std::string(arg.substr(prefix.size())));
+        for (int j = i; j + 1 < argc; ++j)
+            argv[j] = argv[j + 1];
+        --argc;
+        --i;
+    }
+    return value;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    size_t size = parse_flag(argc, argv, "size", size_t(1) << 20);
+    size_t depth = parse_flag(argc, argv, "depth", 256);
+    int threads = int(parse_flag(argc, argv, "threads", 4));
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    benchmark::AddCustomContext("sizeof(Tome)", std::to_string(sizeof(Tome)));
+
+    // NOTE: deque, because registered benchmarks keep references
+    std::deque<Case> cases;
+    cases.push_back(wide_dict(size / 64));
+    cases.push_back(deep_dict(depth));
+    cases.push_back(float_array(size));
+    cases.push_back(float_array_base64(size));
+    cases.push_back(complex_array(size / 2));
+    cases.push_back(many_arrays(size));
+    cases.push_back(number_tome_array(size / 16));
+    cases.push_back(dict_tome_array(size / 64));
+
+    // NOTE: capture by reference, so that the data is not copied
+    // NOTE: wall-clock time, as the cpu time of the main thread does not
+    //       include I/O wait or other threads
+    auto add = [](std::string const &name, auto f) {
+        benchmark::RegisterBenchmark(name.c_str(), f)
+            ->Unit(benchmark::kMillisecond)
+            ->UseRealTime();
+    };
+
+    std::vector<std::string> files;
+    for (auto &c : cases)
+    {
+        c.elements = count_elements(c.data);
+        auto json = temp_filename(c, ".json");
+        auto hdf5 = temp_filename(c, ".h5");
+        files.push_back(json);
+
+        add("json/write/" + c.name,
+            [&c, json](auto &state) { bench_write(state, c, json); });
+        add("json/read/" + c.name,
+            [&c, json](auto &state) { bench_read(state, c, json); });
+        add("json/validate/" + c.name,
+            [&c, json](auto &state) { bench_validate(state, c, json); });
+        add("guess_schema/" + c.name,
+            [&c](auto &state) { bench_guess_schema(state, c); });
+        if (!c.hdf5)
+            continue;
+        files.push_back(hdf5);
+        add("hdf5/write/" + c.name,
+            [&c, hdf5](auto &state) { bench_write(state, c, hdf5); });
+        add("hdf5/read/" + c.name,
+            [&c, hdf5](auto &state) { bench_read(state, c, hdf5); });
+        add("hdf5/read_parallel/" + c.name, [&c, hdf5, threads](auto &state) {
+            bench_read(state, c, hdf5, {.num_threads = threads});
+        });
+        add("hdf5/validate/" + c.name,
+            [&c, hdf5](auto &state) { bench_validate(state, c, hdf5); });
+        add("hdf5/guess_schema/" + c.name, [&c, hdf5](auto &state) {
+            bench_guess_schema_hdf5(state, c, hdf5);
+        });
+        add("convert/" + c.name, [&c, json, hdf5](auto &state) {
+            bench_convert(state, c, json, hdf5);
+        });
+    }
+
+    auto base64_bytes = size * sizeof(double);
+    add(fmt::format("base64/encode/{}", base64_bytes),
+        [base64_bytes](auto &state) {
+            bench_base64_encode(state, base64_bytes);
+        });
+    add(fmt::format("base64/decode/{}", base64_bytes),
+        [base64_bytes](auto &state) {
+            bench_base64_decode(state, base64_bytes);
+        });
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    for (auto const &file : files)
+        std::filesystem::remove(file);
+}
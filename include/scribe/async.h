@@ -0,0 +1,76 @@
+#pragma once
+
+#include "scribe/io.h"
+#include "scribe/schema.h"
+#include "scribe/tome.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+
+namespace scribe {
+
+// Writes files on a background thread, so that the caller can continue (e.g.
+// with the next compute phase of a simulation) while a checkpoint is encoded
+// and written.
+//   * 'write' takes ownership of the data and returns a future, which becomes
+//     ready when the file is complete, or holds the exception if writing
+//     failed. Passing a copy of a Tome is cheap, and the copy is a snapshot
+//     (see 'internal::Boxed'): the caller can go on modifying its Tome, also
+//     through references obtained before.
+//   * HDF5 files are written holding the global HDF5 lock (see
+//     'internal::hdf5_mutex'), so the caller can keep using HDF5 meanwhile.
+//   * files are written one after the other, in order. At most 'max_pending'
+//     writes (including the one currently running) are in flight. 'write'
+//     blocks until there is room, so memory usage stays bounded.
+//   * the destructor waits for all pending writes. Errors are only reported
+//     through the futures.
+class AsyncWriter
+{
+    struct Job
+    {
+        std::function<void()> write;
+        std::promise<void> done;
+    };
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Job> queue_;
+    size_t max_pending_;
+    size_t pending_ = 0; // queued or running
+    bool stop_ = false;
+    std::thread thread_;
+
+    void run();
+    std::future<void> submit(std::function<void()> write);
+
+  public:
+    AsyncWriter(AsyncWriter const &) = delete;
+    AsyncWriter &operator=(AsyncWriter const &) = delete;
+
+    explicit AsyncWriter(size_t max_pending = 2);
+    ~AsyncWriter();
+
+    // same as 'write_file(filename, tome, schema, options)'
+    std::future<void> write(std::string_view filename, Tome tome,
+                            Schema schema, WriteOptions options = {});
+
+    // same as 'write_file(filename, data)' for generated types
+    template <class T>
+        requires(!std::same_as<T, Tome>)
+    std::future<void> write(std::string_view filename, T data)
+    {
+        // NOTE: shared, as 'std::function' needs a copyable callable
+        return submit([filename = std::string(filename),
+                       data = std::make_shared<T>(std::move(data))] {
+            write_file(filename, *data);
+        });
+    }
+
+    // blocks until all pending writes are done
+    void wait();
+};
+
+} // namespace scribe
@@ -3,14 +3,27 @@
 // Basic definitions that are used by most other header files in Scribe.
 // Mostly typedefs and concepts. Also error classes.
 
+#include "scribe/flat_dict.h"
 #include "xtensor/xarray.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <span>
 #include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace scribe {
 
 // forward declarations
 class JsonReader;
 class Hdf5Reader;
+class JsonWriter;
+class Hdf5Writer;
 
 struct ScribeError : std::runtime_error
 {
@@ -68,9 +81,192 @@ using complex_float64_t = std::complex<double>;
 using string_t = std::string;
 using bool_t = bool;
 
+namespace internal {
+// Element storage of 'Array'. Behaves like a 'std::vector', but can also be a
+// read-only view of memory owned by someone else (e.g. a memory-mapped file,
+// see 'ScbFile'), which is kept alive by a shared pointer. Copies of a view
+// share that memory. The first non-const access to the elements copies them
+// into an owned vector (copy-on-write, as for 'Boxed'), so a view is never
+// written through. Thus, arrays that are only read through a const reference
+// never copy their elements.
+template <class T> class ArrayStorage
+{
+    std::vector<T> data_;
+    T const *view_ = nullptr; // elements, if this is a view
+    size_t view_size_ = 0;
+    std::shared_ptr<const void> owner_; // keeps 'view_' alive
+
+    void detach()
+    {
+        if (!view_)
+            return;
+        data_.assign(view_, view_ + view_size_);
+        release();
+    }
+    void release() noexcept
+    {
+        view_ = nullptr;
+        view_size_ = 0;
+        owner_.reset();
+    }
+
+  public:
+    using value_type = T;
+    using allocator_type = typename std::vector<T>::allocator_type;
+    using size_type = size_t;
+    using difference_type = ptrdiff_t;
+    using reference = T &;
+    using const_reference = T const &;
+    using pointer = T *;
+    using const_pointer = T const *;
+    using iterator = T *;
+    using const_iterator = T const *;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    ArrayStorage() = default;
+    explicit ArrayStorage(size_type n) : data_(n) {}
+    ArrayStorage(size_type n, T const &value) : data_(n, value) {}
+    template <std::input_iterator It>
+    ArrayStorage(It first, It last) : data_(first, last)
+    {}
+    ArrayStorage(std::initializer_list<T> values) : data_(values) {}
+    ArrayStorage(std::vector<T> data) : data_(std::move(data)) {}
+
+    // view of 'size' elements at 'data', which 'owner' keeps alive
+    ArrayStorage(T const *data, size_type size,
+                 std::shared_ptr<const void> owner)
+        : view_(data), view_size_(size), owner_(std::move(owner))
+    {}
+
+    ArrayStorage(ArrayStorage const &) = default;
+    ArrayStorage(ArrayStorage &&other) noexcept
+        : data_(std::move(other.data_)),
+          view_(std::exchange(other.view_, nullptr)),
+          view_size_(std::exchange(other.view_size_, 0)),
+          owner_(std::move(other.owner_))
+    {}
+    ArrayStorage &operator=(ArrayStorage const &) = default;
+    ArrayStorage &operator=(ArrayStorage &&other) noexcept
+    {
+        data_ = std::move(other.data_);
+        view_ = std::exchange(other.view_, nullptr);
+        view_size_ = std::exchange(other.view_size_, 0);
+        owner_ = std::move(other.owner_);
+        return *this;
+    }
+    ~ArrayStorage() = default;
+
+    // true if the elements are not owned (and not copied yet)
+    bool is_view() const noexcept { return view_ != nullptr; }
+
+    allocator_type get_allocator() const { return data_.get_allocator(); }
+
+    size_type size() const noexcept
+    {
+        return view_ ? view_size_ : data_.size();
+    }
+    size_type max_size() const noexcept { return data_.max_size(); }
+    bool empty() const noexcept { return size() == 0; }
+
+    void resize(size_type n)
+    {
+        if (n == size())
+            return;
+        detach();
+        data_.resize(n);
+    }
+    void resize(size_type n, T const &value)
+    {
+        detach();
+        data_.resize(n, value);
+    }
+    void reserve(size_type n)
+    {
+        detach();
+        data_.reserve(n);
+    }
+    void clear() noexcept
+    {
+        release();
+        data_.clear();
+    }
+    void push_back(T const &value)
+    {
+        detach();
+        data_.push_back(value);
+    }
+    void push_back(T &&value)
+    {
+        detach();
+        data_.push_back(std::move(value));
+    }
+
+    T *data()
+    {
+        detach();
+        return data_.data();
+    }
+    T const *data() const noexcept { return view_ ? view_ : data_.data(); }
+
+    reference operator[](size_type i) { return data()[i]; }
+    const_reference operator[](size_type i) const { return data()[i]; }
+    reference at(size_type i)
+    {
+        if (i >= size())
+            throw std::out_of_range("ArrayStorage::at");
+        return data()[i];
+    }
+    const_reference at(size_type i) const
+    {
+        if (i >= size())
+            throw std::out_of_range("ArrayStorage::at");
+        return data()[i];
+    }
+    reference front() { return data()[0]; }
+    const_reference front() const { return data()[0]; }
+    reference back() { return data()[size() - 1]; }
+    const_reference back() const { return data()[size() - 1]; }
+
+    iterator begin() { return data(); }
+    iterator end() { return data() + size(); }
+    const_iterator begin() const noexcept { return data(); }
+    const_iterator end() const noexcept { return data() + size(); }
+    const_iterator cbegin() const noexcept { return begin(); }
+    const_iterator cend() const noexcept { return end(); }
+    reverse_iterator rbegin() { return reverse_iterator(end()); }
+    reverse_iterator rend() { return reverse_iterator(begin()); }
+    const_reverse_iterator rbegin() const noexcept
+    {
+        return const_reverse_iterator(end());
+    }
+    const_reverse_iterator rend() const noexcept
+    {
+        return const_reverse_iterator(begin());
+    }
+    const_reverse_iterator crbegin() const noexcept { return rbegin(); }
+    const_reverse_iterator crend() const noexcept { return rend(); }
+
+    void swap(ArrayStorage &other) noexcept
+    {
+        data_.swap(other.data_);
+        std::swap(view_, other.view_);
+        std::swap(view_size_, other.view_size_);
+        owner_.swap(other.owner_);
+    }
+    friend void swap(ArrayStorage &a, ArrayStorage &b) noexcept { a.swap(b); }
+
+    friend bool operator==(ArrayStorage const &a, ArrayStorage const &b)
+    {
+        return std::equal(a.begin(), a.end(), b.begin(), b.end());
+    }
+};
+} // namespace internal
+
 template <class T>
-using Array = xt::xarray_container<std::vector<T>, xt::layout_type::row_major,
-                                   std::vector<std::size_t>>;
+using Array =
+    xt::xarray_container<internal::ArrayStorage<T>, xt::layout_type::row_major,
+                         std::vector<std::size_t>>;
 class Tome;
 
 // compact numerical arrays
@@ -111,7 +307,7 @@ concept ArrayType = NumericArrayType<T> || std::same_as<T, Array<Tome>>;
 template <class T>
 concept CompoundType =
     std::same_as<T, Array<Tome>> ||
-    std::same_as<T, std::map<std::string, Tome>> || NumericArrayType<T>;
+    std::same_as<T, FlatDict<Tome>> || NumericArrayType<T>;
 
 template <class T>
 concept TomeType = AtomicType<T> || CompoundType<T>;
@@ -132,6 +328,52 @@ template <class F> struct ScopeGuard
         [&] { code; }                                                          \
     }
 
+namespace internal {
+// reverses the byte order of a number (of each part for complex numbers)
+template <NumberType T> T byteswap(T value)
+{
+    if constexpr (ComplexType<T>)
+        return T(byteswap(value.real()), byteswap(value.imag()));
+    else
+    {
+        auto bytes = std::bit_cast<std::array<char, sizeof(T)>>(value);
+        std::reverse(bytes.begin(), bytes.end());
+        return std::bit_cast<T>(bytes);
+    }
+}
+
+} // namespace internal
+
+// Rectangular selection ("hyperslab" in HDF5 lingo) of a multi-dimensional
+// array. All vectors have one entry per dimension. The selected elements in
+// dimension 'i' are 'offset[i] + k * stride[i]' for 'k < count[i]'.
+struct Hyperslab
+{
+    std::vector<size_t> offset;
+    std::vector<size_t> count;
+    std::vector<size_t> stride; // empty means all strides are 1
+
+    // throws ReadError if the selection does not fit into the given shape
+    void validate(std::span<const size_t> shape) const
+    {
+        if (offset.size() != shape.size() || count.size() != shape.size() ||
+            (!stride.empty() && stride.size() != shape.size()))
+            throw ReadError("hyperslab rank does not match array rank");
+        for (size_t i = 0; i < shape.size(); ++i)
+        {
+            size_t s = stride.empty() ? 1 : stride[i];
+            if (s == 0)
+                throw ReadError("hyperslab stride must be positive");
+            // written such that nothing can overflow
+            if (count[i] != 0 &&
+                (offset[i] >= shape[i] ||
+                 count[i] - 1 > (shape[i] - 1 - offset[i]) / s))
+                throw ReadError("hyperslab out of bounds in dimension " +
+                                std::to_string(i));
+        }
+    }
+};
+
 template <class R>
 concept Reader = requires(R &r, std::string_view key, bool &b, std::string &s,
                           int &i, double &d, std::complex<double> &c) {
@@ -144,4 +386,17 @@ concept Reader = requires(R &r, std::string_view key, bool &b, std::string &s,
     r.read(c, key);
 };
 
+template <class W>
+concept Writer = requires(W &w, std::string_view key, bool const &b,
+                          std::string const &s, int const &i, double const &d,
+                          std::complex<double> const &c) {
+    w.push(key);
+    w.pop();
+    w.write(b, key);
+    w.write(s, key);
+    w.write(i, key);
+    w.write(d, key);
+    w.write(c, key);
+};
+
 } // namespace scribe
\ No newline at end of file
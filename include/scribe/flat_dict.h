@@ -0,0 +1,558 @@
+#pragma once
+
+// Flat dictionary used as the backend of 'Tome::dict_type'.
+
+#include <algorithm>
+#include <compare>
+#include <concepts>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace scribe {
+
+namespace internal {
+// Allocator using a 'std::pmr::memory_resource', or the global heap if that
+// is nullptr. Unlike 'std::pmr::polymorphic_allocator', the resource moves
+// along with the container on move-assignment, such that assigning a freshly
+// created dict keeps its resource. Copies always use the global heap.
+template <class T> class ResourceAllocator
+{
+    std::pmr::memory_resource *memory_ = nullptr;
+
+  public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::false_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    ResourceAllocator() noexcept = default;
+    explicit ResourceAllocator(std::pmr::memory_resource *memory) noexcept
+        : memory_(memory)
+    {}
+    template <class U>
+    ResourceAllocator(ResourceAllocator<U> const &other) noexcept
+        : memory_(other.memory())
+    {}
+
+    std::pmr::memory_resource *memory() const noexcept { return memory_; }
+
+    T *allocate(size_t n)
+    {
+        if (memory_)
+            return static_cast<T *>(
+                memory_->allocate(n * sizeof(T), alignof(T)));
+        return static_cast<T *>(::operator new(n * sizeof(T)));
+    }
+    void deallocate(T *p, size_t n) noexcept
+    {
+        if (memory_)
+            memory_->deallocate(p, n * sizeof(T), alignof(T));
+        else
+            ::operator delete(p);
+    }
+
+    ResourceAllocator select_on_container_copy_construction() const
+    {
+        return {};
+    }
+
+    friend bool operator==(ResourceAllocator const &a,
+                           ResourceAllocator const &b) noexcept
+    {
+        if (a.memory_ == b.memory_)
+            return true;
+        return a.memory_ && b.memory_ && a.memory_->is_equal(*b.memory_);
+    }
+};
+} // namespace internal
+
+// Immutable string used as key of 'FlatDict'. Short keys (the vast majority
+// in practice) are stored inline, without any allocation. Longer keys are
+// stored on the heap (or a given memory resource), shared between copies.
+// Long keys created through a 'KeyPool' are interned, i.e. equal keys are
+// copies of each other, and comparing them is a pointer comparison.
+class DictKey
+{
+    static constexpr size_t inline_capacity = 15;
+
+    std::shared_ptr<const std::pmr::string> long_; // nullptr for short keys
+    char short_[inline_capacity] = {};
+    unsigned char short_size_ = 0;
+
+  public:
+    DictKey() = default;
+    DictKey(std::string_view s) : DictKey(s, nullptr) {}
+    DictKey(std::string const &s) : DictKey(std::string_view(s)) {}
+    DictKey(char const *s) : DictKey(std::string_view(s)) {}
+
+    // long keys allocated from 'memory' (the global heap if nullptr), which
+    // then has to outlive the key and all its copies
+    DictKey(std::string_view s, std::pmr::memory_resource *memory)
+    {
+        if (s.size() <= inline_capacity)
+        {
+            s.copy(short_, s.size());
+            short_size_ = static_cast<unsigned char>(s.size());
+        }
+        else
+            long_ = std::allocate_shared<const std::pmr::string>(
+                internal::ResourceAllocator<std::pmr::string>(memory), s,
+                memory ? memory : std::pmr::get_default_resource());
+    }
+    // NOTE: for short keys, this points into the key object itself
+    std::string_view view() const
+    {
+        return long_ ? std::string_view(*long_)
+                     : std::string_view(short_, short_size_);
+    }
+    std::string str() const { return std::string(view()); }
+    operator std::string_view() const { return view(); }
+
+    // true if both share the same heap storage, which implies equality
+    bool same(DictKey const &other) const
+    {
+        return long_ && long_ == other.long_;
+    }
+
+    friend bool operator==(DictKey const &a, DictKey const &b)
+    {
+        return a.same(b) || a.view() == b.view();
+    }
+    friend bool operator==(DictKey const &a, std::string_view b)
+    {
+        return a.view() == b;
+    }
+    friend bool operator==(DictKey const &a, std::string const &b)
+    {
+        return a.view() == b;
+    }
+    friend bool operator==(DictKey const &a, char const *b)
+    {
+        return a.view() == b;
+    }
+    friend std::strong_ordering operator<=>(DictKey const &a,
+                                            DictKey const &b)
+    {
+        if (a.same(b))
+            return std::strong_ordering::equal;
+        return a.view() <=> b.view();
+    }
+};
+
+// Set of interned keys. Reading a large array of dicts through a pool stores
+// each distinct (long) key only once, instead of once per dict. The keys can
+// be allocated from a memory resource, which has to outlive all copies.
+class KeyPool
+{
+    struct Hash
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view s) const noexcept
+        {
+            return std::hash<std::string_view>()(s);
+        }
+    };
+    struct Equal
+    {
+        using is_transparent = void;
+        bool operator()(std::string_view a, std::string_view b) const noexcept
+        {
+            return a == b;
+        }
+    };
+
+    std::unordered_set<DictKey, Hash, Equal> keys_;
+    std::pmr::memory_resource *memory_ = nullptr;
+
+  public:
+    KeyPool() = default;
+    explicit KeyPool(std::pmr::memory_resource *memory) : memory_(memory) {}
+
+    DictKey const &intern(std::string_view key)
+    {
+        if (auto it = keys_.find(key); it != keys_.end())
+            return *it;
+        return *keys_.emplace(key, memory_).first;
+    }
+
+    size_t size() const { return keys_.size(); }
+};
+
+// anything a 'FlatDict' can be indexed with
+template <class K>
+concept DictKeyLike = std::convertible_to<K const &, std::string_view>;
+
+// Map from strings to 'V', stored as a vector of pointers to (key, value)
+// pairs, sorted by key. Compared to 'std::map', lookups are a binary search
+// over contiguous memory, and building a dict of n items in order (as readers
+// do) is O(n), without any tree rebalancing. Lookups take anything
+// convertible to 'std::string_view' and never create a temporary
+// 'std::string'. Lookups and insertions using a 'DictKey' share its storage
+// and compare by pointer first.
+// NOTE: as for 'std::map', each item is a separate allocation, so inserting
+//       or erasing items never invalidates references to other items (e.g.
+//       'dict["y"] = dict["x"]' is fine). Iterators are invalidated though,
+//       as for 'std::vector'.
+// NOTE: 'V' may be incomplete when this class is instantiated, which allows
+//       recursive types like 'Tome'.
+// NOTE: the items can be allocated from a 'std::pmr::memory_resource' (e.g.
+//       an arena), which then has to outlive the dict. Copies of the dict use
+//       the global heap again.
+template <class V> class FlatDict
+{
+  public:
+    using key_type = DictKey;
+    using mapped_type = V;
+    using value_type = std::pair<DictKey, V>;
+    using size_type = size_t;
+    using allocator_type = internal::ResourceAllocator<value_type>;
+
+  private:
+    using storage_type =
+        std::vector<value_type *, internal::ResourceAllocator<value_type *>>;
+
+    // iterator over the items, hiding the indirection
+    template <bool Const> class Iterator
+    {
+        friend class FlatDict;
+        using base_type =
+            std::conditional_t<Const, typename storage_type::const_iterator,
+                               typename storage_type::iterator>;
+        base_type it_;
+
+      public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = FlatDict::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<Const, value_type const *,
+                                           value_type *>;
+        using reference = std::conditional_t<Const, value_type const &,
+                                             value_type &>;
+
+        Iterator() = default;
+        explicit Iterator(base_type it) : it_(it) {}
+        operator Iterator<true>() const
+            requires(!Const)
+        {
+            return Iterator<true>(it_);
+        }
+
+        reference operator*() const { return **it_; }
+        pointer operator->() const { return *it_; }
+        reference operator[](difference_type n) const { return *it_[n]; }
+
+        Iterator &operator++()
+        {
+            ++it_;
+            return *this;
+        }
+        Iterator operator++(int) { return Iterator(it_++); }
+        Iterator &operator--()
+        {
+            --it_;
+            return *this;
+        }
+        Iterator operator--(int) { return Iterator(it_--); }
+        Iterator &operator+=(difference_type n)
+        {
+            it_ += n;
+            return *this;
+        }
+        Iterator &operator-=(difference_type n)
+        {
+            it_ -= n;
+            return *this;
+        }
+        friend Iterator operator+(Iterator a, difference_type n)
+        {
+            return a += n;
+        }
+        friend Iterator operator+(difference_type n, Iterator a)
+        {
+            return a += n;
+        }
+        friend Iterator operator-(Iterator a, difference_type n)
+        {
+            return a -= n;
+        }
+        friend difference_type operator-(Iterator const &a, Iterator const &b)
+        {
+            return a.it_ - b.it_;
+        }
+        friend bool operator==(Iterator const &a, Iterator const &b)
+        {
+            return a.it_ == b.it_;
+        }
+        friend auto operator<=>(Iterator const &a, Iterator const &b)
+        {
+            return a.it_ <=> b.it_;
+        }
+    };
+
+  public:
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+  private:
+    storage_type items_; // sorted by key, no duplicates
+
+    static bool equal(DictKey const &a, DictKeyLike auto const &b)
+    {
+        if constexpr (std::same_as<std::decay_t<decltype(b)>, DictKey>)
+            return a == b; // compares pointers first
+        else
+            return std::string_view(a) == std::string_view(b);
+    }
+
+    // first item with key >= 'key'
+    typename storage_type::const_iterator
+    lower_bound(DictKeyLike auto const &key) const
+    {
+        auto k = std::string_view(key);
+
+        // fast path for inserting in sorted order (e.g. when reading files)
+        if (items_.empty() || std::string_view(items_.back()->first) < k)
+            return items_.end();
+        return std::lower_bound(items_.begin(), items_.end(), k,
+                                [](value_type const *item, std::string_view x) {
+                                    return std::string_view(item->first) < x;
+                                });
+    }
+    typename storage_type::iterator lower_bound(DictKeyLike auto const &key)
+    {
+        return items_.begin() +
+               (std::as_const(*this).lower_bound(key) - items_.cbegin());
+    }
+
+    static DictKey make_key(DictKeyLike auto const &key)
+    {
+        if constexpr (std::same_as<std::decay_t<decltype(key)>, DictKey>)
+            return key; // shares storage
+        else
+            return DictKey(std::string_view(key));
+    }
+
+    // allocates a single item from the resource of the dict
+    template <class... Args> value_type *make_item(Args &&...args)
+    {
+        auto alloc = allocator_type(memory());
+        auto *item = alloc.allocate(1);
+        try
+        {
+            return std::construct_at(item, std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            alloc.deallocate(item, 1);
+            throw;
+        }
+    }
+    // room for one more item, such that inserting its pointer cannot fail
+    // after the item was created
+    void grow()
+    {
+        if (items_.size() == items_.capacity())
+            items_.reserve(std::max(size_t(4), 2 * items_.capacity()));
+    }
+    void destroy_item(value_type *item) noexcept
+    {
+        std::destroy_at(item);
+        allocator_type(memory()).deallocate(item, 1);
+    }
+
+    // copies all items of 'other' into this (empty) dict
+    void copy_items(FlatDict const &other)
+    {
+        items_.reserve(other.size());
+        try
+        {
+            for (auto const *item : other.items_)
+                items_.push_back(make_item(*item));
+        }
+        catch (...)
+        {
+            clear();
+            throw;
+        }
+    }
+
+  public:
+    FlatDict() = default;
+    explicit FlatDict(std::pmr::memory_resource *memory)
+        : items_(typename storage_type::allocator_type(memory))
+    {}
+
+    // if a key appears multiple times, the first one wins (same as std::map)
+    FlatDict(std::initializer_list<value_type> items)
+    {
+        items_.reserve(items.size());
+        for (auto const &item : items)
+            insert(item);
+    }
+
+    FlatDict(FlatDict const &other) { copy_items(other); }
+    FlatDict(FlatDict &&other) noexcept : items_(std::move(other.items_)) {}
+    FlatDict &operator=(FlatDict const &other)
+    {
+        if (this != &other)
+        {
+            clear();
+            copy_items(other);
+        }
+        return *this;
+    }
+    // NOTE: takes over the resource of 'other', along with its items
+    FlatDict &operator=(FlatDict &&other) noexcept
+    {
+        if (this != &other)
+        {
+            clear();
+            items_ = std::move(other.items_);
+            other.items_.clear();
+        }
+        return *this;
+    }
+    ~FlatDict() { clear(); }
+
+    iterator begin() { return iterator(items_.begin()); }
+    iterator end() { return iterator(items_.end()); }
+    const_iterator begin() const { return const_iterator(items_.begin()); }
+    const_iterator end() const { return const_iterator(items_.end()); }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+
+    // resource the items are allocated from. nullptr for the global heap
+    std::pmr::memory_resource *memory() const
+    {
+        return items_.get_allocator().memory();
+    }
+
+    size_t size() const { return items_.size(); }
+    bool empty() const { return items_.empty(); }
+    void clear() noexcept
+    {
+        for (auto *item : items_)
+            destroy_item(item);
+        items_.clear();
+    }
+    void reserve(size_t n) { items_.reserve(n); }
+
+    iterator find(DictKeyLike auto const &key)
+    {
+        auto it = lower_bound(key);
+        return iterator(it != items_.end() && equal((*it)->first, key)
+                            ? it
+                            : items_.end());
+    }
+    const_iterator find(DictKeyLike auto const &key) const
+    {
+        auto it = lower_bound(key);
+        return const_iterator(it != items_.end() && equal((*it)->first, key)
+                                  ? it
+                                  : items_.end());
+    }
+    bool contains(DictKeyLike auto const &key) const
+    {
+        return find(key) != end();
+    }
+    size_t count(DictKeyLike auto const &key) const { return contains(key); }
+
+    V &at(DictKeyLike auto const &key)
+    {
+        auto it = find(key);
+        if (it == end())
+            throw std::out_of_range("key not found: " +
+                                    std::string(std::string_view(key)));
+        return it->second;
+    }
+    V const &at(DictKeyLike auto const &key) const
+    {
+        auto it = find(key);
+        if (it == end())
+            throw std::out_of_range("key not found: " +
+                                    std::string(std::string_view(key)));
+        return it->second;
+    }
+
+    // inserts a default-constructed value if the key does not exist yet
+    V &operator[](DictKeyLike auto const &key)
+    {
+        return try_emplace(key).first->second;
+    }
+
+    // constructs a value from 'args' if the key does not exist yet
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(DictKeyLike auto const &key,
+                                          Args &&...args)
+    {
+        auto it = lower_bound(key);
+        if (it != items_.end() && equal((*it)->first, key))
+            return {iterator(it), false};
+        auto pos = it - items_.begin();
+        grow();
+        auto *item = make_item(
+            std::piecewise_construct, std::forward_as_tuple(make_key(key)),
+            std::forward_as_tuple(std::forward<Args>(args)...));
+        return {iterator(items_.insert(items_.begin() + pos, item)), true};
+    }
+
+    std::pair<iterator, bool> insert(value_type item)
+    {
+        auto it = lower_bound(item.first);
+        if (it != items_.end() && equal((*it)->first, item.first))
+            return {iterator(it), false};
+        auto pos = it - items_.begin();
+        grow();
+        auto *p = make_item(std::move(item));
+        return {iterator(items_.insert(items_.begin() + pos, p)), true};
+    }
+
+    // Bulk insertion, for building a dict from many items in any order (e.g.
+    // when reading a file): 'append_unsorted' adds an item without keeping
+    // the items sorted, 'sort' restores the order after the last one, in
+    // O(n log n) total instead of O(n^2) for inserting one by one. In between,
+    // the dict must only be iterated, and the keys have to be unique.
+    V &append_unsorted(DictKeyLike auto const &key)
+    {
+        grow();
+        auto *item = make_item(std::piecewise_construct,
+                               std::forward_as_tuple(make_key(key)),
+                               std::forward_as_tuple());
+        items_.push_back(item);
+        return item->second;
+    }
+    void sort()
+    {
+        auto less = [](value_type const *a, value_type const *b) {
+            return a->first < b->first;
+        };
+        if (!std::is_sorted(items_.begin(), items_.end(), less))
+            std::sort(items_.begin(), items_.end(), less);
+    }
+
+    iterator erase(const_iterator it)
+    {
+        destroy_item(*it.it_);
+        return iterator(items_.erase(it.it_));
+    }
+    size_t erase(DictKeyLike auto const &key)
+    {
+        auto it = find(key);
+        if (it == end())
+            return 0;
+        erase(it);
+        return 1;
+    }
+};
+
+} // namespace scribe
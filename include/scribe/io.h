@@ -37,7 +37,9 @@ template <class T> void read(T &data, Reader auto &reader, std::string_view key)
     }
 }
 
-void read_file(auto &data, std::string_view filename)
+// 'options.num_threads' is supported for HDF5. 'options.lazy' is not.
+void read_file(auto &data, std::string_view filename,
+               ReadOptions const &options = {})
 {
     if (filename.ends_with(".json"))
     {
@@ -46,11 +48,85 @@ void read_file(auto &data, std::string_view filename)
     }
     else if (filename.ends_with(".h5") || filename.ends_with(".hdf5"))
     {
-        auto file = scribe::Hdf5Reader(filename);
+        auto file = scribe::Hdf5Reader(filename, options.num_threads);
         read(data, file);
+        file.finish();
     }
     else
         throw ReadError("dont recognize file format for " +
                         std::string(filename));
 }
+
+// writing basic types just relays to the writer directly
+void write(AtomicType auto const &data, Writer auto &writer,
+           std::string_view key)
+{
+    writer.write(data, key);
+}
+void write(NumericArrayType auto const &data, Writer auto &writer,
+           std::string_view key)
+{
+    writer.write(data, key);
+}
+template <class T>
+void write(std::optional<T> const &data, Writer auto &writer,
+           std::string_view key)
+{
+    writer.write(data, key);
+}
+
+// arrays with the storage hints of their schema (see 'StorageHints'). Writers
+// without support for hints ignore them.
+template <NumberType T>
+void write(Array<T> const &data, Writer auto &writer, std::string_view key,
+           StorageHints const &hints)
+{
+    if constexpr (requires { writer.write(data, key, hints); })
+        writer.write(data, key, hints);
+    else
+        writer.write(data, key);
+}
+template <NumberType T>
+void write(std::optional<Array<T>> const &data, Writer auto &writer,
+           std::string_view key, StorageHints const &hints)
+{
+    if (data)
+        write(*data, writer, key, hints);
+}
+
+// convenience function that enables as user type to only implement key-less
+// writing
+template <class T>
+void write(T const &data, Writer auto &writer, std::string_view key)
+{
+    if (key.empty())
+    {
+        write(data, writer);
+    }
+    else
+    {
+        writer.push(key);
+        SCRIBE_DEFER(writer.pop());
+        write(data, writer);
+    }
+}
+
+void write_file(std::string_view filename, auto const &data)
+{
+    if (filename.ends_with(".json"))
+    {
+        auto file = scribe::JsonWriter(filename);
+        write(data, file);
+        file.finish();
+    }
+    else if (filename.ends_with(".h5") || filename.ends_with(".hdf5"))
+    {
+        auto file = scribe::Hdf5Writer(filename);
+        write(data, file);
+        file.finish();
+    }
+    else
+        throw WriteError("dont recognize file format for " +
+                         std::string(filename));
+}
 } // namespace scribe
\ No newline at end of file
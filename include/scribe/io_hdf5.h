@@ -4,41 +4,215 @@
 #include "scribe/tome.h"
 
 #include "highfive/highfive.hpp"
+#include <mutex>
+#include <unordered_map>
 
 namespace scribe {
 namespace internal {
+
+// HDF5 itself is not thread-safe, so every call into it (including closing
+// handles) holds this process-wide lock. Recursive, as entry points nest, e.g.
+// writing a Tome to HDF5 can load lazy values from another HDF5 file.
+std::recursive_mutex &hdf5_mutex();
+inline std::unique_lock<std::recursive_mutex> hdf5_lock()
+{
+    return std::unique_lock(hdf5_mutex());
+}
+
+// metadata of a single object (group or dataset) in an HDF5 file
+struct Hdf5ObjectInfo
+{
+    HighFive::ObjectType type = HighFive::ObjectType::Other;
+    bool is_string = false;          // datasets only
+    std::optional<NumType> num_type; // datasets only, nullopt if not numeric
+    std::vector<size_t> shape;       // datasets only
+    std::optional<uint64_t> offset;  // contiguous unfiltered datasets only
+};
+
+// Metadata of all objects below 'root', collected in a single pass over the
+// file ('H5Ovisit'), so that reading does not need separate HDF5 lookups for
+// every object. Objects not seen by the visit (e.g. soft links, or a second
+// hard link to the same object) are described on first access.
+class Hdf5Index
+{
+    std::unordered_map<std::string, Hdf5ObjectInfo> objects_;
+
+  public:
+    explicit Hdf5Index(HighFive::File const &, std::string const &root = "/");
+
+    // object 'name' inside 'parent' (or 'parent' itself if 'name' is empty),
+    // where 'path' is the absolute path of the object. nullptr if it does not
+    // exist.
+    Hdf5ObjectInfo const *find(HighFive::Group const &parent,
+                               std::string const &name,
+                               std::string const &path);
+};
+
+// describes the object 'name' inside 'parent'. nullopt if it does not exist
+std::optional<Hdf5ObjectInfo> hdf5_object_info(HighFive::Group const &parent,
+                                               std::string const &name);
+
+// Reads of numeric array datasets into preallocated buffers, deferred until
+// 'run()' so that they can be executed by multiple threads. Contiguous and
+// unfiltered datasets are read with plain 'pread' directly from the file,
+// bypassing HDF5. Everything else (e.g. chunked/compressed datasets) falls
+// back to HDF5 itself, on the calling thread only (holding 'hdf5_mutex()').
+class Hdf5ReadQueue
+{
+    struct Item
+    {
+        HighFive::DataSet dataset;
+        HighFive::DataType mem_type;
+        void *data = nullptr;
+        size_t bytes = 0;
+        std::optional<uint64_t> offset; // set if directly readable from file
+    };
+
+    std::string filename_;
+    bool direct_ = false; // file uses the default (POSIX) driver
+    std::vector<Item> items_;
+
+    void push(HighFive::DataSet const &, HighFive::DataType const &mem_type,
+              void *data, size_t bytes);
+    void push(HighFive::DataSet const &, HighFive::DataType const &mem_type,
+              void *data, size_t bytes, std::optional<uint64_t> offset);
+
+  public:
+    explicit Hdf5ReadQueue(HighFive::File const &);
+
+    // schedule reading the full dataset into 'data', which has to stay valid
+    // until 'run()'. Size and type have to be checked by the caller.
+    template <NumberType T>
+    void push(HighFive::DataSet const &dataset, T *data)
+    {
+        push(dataset, HighFive::create_datatype<T>(), data,
+             dataset.getElementCount() * sizeof(T));
+    }
+
+    // same, using the metadata from an 'Hdf5Index' instead of querying HDF5
+    template <NumberType T>
+    void push(HighFive::DataSet const &dataset, T *data,
+              Hdf5ObjectInfo const &info)
+    {
+        size_t count = 1;
+        for (auto n : info.shape)
+            count *= n;
+        push(dataset, HighFive::create_datatype<T>(), data, count * sizeof(T),
+             info.num_type == num_type_of<T>() ? info.offset : std::nullopt);
+    }
+
+    // execute (and clear) all scheduled reads using 'num_threads' threads
+    void run(int num_threads);
+};
+
 // validates and reads a JSON object according to the given schema
 //   * throws ValidationError if the JSON object does not follow the schema
 //   * set tome=nullptr to only validate
+//   * if 'queue' is given, the data of numeric arrays is only read by
+//     'queue->run()'
+//   * dicts are allocated from 'memory' if given (see 'ReadOptions::memory')
 void read_hdf5(Tome *, HighFive::File &, std::string const &path,
-               Schema const &);
+               Schema const &, Hdf5ReadQueue *queue = nullptr,
+               std::pmr::memory_resource *memory = nullptr);
 
 void write_hdf5(HighFive::File &, std::string const &path, Tome const &,
                 Schema const &);
+
+// same as 'write_hdf5', but for a file that already contains 'base'. Only
+// writes the parts of the Tome that changed since (see 'WriteOptions::base')
+void update_hdf5(HighFive::File &, std::string const &path, Tome const &,
+                 Tome const &base, Schema const &);
+
+// reads part of a numeric array dataset into a compact array of matching type
+void read_hdf5_slice(Tome &, HighFive::File &, std::string const &path,
+                     Hyperslab const &);
+
+// lazily reads an HDF5 object without schema (see 'Tome::lazy'). The file is
+// kept open as long as any part of the Tome refers to it.
+void read_hdf5_lazy(Tome &, std::shared_ptr<HighFive::File>,
+                    std::string const &path);
+
+// dataset creation properties implementing the storage hints of the schema
+HighFive::DataSetCreateProps
+hdf5_create_props(ArraySchema const &, std::vector<size_t> const &shape);
+HighFive::DataSetCreateProps
+hdf5_create_props(Hdf5StorageHints const &, std::vector<size_t> const &shape);
+
+// chunk dimensions of an appendable array (see 'Appender') with rows of the
+// given shape. Unless the schema specifies the number of rows per chunk,
+// chunks hold roughly 16k elements (but at least one row).
+std::vector<size_t> hdf5_appendable_chunk_dims(ArraySchema const &,
+                                               std::span<const size_t> row);
+
+// if the schema specifies a chunk size, the dataset has to match it
+void hdf5_validate_chunking(ArraySchema const &, HighFive::DataSet const &,
+                            std::vector<size_t> const &shape);
+
+// NumType corresponding to an HDF5 datatype. nullopt for non-numeric types
+std::optional<NumType> hdf5_num_type(HighFive::DataType const &);
+
+// Reads a numeric dataset stored with a different type than 'type' into
+// 'data'. HDF5 would convert silently (clamping values out of range), so
+// this reads the stored type instead, and validates every value against
+// 'type' before converting it. Throws ValidationError.
+void hdf5_read_converted(HighFive::DataSet const &, Hdf5ObjectInfo const &,
+                         NumType type, void *data);
 } // namespace internal
 
 class Hdf5Reader
 {
     HighFive::File file_;
+    internal::Hdf5Index index_;
     std::vector<HighFive::Group> stack_;
     std::vector<std::string> keys_;
+    int num_threads_ = 1;
+    std::optional<internal::Hdf5ReadQueue> queue_;
 
     HighFive::Group const &current() const { return stack_.back(); }
 
+    // metadata of the object 'key' in the current group. nullptr if missing
+    internal::Hdf5ObjectInfo const *find(std::string const &key)
+    {
+        auto path = keys_.empty() ? "/" + key : current_path() + "/" + key;
+        return index_.find(current(), key, path);
+    }
+
   public:
     Hdf5Reader(Hdf5Reader const &) = delete;
     Hdf5Reader &operator=(Hdf5Reader const &) = delete;
 
-    explicit Hdf5Reader(std::string_view filename)
-    try : file_(std::string(filename), HighFive::File::ReadOnly)
+    // With num_threads > 1, the data of numeric arrays is read in parallel
+    // by 'finish()', and is only valid after that.
+    explicit Hdf5Reader(std::string_view filename, int num_threads = 1)
+        : Hdf5Reader(filename, num_threads, internal::hdf5_lock())
+    {}
+
+    ~Hdf5Reader()
+    {
+        // HDF5 handles are closed under the lock as well
+        auto lock = internal::hdf5_lock();
+        queue_.reset();
+        stack_.clear();
+        auto file = std::move(file_);
+    }
+
+  private:
+    // holds the lock while the members are constructed
+    Hdf5Reader(std::string_view filename, int num_threads,
+               std::unique_lock<std::recursive_mutex>)
+    try : file_(std::string(filename), HighFive::File::ReadOnly),
+        index_(file_), num_threads_(num_threads)
     {
         stack_.push_back(file_.getGroup("/"));
+        if (num_threads_ > 1)
+            queue_.emplace(file_);
     }
     catch (HighFive::FileException const &e)
     {
         throw ReadError(e.what());
     }
 
+  public:
     // human-readable location in the JSON file
     std::string current_path() const
     {
@@ -47,11 +221,12 @@ class Hdf5Reader
 
     void push(std::string_view key_)
     {
+        auto lock = internal::hdf5_lock();
         // HighFive does not like string_view's :(
         auto key = std::string(key_);
 
         assert(!key.empty());
-        if (!current().exist(key))
+        if (!find(key))
             throw ReadError("missing key '" + std::string(key) + "' at " +
                             current_path());
         stack_.push_back(current().getGroup(key));
@@ -61,12 +236,14 @@ class Hdf5Reader
     void pop() noexcept
     {
         assert(stack_.size() > 1);
+        auto lock = internal::hdf5_lock();
         keys_.pop_back();
         stack_.pop_back();
     }
 
     void read(AtomicType auto &value, std::string_view key_)
     {
+        auto lock = internal::hdf5_lock();
         auto key = std::string(key_);
         auto dset = current().getDataSet(key);
         dset.read(value);
@@ -74,9 +251,10 @@ class Hdf5Reader
 
     template <class T> void read(std::optional<T> &value, std::string_view key_)
     {
+        auto lock = internal::hdf5_lock();
         auto key = std::string(key_);
         assert(!key.empty());
-        if (!current().exist(key))
+        if (!find(key))
         {
             value.reset();
             return;
@@ -89,13 +267,184 @@ class Hdf5Reader
 
     void read(NumericArrayType auto &value, std::string_view key_)
     {
+        auto lock = internal::hdf5_lock();
         auto key = std::string(key_);
+        auto info = find(key);
+        if (!info)
+            throw ReadError("missing key '" + key + "' at " + current_path());
         auto dset = current().getDataSet(key);
-        value.resize(dset.getSpace().getDimensions());
-        dset.read(value.data());
+        value.resize(info->shape);
+        auto type = num_type_of<typename std::decay_t<
+            decltype(value)>::value_type>();
+        if (info->num_type && *info->num_type != type)
+            internal::hdf5_read_converted(dset, *info, type, value.data());
+        else if (queue_)
+            queue_->push(dset, value.data(), *info);
+        else
+            dset.read(value.data());
+    }
+
+    // partial read of an array dataset. 'value' is resized to 'slab.count'
+    void read(NumericArrayType auto &value, std::string_view key_,
+              Hyperslab const &slab)
+    {
+        auto lock = internal::hdf5_lock();
+        auto key = std::string(key_);
+        auto dset = current().getDataSet(key);
+        slab.validate(dset.getDimensions());
+        value.resize(slab.count);
+        dset.select(slab.offset, slab.count, slab.stride)
+            .read_raw(value.data());
+    }
+
+    // execute all deferred reads (no-op if num_threads <= 1)
+    void finish()
+    {
+        auto lock = internal::hdf5_lock();
+        if (queue_)
+            queue_->run(num_threads_);
     }
 };
 
 static_assert(Reader<Hdf5Reader>);
 
+class Hdf5Writer
+{
+    HighFive::File file_;
+    std::vector<HighFive::Group> stack_;
+
+    HighFive::Group &current() { return stack_.back(); }
+
+  public:
+    Hdf5Writer(Hdf5Writer const &) = delete;
+    Hdf5Writer &operator=(Hdf5Writer const &) = delete;
+
+    // truncates the file if it exists
+    explicit Hdf5Writer(std::string_view filename)
+        : Hdf5Writer(filename, internal::hdf5_lock())
+    {}
+
+    ~Hdf5Writer()
+    {
+        // HDF5 handles are closed under the lock as well
+        auto lock = internal::hdf5_lock();
+        stack_.clear();
+        auto file = std::move(file_);
+    }
+
+  private:
+    // holds the lock while the members are constructed
+    Hdf5Writer(std::string_view filename,
+               std::unique_lock<std::recursive_mutex>)
+    try : file_(std::string(filename), HighFive::File::ReadWrite |
+                                           HighFive::File::Create |
+                                           HighFive::File::Truncate)
+    {
+        stack_.push_back(file_.getGroup("/"));
+    }
+    catch (HighFive::FileException const &e)
+    {
+        throw WriteError(e.what());
+    }
+
+  public:
+    void push(std::string_view key)
+    {
+        assert(!key.empty());
+        auto lock = internal::hdf5_lock();
+        stack_.push_back(current().createGroup(std::string(key)));
+    }
+
+    void pop() noexcept
+    {
+        assert(stack_.size() > 1);
+        auto lock = internal::hdf5_lock();
+        stack_.pop_back();
+    }
+
+    void write(AtomicType auto const &value, std::string_view key)
+    {
+        auto lock = internal::hdf5_lock();
+        current().createDataSet(std::string(key), value);
+    }
+
+    template <class T>
+    void write(std::optional<T> const &value, std::string_view key)
+    {
+        if (value)
+            write(*value, key);
+    }
+
+    // written directly from the array's memory, without any copy. The
+    // dataset is chunked and filtered according to the HDF5 part of 'hints'.
+    template <NumberType T>
+    void write(Array<T> const &value, std::string_view key,
+               StorageHints const &hints = {})
+    {
+        auto lock = internal::hdf5_lock();
+        auto shape = std::vector<size_t>(value.shape().begin(),
+                                         value.shape().end());
+        auto dataset = current().createDataSet<T>(
+            std::string(key), HighFive::DataSpace(shape),
+            internal::hdf5_create_props(hints.hdf5, shape));
+        dataset.write_raw(value.data());
+    }
+
+    void finish()
+    {
+        auto lock = internal::hdf5_lock();
+        file_.flush();
+    }
+};
+
+static_assert(Writer<Hdf5Writer>);
+
+// Appends to arrays along their leading dimension, e.g. for time series that
+// a simulation produces step by step. Appending only writes the new data, no
+// matter how large the file already is.
+//   * arrays are appendable if their schema has '-1' as the first entry of
+//     'shape'. They are stored as chunked datasets with unlimited leading
+//     dimension, created on the first append. Existing datasets (e.g. from a
+//     previous run) are continued, and have to be stored that way.
+//   * 'append' takes a dict following the schema, in which all items are
+//     optional. Appendable arrays get the given rows appended, which is
+//     either an array of the same rank, or a single row (one dimension less,
+//     i.e. a plain number for 1D arrays). Other items are written if they do
+//     not exist in the file yet, and are an error otherwise.
+//   * rows are buffered and written as soon as a full chunk is pending.
+//     'flush()' writes all pending rows and flushes the file, so that its
+//     content is complete on disk (e.g. in case the job is preempted). The
+//     destructor does the same, but ignores errors.
+//   * if 'append' throws, parts of the dict might have been appended already
+class Appender
+{
+    struct Series; // dataset of a single appendable array
+
+    HighFive::File file_;
+    ValidationPlan plan_;
+    std::unordered_map<std::string, std::unique_ptr<Series>> series_;
+
+    void append(HighFive::Group &parent, std::string const &name,
+                std::string const &path, Tome const &, ValidationPlan::NodeId);
+    void append_rows(HighFive::Group &parent, std::string const &name,
+                     std::string const &path, Tome const &,
+                     ArraySchema const &);
+    void write(Series &);
+
+    // holds the lock while the members are constructed
+    Appender(std::string_view filename, Schema const &,
+             std::unique_lock<std::recursive_mutex>);
+
+  public:
+    Appender(Appender const &) = delete;
+    Appender &operator=(Appender const &) = delete;
+
+    // opens the file, creating it if it does not exist yet
+    Appender(std::string_view filename, Schema const &);
+    ~Appender();
+
+    void append(Tome const &);
+    void flush();
+};
+
 } // namespace scribe
\ No newline at end of file
@@ -1,9 +1,19 @@
 #pragma once
 
+#include "fmt/format.h"
 #include "nlohmann/json.hpp"
 #include "scribe/schema.h"
 #include "scribe/tome.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
 #include <fstream>
+#include <functional>
+#include <iterator>
+#include <span>
+#include <vector>
 
 namespace scribe {
 namespace internal {
@@ -13,14 +23,110 @@ namespace internal {
 //   * set tome=nullptr to only validate
 void read_json(Tome *, nlohmann::json const &, Schema const &);
 
-// writes a JSON object according to the given schema
-void write_json(nlohmann::json &, Tome const &, Schema const &);
+// same as 'read_json', but parses the JSON text directly, without creating
+// a nlohmann::json document first. Validation-only (tome=nullptr) therefore
+// needs constant memory, independent of the size of the input. Comments are
+// allowed in the input. Dicts are allocated from 'memory' if given (see
+// 'ReadOptions::memory').
+void read_json_stream(Tome *, std::istream &, Schema const &,
+                      std::pmr::memory_resource *memory = nullptr);
+void read_json_stream(Tome *, std::string_view, Schema const &,
+                      std::pmr::memory_resource *memory = nullptr);
+
+// receives the output of 'write_json_stream' in blocks
+using JsonSink = std::function<void(std::string_view)>;
+
+// writes JSON text according to the given schema, without creating a
+// nlohmann::json document first. Output is passed to 'sink' in blocks of
+// limited size, so memory usage does not depend on the size of the output.
+//   * 'indent' is the number of spaces per nesting level. Negative for compact
+//     output without any whitespace (same as 'nlohmann::json::dump').
+//   * floating point numbers are written in the shortest form that reads back
+//     to the exact same value
+//   * throws ValidationError if the Tome does not follow the schema. Output
+//     passed to 'sink' up to that point is not retracted.
+void write_json_stream(JsonSink const &sink, Tome const &, Schema const &,
+                       int indent = 4);
+
+// binary encodings of the JSON data model
+enum class BinaryFormat
+{
+    CBOR,       // RFC 8949
+    MessagePack // https://msgpack.org
+};
+
+// Same as 'read_json_stream'/'write_json_stream', for CBOR or MessagePack.
+// Numeric arrays are stored as packed little-endian typed arrays, one for
+// each innermost row (a 1D array is a single typed array, higher dimensions
+// are nested arrays of those):
+//   * CBOR: byte string tagged as typed array (RFC 8746, tags 64-87)
+//   * MessagePack: ext value, with the RFC 8746 tag number as ext type
+// Complex numbers are stored as interleaved real and imaginary parts. Besides
+// these, the reader also accepts element-by-element arrays, big-endian typed
+// arrays and untagged byte strings (read as uint8). Other CBOR tags are
+// ignored, except on byte strings. Both formats are read in a streaming
+// fashion. The stream has to be opened in binary mode.
+void read_binary_stream(Tome *, std::istream &, Schema const &, BinaryFormat,
+                        std::pmr::memory_resource *memory = nullptr);
+void write_binary_stream(JsonSink const &sink, Tome const &, Schema const &,
+                         BinaryFormat);
 
 } // namespace internal
 
 namespace internal {
 std::vector<size_t> guess_array_shape(nlohmann::json const &json);
 
+// Base64 (RFC 4648, with padding). 'out' needs space for '4 * ceil(size / 3)'
+// characters. Returns the end of the output.
+char *base64_encode(std::span<const std::byte> data, char *out);
+
+// size of the data encoded in 'text'. Throws ReadError for invalid lengths.
+size_t base64_decoded_size(std::string_view text);
+
+// 'out' has to be exactly 'base64_decoded_size(text)' bytes. Throws
+// ReadError on invalid characters.
+void base64_decode(std::string_view text, std::span<std::byte> out);
+
+// the base64 form of an array of numbers (see 'JsonStorageHints')
+struct Base64Array
+{
+    std::string_view dtype;
+    std::vector<size_t> shape;
+    std::string_view data; // raw little-endian values
+};
+
+// throws ValidationError if 'j' is not of the form
+// '{"dtype": ..., "shape": [...], "data": ...}'
+Base64Array parse_base64_array(nlohmann::json const &j);
+
+// decodes the base64 form of an array of numbers. Throws ValidationError if
+// the type or size does not match.
+template <NumberType T>
+void read_base64_array(Array<T> &value, std::string_view dtype,
+                       std::span<const size_t> shape, std::string_view data)
+{
+    if (dtype != to_string(num_type_of<T>()))
+        throw ValidationError(
+            fmt::format("expected array of {}, got array of {}",
+                        to_string(num_type_of<T>()), dtype));
+    size_t bytes = sizeof(T);
+    for (auto dim : shape)
+    {
+        if (dim != 0 && bytes > SIZE_MAX / dim)
+            throw ValidationError("invalid shape of base64 array");
+        bytes *= dim;
+    }
+    if (base64_decoded_size(data) != bytes)
+        throw ValidationError("size of base64 data does not match the shape");
+
+    value.resize(std::vector<size_t>(shape.begin(), shape.end()));
+    auto out = std::span(value.data(), value.size());
+    base64_decode(data, std::as_writable_bytes(out));
+    if constexpr (std::endian::native == std::endian::big)
+        for (auto &x : value)
+            x = byteswap(x);
+}
+
 template <NumberType T>
 void read_json_elements(typename Array<T>::iterator &it,
                         nlohmann::json const &j, std::span<const size_t> shape,
@@ -54,6 +160,13 @@ void read_json_elements(typename Array<T>::iterator &it,
 template <NumberType T>
 void read_json_array(Array<T> &value, nlohmann::json const &json)
 {
+    if (json.is_object())
+    {
+        auto packed = parse_base64_array(json);
+        read_base64_array(value, packed.dtype, packed.shape, packed.data);
+        return;
+    }
+
     auto shape = internal::guess_array_shape(json);
     if constexpr (ComplexType<T>)
     {
@@ -70,6 +183,271 @@ void read_json_array(Array<T> &value, nlohmann::json const &json)
     auto it = value.begin();
     read_json_elements<T>(it, json, shape, 0);
 }
+
+// Streaming JSON output. Text is formatted into a buffer, which is handed
+// to the sink in blocks, so that memory usage does not depend on the size of
+// the output. Layout is the same as 'nlohmann::json::dump(indent)'.
+class JsonStream
+{
+    static constexpr size_t block_size = size_t(1) << 16;
+
+    JsonSink const &sink_;
+    fmt::memory_buffer buf_;
+    int indent_; // negative for compact output
+    int depth_ = 0;
+
+    // one entry per open array/object: true if no element was written yet
+    std::vector<bool> first_;
+    bool after_key_ = false;
+
+    void append(std::string_view s)
+    {
+        buf_.append(s.data(), s.data() + s.size());
+    }
+
+    void newline()
+    {
+        if (indent_ < 0)
+            return;
+        buf_.push_back('\n');
+        std::fill_n(std::back_inserter(buf_), depth_ * indent_, ' ');
+    }
+
+    // comma/newline before the next value (or key)
+    void separator()
+    {
+        if (after_key_)
+        {
+            after_key_ = false;
+            return;
+        }
+        if (first_.empty())
+            return;
+        if (!first_.back())
+            buf_.push_back(',');
+        first_.back() = false;
+        newline();
+    }
+
+    void string(std::string_view s)
+    {
+        buf_.push_back('"');
+        for (char c : s)
+            switch (c)
+            {
+            case '"':
+                append("\\\"");
+                break;
+            case '\\':
+                append("\\\\");
+                break;
+            case '\b':
+                append("\\b");
+                break;
+            case '\f':
+                append("\\f");
+                break;
+            case '\n':
+                append("\\n");
+                break;
+            case '\r':
+                append("\\r");
+                break;
+            case '\t':
+                append("\\t");
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                    fmt::format_to(std::back_inserter(buf_), "\\u{:04x}",
+                                  static_cast<int>(c));
+                else
+                    buf_.push_back(c);
+            }
+        buf_.push_back('"');
+    }
+
+    void maybe_flush()
+    {
+        if (buf_.size() >= block_size)
+            flush();
+    }
+
+    template <NumberType T>
+    void rows(T const *&it, std::span<const size_t> shape)
+    {
+        if (shape.size() == 1)
+        {
+            row(it, shape[0]);
+            it += shape[0];
+            return;
+        }
+        begin_array();
+        for (size_t i = 0; i < shape[0]; ++i)
+            rows(it, shape.subspan(1));
+        end_array();
+    }
+
+  public:
+    JsonStream(JsonSink const &sink, int indent)
+        : sink_(sink), indent_(indent)
+    {}
+
+    void flush()
+    {
+        if (buf_.size())
+            sink_(std::string_view(buf_.data(), buf_.size()));
+        buf_.clear();
+    }
+
+    // sizes are only needed for binary formats
+    void begin_object(size_t = 0)
+    {
+        separator();
+        buf_.push_back('{');
+        first_.push_back(true);
+        ++depth_;
+    }
+    void begin_array(size_t = 0)
+    {
+        separator();
+        buf_.push_back('[');
+        first_.push_back(true);
+        ++depth_;
+    }
+    void end_object()
+    {
+        --depth_;
+        if (!first_.back())
+            newline();
+        first_.pop_back();
+        buf_.push_back('}');
+        maybe_flush();
+    }
+    void end_array()
+    {
+        --depth_;
+        if (!first_.back())
+            newline();
+        first_.pop_back();
+        buf_.push_back(']');
+        maybe_flush();
+    }
+
+    void key(std::string_view k)
+    {
+        separator();
+        string(k);
+        buf_.push_back(':');
+        if (indent_ >= 0)
+            buf_.push_back(' ');
+        after_key_ = true;
+    }
+
+    void value(bool v)
+    {
+        separator();
+        append(v ? "true" : "false");
+    }
+    void value(std::string_view v)
+    {
+        separator();
+        string(v);
+        maybe_flush();
+    }
+    void value(IntegerType auto v)
+    {
+        separator();
+        fmt::format_to(std::back_inserter(buf_), "{}", v);
+        maybe_flush();
+    }
+    void value(RealType auto v)
+    {
+        separator();
+
+        // same as nlohmann::json: no representation for inf/nan in JSON
+        if (!std::isfinite(v))
+        {
+            append("null");
+            return;
+        }
+
+        // shortest representation that reads back to the same value. Make
+        // sure it is read as a floating point number again.
+        auto start = buf_.size();
+        fmt::format_to(std::back_inserter(buf_), "{}", v);
+        if (std::none_of(buf_.begin() + start, buf_.end(),
+                         [](char c) { return c == '.' || c == 'e'; }))
+            append(".0");
+        maybe_flush();
+    }
+    void value(ComplexType auto v)
+    {
+        begin_array();
+        value(v.real());
+        value(v.imag());
+        end_array();
+    }
+
+    // innermost row of an array of numbers
+    template <NumberType T> void row(T const *data, size_t n)
+    {
+        begin_array();
+        for (size_t i = 0; i < n; ++i)
+            value(data[i]);
+        end_array();
+    }
+
+    // array of numbers as nested rows (a single number for rank zero)
+    template <NumberType T> void array(Array<T> const &values)
+    {
+        auto const &shape = values.shape();
+        if (shape.empty())
+            return value(*values.data());
+        T const *it = values.data();
+        rows(it, std::span(shape.data(), shape.size()));
+    }
+
+    // base64 form of an array of numbers (see 'JsonStorageHints')
+    template <NumberType T> void base64_array(Array<T> const &values)
+    {
+        begin_object();
+        key("dtype");
+        value(to_string(num_type_of<T>()));
+        key("shape");
+        begin_array();
+        for (auto dim : values.shape())
+            value(static_cast<uint64_t>(dim));
+        end_array();
+        key("data");
+        separator();
+
+        // raw data is always little-endian
+        std::vector<T> swapped;
+        auto data = std::span(values.data(), values.size());
+        if constexpr (std::endian::native == std::endian::big)
+        {
+            swapped.assign(values.begin(), values.end());
+            for (auto &x : swapped)
+                x = byteswap(x);
+            data = swapped;
+        }
+
+        // encoded in pieces, so that the buffer stays small
+        constexpr size_t piece = block_size / 4 * 3;
+        auto bytes = std::as_bytes(data);
+        buf_.push_back('"');
+        for (size_t i = 0; i < bytes.size(); i += piece)
+        {
+            auto part = bytes.subspan(i, std::min(piece, bytes.size() - i));
+            auto old_size = buf_.size();
+            buf_.resize(old_size + (part.size() + 2) / 3 * 4);
+            base64_encode(part, buf_.data() + old_size);
+            maybe_flush();
+        }
+        buf_.push_back('"');
+        end_object();
+    }
+};
 } // namespace internal
 
 class JsonReader
@@ -200,4 +578,110 @@ class JsonReader
 
 static_assert(Reader<JsonReader>);
 
+// Writes a JSON file while the data is visited, without building a document
+// in memory first (same output as 'write_file' for a Tome). The text goes to
+// '<filename>.tmp', which replaces 'filename' in 'finish()'. If 'finish()' is
+// never reached (e.g. an exception while writing), the temporary file is
+// removed and an existing file stays untouched.
+class JsonWriter
+{
+    std::string filename_;
+    std::string temp_filename_;
+    std::ofstream file_;
+    internal::JsonSink sink_;
+    internal::JsonStream out_;
+    bool finished_ = false;
+
+  public:
+    JsonWriter(JsonWriter const &) = delete;
+    JsonWriter &operator=(JsonWriter const &) = delete;
+
+    // 'indent' as in 'WriteOptions::indent'
+    explicit JsonWriter(std::string_view filename, int indent = 4)
+        : filename_(filename), temp_filename_(filename_ + ".tmp"),
+          file_(temp_filename_, std::ios::binary),
+          sink_([this](std::string_view block) {
+              file_.write(block.data(), block.size());
+          }),
+          out_(sink_, indent)
+    {
+        if (!file_)
+            throw WriteError("could not open file " + temp_filename_);
+        out_.begin_object();
+    }
+
+    ~JsonWriter()
+    {
+        if (finished_)
+            return;
+        file_.close();
+        std::error_code ec;
+        std::filesystem::remove(temp_filename_, ec);
+    }
+
+    void push(std::string_view key)
+    {
+        assert(!key.empty());
+        out_.key(key);
+        out_.begin_object();
+    }
+    void pop() noexcept { out_.end_object(); }
+
+    void write(bool const &value, std::string_view key)
+    {
+        out_.key(key);
+        out_.value(value);
+    }
+
+    void write(std::string const &value, std::string_view key)
+    {
+        out_.key(key);
+        out_.value(std::string_view(value));
+    }
+
+    void write(NumberType auto const &value, std::string_view key)
+    {
+        out_.key(key);
+        out_.value(value);
+    }
+
+    template <class T>
+    void write(std::optional<T> const &value, std::string_view key)
+    {
+        if (value)
+            write(*value, key);
+    }
+
+    // arrays are written as nested lists, or in base64 form if requested by
+    // the JSON part of 'hints'
+    template <NumberType T>
+    void write(Array<T> const &value, std::string_view key,
+               StorageHints const &hints = {})
+    {
+        out_.key(key);
+        if (hints.json.base64)
+            out_.base64_array(value);
+        else
+            out_.array(value);
+    }
+
+    // completes the file and moves it into place
+    void finish()
+    {
+        out_.end_object();
+        out_.flush();
+        file_ << '\n';
+        file_.close();
+        if (!file_)
+            throw WriteError("could not write file " + temp_filename_);
+        std::error_code ec;
+        std::filesystem::rename(temp_filename_, filename_, ec);
+        if (ec)
+            throw WriteError("could not write file " + filename_);
+        finished_ = true;
+    }
+};
+
+static_assert(Writer<JsonWriter>);
+
 } // namespace scribe
\ No newline at end of file
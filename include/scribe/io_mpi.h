@@ -0,0 +1,83 @@
+#pragma once
+
+// MPI-parallel HDF5 I/O. Only available if Scribe is built with
+// SCRIBE_WITH_MPI, which requires a parallel build of the HDF5 library.
+
+#include "scribe/io_hdf5.h"
+
+#include <mpi.h>
+
+namespace scribe {
+namespace internal {
+// collective. Creates the dataset at 'path' (global shape from the schema,
+// see 'MpiHdf5File::write_block') and writes the block of this rank.
+void write_hdf5_block(HighFive::File &, MPI_Comm, std::string const &path,
+                      Schema const &, NumType, void const *data,
+                      std::vector<size_t> const &offset,
+                      std::vector<size_t> const &count);
+
+// collective. Reads the part 'slab' of the dataset at 'path' into 'data'.
+void read_hdf5_block(HighFive::File &, MPI_Comm, std::string const &path,
+                     Schema const &, NumType, void *data, Hyperslab const &);
+} // namespace internal
+
+// HDF5 file opened by all ranks of an MPI communicator, using the MPI-IO
+// driver. All member functions (including constructor and destructor) are
+// collective, i.e., they have to be called by all ranks in the same order
+// with the same 'path' and schema. Errors are raised on all ranks, so that
+// no rank is left waiting.
+class MpiHdf5File
+{
+    MPI_Comm comm_;
+    HighFive::File file_;
+
+  public:
+    enum class Mode
+    {
+        Read,
+        Write // create new file, overwriting an existing one
+    };
+
+    MpiHdf5File(std::string_view filename, Mode mode,
+                MPI_Comm comm = MPI_COMM_WORLD);
+    ~MpiHdf5File();
+
+    MpiHdf5File(MpiHdf5File const &) = delete;
+    MpiHdf5File &operator=(MpiHdf5File const &) = delete;
+
+    MPI_Comm comm() const { return comm_; }
+    HighFive::File &file() { return file_; }
+
+    // read/write data that is identical on all ranks (e.g. parameters)
+    void read(Tome &, std::string const &path, Schema const &);
+    void write(std::string const &path, Tome const &, Schema const &);
+
+    // Write the block of a distributed array owned by this rank, starting at
+    // global index 'offset'. The global shape is given by the schema, where
+    // '-1' (or no shape at all) means the maximum extent of the blocks of all
+    // ranks. Blocks may be empty, but must not overlap.
+    template <NumberType T>
+    void write_block(std::string const &path, Schema const &schema,
+                     Array<T> const &block, std::vector<size_t> const &offset)
+    {
+        internal::write_hdf5_block(file_, comm_, path, schema, num_type_of<T>(),
+                                   block.data(), offset, block.shape());
+    }
+
+    // read part of a distributed array. 'block' is resized to 'slab.count'
+    template <NumberType T>
+    void read_block(Array<T> &block, std::string const &path,
+                    Schema const &schema, Hyperslab const &slab)
+    {
+        block.resize(slab.count);
+        internal::read_hdf5_block(file_, comm_, path, schema, num_type_of<T>(),
+                                  block.data(), slab);
+    }
+
+  private:
+    // holds the HDF5 lock while the members are constructed
+    MpiHdf5File(std::string_view filename, Mode mode, MPI_Comm comm,
+                std::unique_lock<std::recursive_mutex>);
+};
+
+} // namespace scribe
@@ -0,0 +1,106 @@
+#pragma once
+
+// Native binary container format of Scribe ('.scb' files). Layout:
+//   * 64 byte header: magic "SCRIBE\0\0", version (uint32), byte order mark
+//     (uint32 0x01020304), offset and size of the index (uint64 each).
+//   * raw payloads of numeric arrays, each aligned to 64 bytes, in native
+//     (i.e. little-endian on all relevant platforms) byte order
+//   * index: JSON document {"schema": ..., "data": ...}, where "schema" is
+//     the schema used for writing and "data" describes the content. Dicts
+//     and atomic values are stored in the index directly, numeric arrays as
+//     {"type": "array", "elements": <type>, "shape": [...], "offset": N}.
+// Reading maps the file into memory, so that no data has to be parsed.
+// Numeric arrays read from the file refer to the mapping directly.
+
+#include "scribe/schema.h"
+#include "scribe/tome.h"
+
+#include "nlohmann/json.hpp"
+#include "xtensor/xadapt.hpp"
+
+namespace scribe {
+
+// read-only view of numeric array data, e.g. into a memory-mapped file
+template <class T>
+using ArrayView =
+    xt::xarray_adaptor<xt::xbuffer_adaptor<T const *, xt::no_ownership>,
+                       xt::layout_type::row_major, std::vector<size_t>>;
+
+// A '.scb' file, memory-mapped read-only.
+class ScbFile
+{
+    std::string filename_;
+    std::shared_ptr<const char> data_; // the mapping, shared with arrays
+    size_t size_ = 0;
+    nlohmann::json index_;
+
+    // raw data and number of elements of a numeric array entry of the index
+    std::pair<void const *, size_t> payload(nlohmann::json const &entry,
+                                            NumType type) const;
+
+  public:
+    explicit ScbFile(std::string_view filename);
+
+    ScbFile(ScbFile const &) = delete;
+    ScbFile &operator=(ScbFile const &) = delete;
+
+    // schema the file was written with
+    Schema schema() const;
+
+    // description of the content (the "data" part of the index)
+    nlohmann::json const &index() const { return index_.at("data"); }
+
+    // Zero-copy view of the numeric array stored at 'path' (e.g. "/foo/bar").
+    // Stays valid as long as this ScbFile. The element type has to match
+    // exactly, otherwise a TomeTypeError is thrown.
+    template <NumberType T> ArrayView<T> view(std::string_view path) const
+    {
+        return view_entry<T>(entry(path));
+    }
+
+    // same, for an entry of the index
+    template <NumberType T>
+    ArrayView<T> view_entry(nlohmann::json const &e) const
+    {
+        auto [ptr, size] = payload(e, num_type_of<T>());
+        return xt::adapt(static_cast<T const *>(ptr), size, xt::no_ownership(),
+                         e.at("shape").get<std::vector<size_t>>());
+    }
+
+    // Same as 'view', but as an 'Array' which shares ownership of the mapping,
+    // so that it stays valid after this ScbFile is gone. Still no copy,
+    // unless the array is modified (see 'internal::ArrayStorage').
+    template <NumberType T> Array<T> array(std::string_view path) const
+    {
+        return array_entry<T>(entry(path));
+    }
+
+    // same, for an entry of the index
+    template <NumberType T> Array<T> array_entry(nlohmann::json const &e) const
+    {
+        auto [ptr, size] = payload(e, num_type_of<T>());
+        auto shape = e.at("shape").get<std::vector<size_t>>();
+        auto strides = std::vector<ptrdiff_t>(shape.size());
+        xt::compute_strides(shape, xt::layout_type::row_major, strides);
+        auto storage = internal::ArrayStorage<T>(static_cast<T const *>(ptr),
+                                                 size, data_);
+        return Array<T>(std::move(storage), std::move(shape),
+                        std::move(strides));
+    }
+
+    // index entry of the object at 'path'. Throws ReadError if not found.
+    nlohmann::json const &entry(std::string_view path) const;
+};
+
+namespace internal {
+// validates and reads a .scb file according to the given schema
+//   * throws ValidationError if the file does not follow the schema
+//   * set tome=nullptr to only validate
+//   * dicts are allocated from 'memory' if given (see 'ReadOptions::memory')
+void read_scb(Tome *, ScbFile const &, Schema const &,
+              std::pmr::memory_resource *memory = nullptr);
+
+void write_scb(std::string const &filename, Tome const &, Schema const &);
+} // namespace internal
+
+} // namespace scribe
@@ -2,10 +2,12 @@
 
 #include "nlohmann/json.hpp"
 #include "scribe/base.h"
+#include <map>
 #include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
@@ -40,6 +42,70 @@ enum class NumType
 
 std::string to_string(NumType type);
 
+// NumType corresponding to a C++ type
+template <NumberType T> constexpr NumType num_type_of()
+{
+    if constexpr (std::same_as<T, int8_t>)
+        return NumType::INT8;
+    else if constexpr (std::same_as<T, int16_t>)
+        return NumType::INT16;
+    else if constexpr (std::same_as<T, int32_t>)
+        return NumType::INT32;
+    else if constexpr (std::same_as<T, int64_t>)
+        return NumType::INT64;
+    else if constexpr (std::same_as<T, uint8_t>)
+        return NumType::UINT8;
+    else if constexpr (std::same_as<T, uint16_t>)
+        return NumType::UINT16;
+    else if constexpr (std::same_as<T, uint32_t>)
+        return NumType::UINT32;
+    else if constexpr (std::same_as<T, uint64_t>)
+        return NumType::UINT64;
+    else if constexpr (std::same_as<T, float32_t>)
+        return NumType::FLOAT32;
+    else if constexpr (std::same_as<T, float64_t>)
+        return NumType::FLOAT64;
+    else if constexpr (std::same_as<T, complex_float32_t>)
+        return NumType::COMPLEX_FLOAT32;
+    else
+        return NumType::COMPLEX_FLOAT64;
+}
+
+// calls 'f(T{})', where T is the C++ type corresponding to 'type'. Intended
+// for use with templated lambdas like '[&]<class T>(T) {...}'.
+template <class F> decltype(auto) visit_num_type(NumType type, F &&f)
+{
+    switch (type)
+    {
+    case NumType::INT8:
+        return f(int8_t{});
+    case NumType::INT16:
+        return f(int16_t{});
+    case NumType::INT32:
+        return f(int32_t{});
+    case NumType::INT64:
+        return f(int64_t{});
+    case NumType::UINT8:
+        return f(uint8_t{});
+    case NumType::UINT16:
+        return f(uint16_t{});
+    case NumType::UINT32:
+        return f(uint32_t{});
+    case NumType::UINT64:
+        return f(uint64_t{});
+    case NumType::FLOAT32:
+        return f(float32_t{});
+    case NumType::FLOAT64:
+        return f(float64_t{});
+    case NumType::COMPLEX_FLOAT32:
+        return f(complex_float32_t{});
+    case NumType::COMPLEX_FLOAT64:
+        return f(complex_float64_t{});
+    default:
+        throw std::runtime_error("invalid NumType");
+    }
+}
+
 struct SchemaMetadata
 {
     // unique identifier for the schema (optional)
@@ -136,8 +202,23 @@ class NumberSchema
 
     // validate a integer/real/complex number against the schema
     void validate(int64_t) const;
+    void validate(uint64_t) const;
     void validate(double) const;
     void validate(double, double) const;
+
+    // same as above for any C++ number type, without narrowing conversions
+    // (e.g. 'uint64_t' values above INT64_MAX)
+    template <NumberType T> void validate_number(T value) const
+    {
+        if constexpr (ComplexType<T>)
+            validate(double(value.real()), double(value.imag()));
+        else if constexpr (RealType<T>)
+            validate(double(value));
+        else if constexpr (std::is_signed_v<T>)
+            validate(int64_t(value));
+        else
+            validate(uint64_t(value));
+    }
 };
 
 class StringSchema
@@ -150,6 +231,62 @@ class StringSchema
     void validate(std::string_view) const;
 };
 
+// HDF5-specific storage hints for arrays (the "hdf5" field of an array
+// schema). Other file formats ignore these.
+struct Hdf5StorageHints
+{
+    // chunk shape. '-1' means the full extent of that dimension. If not set,
+    // datasets are stored contiguously, unless a filter below requires
+    // chunking, in which case the whole array becomes a single chunk.
+    // Appended arrays (see 'Appender') are always chunked. Their leading
+    // dimension has no full extent, so '-1' (or no chunk size) there picks a
+    // default number of rows per chunk.
+    std::optional<std::vector<int64_t>> chunk_size;
+
+    // gzip compression level (0-9)
+    std::optional<int> deflate;
+
+    // byte-shuffle filter. Typically improves compression of numeric data.
+    bool shuffle = false;
+
+    // szip compression with given number of pixels per block (even, <= 32)
+    std::optional<int> szip;
+
+    // checksum for each chunk
+    bool fletcher32 = false;
+
+    // true if no hint is set at all
+    bool empty() const;
+
+    // filters only work on chunked datasets
+    bool needs_chunking() const;
+
+    // actual chunk dimensions for an array of given shape
+    std::vector<size_t> chunk_dims(std::span<const size_t> shape) const;
+};
+
+// JSON-specific storage hints for arrays (the "json" field of an array
+// schema). Other file formats ignore these.
+struct JsonStorageHints
+{
+    // write an array of numbers as a single object
+    // '{"dtype": "float64", "shape": [...], "data": "<base64>"}' instead of
+    // nested arrays, where 'data' contains the raw little-endian values.
+    // Readers accept this form for any array of numbers.
+    bool base64 = false;
+
+    // true if no hint is set at all
+    bool empty() const { return !base64; }
+};
+
+// the storage hints of an array schema for all formats. Code generated by
+// 'scribe codegen' passes them to the typed writers (see 'Writer').
+struct StorageHints
+{
+    Hdf5StorageHints hdf5;
+    JsonStorageHints json;
+};
+
 class ArraySchema
 {
   public:
@@ -157,7 +294,15 @@ class ArraySchema
 
     std::optional<std::vector<int64_t>> shape;
 
+    Hdf5StorageHints hdf5;
+
+    JsonStorageHints json;
+
     void validate_shape(std::span<const size_t> shape) const;
+
+    // true if the leading dimension is '-1', such that the array can be
+    // extended along it (see 'Appender')
+    bool appendable() const;
 };
 
 struct ItemSchema
@@ -169,12 +314,12 @@ struct ItemSchema
 
 class DictSchema
 {
-    // -1 if not found
-    int find_key(std::string_view key) const;
-
   public:
     std::vector<ItemSchema> items;
 
+    // index into 'items'. -1 if not found
+    int find_key(std::string_view key) const;
+
     // Validate that each (non-optional) key is present in the given list of
     // keys. returns the schema that each sub-object should be validated
     // against.
@@ -206,6 +351,64 @@ template <class R, class Visitor> R Schema::visit(Visitor &&vis) const
     return std::visit<R>(std::forward<Visitor>(vis), impl().schema_);
 }
 
+// Immutable, pre-processed form of a schema, used by readers and writers for
+// validation. Sub-schemas are referred to by index ('NodeId'), dicts get a
+// hash table of their keys and a bitmask of required keys. So validating a
+// dict with N keys is O(N) and does not copy any 'Schema' (which would touch
+// the shared_ptr refcount).
+class ValidationPlan
+{
+  public:
+    using NodeId = uint32_t;
+
+    struct Node
+    {
+        // points into the schema the plan was compiled from
+        Schema const *schema = nullptr;
+
+        // ArraySchema: node of the elements
+        NodeId elements = 0;
+
+        // DictSchema: index into 'items' for each key, node and interned key
+        // of each item, and bitmask of non-optional items
+        std::unordered_map<std::string_view, uint32_t> keys;
+        std::vector<NodeId> items;
+        std::vector<DictKey> item_keys;
+        std::vector<uint64_t> required;
+    };
+
+  private:
+    Schema root_; // keeps all sub-schemas alive
+    std::vector<Node> nodes_;
+    KeyPool key_pool_; // dict keys, shared by all nodes
+
+    NodeId compile(Schema const &, std::map<SchemaImpl const *, NodeId> &);
+
+  public:
+    explicit ValidationPlan(Schema const &schema);
+
+    // the plan refers into itself, so it can not be moved around
+    ValidationPlan(ValidationPlan const &) = delete;
+    ValidationPlan &operator=(ValidationPlan const &) = delete;
+
+    static constexpr NodeId root() { return 0; }
+    Node const &node(NodeId id) const { return nodes_[id]; }
+    Schema const &schema(NodeId id) const { return *nodes_[id].schema; }
+
+    // index of 'key' in the items of a DictSchema node. -1 if not found
+    int find_key(NodeId dict, std::string_view key) const;
+
+    // throws ValidationError if any required item of a DictSchema node is not
+    // marked in 'seen' (one bit per item, same layout as 'Node::required')
+    void check_required(NodeId dict, std::span<const uint64_t> seen) const;
+
+    // Same as 'DictSchema::validate', but returns the index of the item each
+    // key belongs to (into 'Node::items' and 'Node::item_keys'). 'indices' is
+    // overwritten.
+    void validate_keys(NodeId dict, std::span<const std::string> keys,
+                       std::vector<uint32_t> &indices) const;
+};
+
 inline std::string_view Schema::name() const { return impl().metadata_.name; }
 inline std::string_view Schema::description() const
 {
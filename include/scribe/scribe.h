@@ -4,6 +4,7 @@
 // file as in
 //     #include <scribe/scribe.h>
 
+#include "scribe/async.h"
 #include "scribe/io.h"
 #include "scribe/schema.h"
 #include "scribe/tome.h"
\ No newline at end of file
@@ -5,14 +5,20 @@
 #include "scribe/base.h"
 #include "scribe/schema.h"
 #include "xtensor/xadapt.hpp"
+#include <atomic>
 #include <cassert>
 #include <complex>
 #include <concepts>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
-#include <map>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <span>
 #include <string>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -20,38 +26,297 @@ namespace scribe {
 
 template <class T> struct TomeSerializer;
 
+// Source of a lazily loaded Tome, e.g. an object inside an open HDF5 file.
+// See 'Tome::lazy()'.
+class TomeLoader
+{
+  public:
+    virtual ~TomeLoader() = default;
+
+    // load the value. Compound values may contain lazy Tomes themselves.
+    virtual Tome load() const = 0;
+
+    // schema of the value if it is known without loading. Used to speed up
+    // 'guess_schema' on lazy Tomes.
+    virtual std::optional<Schema> schema() const { return std::nullopt; }
+};
+
+namespace internal {
+// Backend of a lazy Tome. The loader is shared between copies, the loaded
+// value is not. The value is loaded on first access, also through a 'const'
+// Tome, therefore 'mutable'. As for any other 'const' access, this is safe
+// from multiple threads at once: the loaded value is published atomically.
+struct LazyValue
+{
+    std::shared_ptr<const TomeLoader> loader;
+    mutable std::atomic<Tome *> value = nullptr; // owned, nullptr if not loaded
+
+    explicit LazyValue(std::shared_ptr<const TomeLoader> loader);
+    LazyValue(LazyValue const &);
+    LazyValue(LazyValue &&) noexcept;
+    LazyValue &operator=(LazyValue const &);
+    LazyValue &operator=(LazyValue &&) noexcept;
+    ~LazyValue();
+
+    bool loaded() const { return value.load(std::memory_order_acquire); }
+
+    // loads the value if not done yet
+    Tome &get() const;
+
+    // release the loaded value. Not thread-safe (non-const).
+    void unload();
+};
+
+// Heap-allocated value with value semantics, shared between copies until one
+// of them is modified (copy-on-write). Used to keep arrays and dicts out of
+// 'Tome::variant_type', such that scalars and strings stay small, and such
+// that copying a Tome is O(1), no matter how large it is.
+//   * non-const access makes the value unique first, copying it if it is
+//     currently shared. As the value's children are themselves shared, this
+//     only copies a single level of the tree.
+//   * non-const access also marks the box as 'leaked': a reference into the
+//     value may still be around, so the value is not shared anymore. Copying
+//     a leaked box copies its value (again only one level deep, the copy
+//     itself is not leaked). So a reference obtained before a copy can still
+//     be used to modify the original without changing the copy. Readers
+//     'seal' freshly read data (see 'internal::seal'), such that copying it
+//     stays cheap.
+//   * a box can only be leaked if all its parents are leaked as well, as
+//     there is no way to get a non-const reference into a child without one
+//     to its parent. Thus copies never contain leaked boxes.
+// A null pointer (only after default construction or move) is equivalent to
+// a default-constructed 'T', so that neither needs an allocation. The box can
+// be allocated from a memory resource, which then has to outlive it. Copies
+// made by copy-on-write use the global heap again.
+// The box also caches the content hash of the value (see 'Tome::hash'). It
+// is not used for leaked boxes, which might change at any time.
+template <class T> class Boxed
+{
+    std::shared_ptr<T> ptr_;
+    mutable std::atomic<uint64_t> hash_ = 0; // 0 if not computed yet
+    bool leaked_ = false; // a non-const reference to '*ptr_' was handed out
+
+    // pointer for a copy of 'other'
+    static std::shared_ptr<T> share(Boxed const &other)
+    {
+        if (other.leaked_)
+            return std::make_shared<T>(std::as_const(*other.ptr_));
+        return other.ptr_;
+    }
+
+  public:
+    Boxed() = default;
+    explicit Boxed(T value, std::pmr::memory_resource *memory = nullptr)
+        : ptr_(std::allocate_shared<T>(ResourceAllocator<T>(memory),
+                                       std::move(value)))
+    {}
+    Boxed(Boxed const &other) : ptr_(share(other)), hash_(other.cached_hash())
+    {}
+    Boxed(Boxed &&other) noexcept
+        : ptr_(std::move(other.ptr_)), hash_(other.hash_.load()),
+          leaked_(std::exchange(other.leaked_, false))
+    {
+        other.hash_ = 0;
+    }
+    Boxed &operator=(Boxed const &other)
+    {
+        if (this != &other)
+        {
+            ptr_ = share(other);
+            hash_ = other.cached_hash();
+            leaked_ = false;
+        }
+        return *this;
+    }
+    Boxed &operator=(Boxed &&other) noexcept
+    {
+        ptr_ = std::move(other.ptr_);
+        hash_ = other.hash_.load();
+        leaked_ = std::exchange(other.leaked_, false);
+        other.hash_ = 0;
+        return *this;
+    }
+    ~Boxed() = default;
+
+    T &operator*()
+    {
+        hash_.store(0, std::memory_order_relaxed);
+        if (!ptr_)
+            ptr_ = std::make_shared<T>();
+        else if (ptr_.use_count() > 1)
+            ptr_ = std::make_shared<T>(std::as_const(*ptr_));
+        leaked_ = true;
+        return *ptr_;
+    }
+    T const &operator*() const
+    {
+        static T const empty{};
+        return ptr_ ? *ptr_ : empty;
+    }
+
+    // true if the value is (possibly) shared with another box
+    bool shared() const noexcept { return ptr_ && ptr_.use_count() > 1; }
+
+    // true if both boxes share the same value (or are both empty)
+    bool shares_with(Boxed const &other) const noexcept
+    {
+        return ptr_ == other.ptr_;
+    }
+
+    // Forget that references to the value were handed out. Only allowed if
+    // none of them is used anymore, e.g. for data a reader just built.
+    // Returns the value if the box was leaked, such that its children can be
+    // sealed as well, nullptr otherwise (children of a box that is not
+    // leaked are not leaked either).
+    T *seal() noexcept
+    {
+        if (!leaked_)
+            return nullptr;
+        leaked_ = false;
+        return ptr_.get();
+    }
+
+    // content hash of the value, 0 if not computed since the last change
+    uint64_t cached_hash() const noexcept
+    {
+        return leaked_ ? 0 : hash_.load(std::memory_order_relaxed);
+    }
+    void cache_hash(uint64_t hash) const noexcept
+    {
+        if (!leaked_)
+            hash_.store(hash, std::memory_order_relaxed);
+    }
+};
+
+template <class T> struct is_boxed : std::false_type
+{};
+template <class T> struct is_boxed<Boxed<T>> : std::true_type
+{};
+
+// XXH64 hash of 'data' (https://github.com/Cyan4973/xxHash). Same result on
+// all platforms.
+uint64_t xxhash64(std::span<const std::byte> data, uint64_t seed = 0);
+
+// Marks all boxes in a Tome as no longer leaked (see 'Boxed'). Used by
+// readers on the data they just built, which nobody holds references into.
+void seal(Tome &) noexcept;
+} // namespace internal
+
 class Tome
 {
   public:
-    using dict_type = std::map<std::string, Tome>;
+    using dict_type = FlatDict<Tome>;
     using array_type = Array<Tome>;
 
+    // type in which a 'T' is stored inside 'variant_type'
+    template <class T>
+    using stored_type =
+        std::conditional_t<CompoundType<T>, internal::Boxed<T>, T>;
+
     // NOTE: 'dict_type' should be first, as it is the default for 'Tome'
-    using variant_type =
-        std::variant<dict_type, array_type, string_t, bool_t, int8_t, int16_t,
-                     int32_t, int64_t, uint8_t, uint16_t, uint32_t, uint64_t,
-                     float32_t, float64_t, complex_float32_t, complex_float64_t,
-                     int8_array_t, int16_array_t, int32_array_t, int64_array_t,
-                     uint8_array_t, uint16_array_t, uint32_array_t,
-                     uint64_array_t, float32_array_t, float64_array_t,
-                     complex_float32_array_t, complex_float64_array_t>;
+    // NOTE: 'LazyValue' is an implementation detail, never seen by visitors
+    // NOTE: arrays and dicts are boxed, such that the size of a Tome is
+    //       determined by 'string_t' and copies are cheap (see
+    //       'internal::Boxed'). Visitors get the unboxed type.
+    using variant_type = std::variant<
+        stored_type<dict_type>, stored_type<array_type>, string_t, bool_t,
+        int8_t, int16_t, int32_t, int64_t, uint8_t, uint16_t, uint32_t,
+        uint64_t, float32_t, float64_t, complex_float32_t, complex_float64_t,
+        stored_type<int8_array_t>, stored_type<int16_array_t>,
+        stored_type<int32_array_t>, stored_type<int64_array_t>,
+        stored_type<uint8_array_t>, stored_type<uint16_array_t>,
+        stored_type<uint32_array_t>, stored_type<uint64_array_t>,
+        stored_type<float32_array_t>, stored_type<float64_array_t>,
+        stored_type<complex_float32_array_t>,
+        stored_type<complex_float64_array_t>, internal::LazyValue>;
 
     template <class R = void, class Visitor> R visit(Visitor &&vis)
     {
-        return std::visit<R>(std::forward<Visitor>(vis), data_);
+        return std::visit<R>(
+            [&vis](auto &value) -> R {
+                using V = std::decay_t<decltype(value)>;
+                if constexpr (std::same_as<V, internal::LazyValue>)
+                    return value.get().template visit<R>(
+                        std::forward<Visitor>(vis));
+                else if constexpr (internal::is_boxed<V>::value)
+                    return static_cast<R>(
+                        std::invoke(std::forward<Visitor>(vis), *value));
+                else
+                    return static_cast<R>(
+                        std::invoke(std::forward<Visitor>(vis), value));
+            },
+            data_);
     }
     template <class R = void, class Visitor> R visit(Visitor &&vis) const
     {
-        return std::visit<R>(std::forward<Visitor>(vis), data_);
+        return std::visit<R>(
+            [&vis](auto const &value) -> R {
+                using V = std::decay_t<decltype(value)>;
+                if constexpr (std::same_as<V, internal::LazyValue>)
+                    return std::as_const(value.get()).template visit<R>(
+                        std::forward<Visitor>(vis));
+                else if constexpr (internal::is_boxed<V>::value)
+                    return static_cast<R>(
+                        std::invoke(std::forward<Visitor>(vis), *value));
+                else
+                    return static_cast<R>(
+                        std::invoke(std::forward<Visitor>(vis), value));
+            },
+            data_);
     }
 
   private:
     variant_type data_;
 
+    // 'std::get_if' that looks through boxes
+    template <class T> static T *get_if(variant_type &data)
+    {
+        if constexpr (CompoundType<T>)
+        {
+            auto *box = std::get_if<internal::Boxed<T>>(&data);
+            return box ? &**box : nullptr;
+        }
+        else
+            return std::get_if<T>(&data);
+    }
+    template <class T> static T const *get_if(variant_type const &data)
+    {
+        if constexpr (CompoundType<T>)
+        {
+            auto *box = std::get_if<internal::Boxed<T>>(&data);
+            return box ? &**box : nullptr;
+        }
+        else
+            return std::get_if<T>(&data);
+    }
+
+    // contained value, looking through (and loading) lazy indirections
+    variant_type &data()
+    {
+        if (auto *lazy = std::get_if<internal::LazyValue>(&data_); lazy)
+            return lazy->get().data();
+        return data_;
+    }
+    variant_type const &data() const
+    {
+        if (auto *lazy = std::get_if<internal::LazyValue>(&data_); lazy)
+            return std::as_const(lazy->get()).data();
+        return data_;
+    }
+
     // private backend constructor
     struct direct
     {};
-    Tome(direct, variant_type &&data) : data_(std::move(data)) {}
+    template <class T>
+    Tome(direct, T &&value)
+        : data_(std::in_place_type<stored_type<std::decay_t<T>>>,
+                std::forward<T>(value))
+    {}
+    template <CompoundType T>
+    Tome(direct, T value, std::pmr::memory_resource *memory)
+        : data_(std::in_place_type<internal::Boxed<T>>, std::move(value),
+                memory)
+    {}
 
   public:
     // default constructor creates an empty dict
@@ -68,7 +333,7 @@ class Tome
     // check contained type
     template <TomeType T> bool is() const
     {
-        return std::holds_alternative<T>(data_);
+        return std::holds_alternative<stored_type<T>>(data());
     }
     bool is_boolean() const
     {
@@ -146,14 +411,14 @@ class Tome
     // get contained value, throwing if the type is not as expected
     template <TomeType T> T &as()
     {
-        if (auto *value = std::get_if<T>(&data_); value)
+        if (auto *value = get_if<T>(data()); value)
             return *value;
         throw TomeTypeError(
             fmt::format("Tome is not of type '{}'", typeid(T).name()));
     }
     template <TomeType T> T const &as() const
     {
-        if (auto *value = std::get_if<T>(&data_); value)
+        if (auto *value = get_if<T>(data()); value)
             return *value;
         throw TomeTypeError(
             fmt::format("Tome is not of type '{}'", typeid(T).name()));
@@ -173,6 +438,93 @@ class Tome
     dict_type &as_dict() { return as<dict_type>(); }
     dict_type const &as_dict() const { return as<dict_type>(); }
 
+    // Lazy Tomes load their value from 'loader' on first access (which
+    // includes '.is<T>()', '.as<T>()', '.visit(...)' and all functions using
+    // those). Apart from that, they behave exactly like the loaded value.
+    // Changes to a loaded value are lost when evicting it.
+    static Tome lazy(std::shared_ptr<const TomeLoader> loader)
+    {
+        return Tome(direct{}, internal::LazyValue(std::move(loader)));
+    }
+    bool is_lazy() const
+    {
+        return std::holds_alternative<internal::LazyValue>(data_);
+    }
+    bool is_loaded() const
+    {
+        auto *lazy = std::get_if<internal::LazyValue>(&data_);
+        return !lazy || lazy->loaded();
+    }
+
+    // schema of a lazy Tome that is not loaded yet, if known to the loader
+    std::optional<Schema> lazy_schema() const
+    {
+        auto *lazy = std::get_if<internal::LazyValue>(&data_);
+        if (!lazy || lazy->loaded())
+            return std::nullopt;
+        return lazy->loader->schema();
+    }
+
+    // Change tracking: true if this Tome is a copy of 'snapshot' that was not
+    // modified since. As copies share their data until one of them is
+    // modified (see 'internal::Boxed'), this is cheap: subtrees that were
+    // not touched since the snapshot was taken are not even visited. Any
+    // non-const access (e.g. 'operator[]', '.as<T>()', '.push_back()')
+    // counts as modification. Atomic values are compared by value.
+    bool unchanged_since(Tome const &snapshot) const
+    {
+        auto const &a = data();
+        auto const &b = snapshot.data();
+        if (a.index() != b.index())
+            return false;
+        return std::visit(
+            [&b]<class V>(V const &value) -> bool {
+                auto const &other = *std::get_if<V>(&b);
+                if constexpr (internal::is_boxed<V>::value)
+                    return value.shares_with(other);
+                else if constexpr (std::same_as<V, internal::LazyValue>)
+                    return false; // not reachable, 'data()' loads lazy values
+                else
+                    return value == other;
+            },
+            a);
+    }
+
+    // Content hash of this Tome. Equal hashes mean equal content (up to the
+    // usual, negligible, chance of collisions), so it can be used to quickly
+    // skip identical subtrees when comparing large data (see 'diff').
+    //   * covers types as well as values: e.g. the integer '1' as int32 and
+    //     as int64 hash differently. So data read with the same schema from
+    //     different file formats hashes equally.
+    //   * stable across runs and platforms. Consistent with 'operator==':
+    //     '0.0' and '-0.0' hash equally, as do all NaNs.
+    //   * arrays and dicts cache their hash, so hashing again after a change
+    //     only re-hashes the modified path. Subtrees that were accessed
+    //     through non-const references are not cached (see 'internal::Boxed'),
+    //     so the hash is never outdated.
+    //   * loads lazy values
+    uint64_t hash() const;
+
+    // Compares the content. Does not compute or use hashes, only skips
+    // subtrees that share their storage. Numbers of different
+    // types are never equal. NaNs are equal to NaNs, '0.0' to '-0.0'.
+    friend bool operator==(Tome const &a, Tome const &b);
+    friend void internal::seal(Tome &) noexcept;
+
+    // Unload all lazy values in this Tome (recursively), freeing memory. They
+    // will be re-loaded on next access. Does nothing to non-lazy values.
+    void evict()
+    {
+        if (auto *lazy = std::get_if<internal::LazyValue>(&data_); lazy)
+            lazy->unload();
+        else if (auto *dict = get_if<dict_type>(data_); dict)
+            for (auto &[key, value] : *dict)
+                value.evict();
+        else if (auto *array = get_if<array_type>(data_); array)
+            for (auto &value : *array)
+                value.evict();
+    }
+
     // pseudo-constructors with explicit types
     // NOTE: these should typically be used when implementing the
     // `TomeSerializer` trait for custom types
@@ -198,15 +550,27 @@ class Tome
         return Tome(direct{}, string_t{value});
     }
 
+    // The overloads taking a 'memory' resource (e.g. an arena) allocate the
+    // node (and for dicts, the items) from it. It has to outlive the Tome.
+    // The elements of arrays use the global heap. See 'ReadOptions::memory'.
     static Tome dict() { return Tome(direct{}, dict_type{}); }
+    static Tome dict(std::pmr::memory_resource *memory)
+    {
+        return Tome(direct{}, dict_type(memory), memory);
+    }
     static Tome dict(dict_type const &d) { return Tome(direct{}, d); }
     static Tome dict(dict_type &&d) { return Tome(direct{}, std::move(d)); }
     static Tome array() { return Tome(direct{}, array_type{}); }
     static Tome array(array_type const &a) { return Tome(direct{}, a); }
-    static Tome array(array_type &&a) { return Tome(direct{}, std::move(a)); }
-    template <NumericArrayType T> static Tome array(T a)
+    static Tome array(array_type &&a,
+                      std::pmr::memory_resource *memory = nullptr)
+    {
+        return Tome(direct{}, std::move(a), memory);
+    }
+    template <NumericArrayType T>
+    static Tome array(T a, std::pmr::memory_resource *memory = nullptr)
     {
-        return Tome(direct{}, std::move(a));
+        return Tome(direct{}, std::move(a), memory);
     }
 
     // array from existing data. default to 1D if no shape is given
@@ -215,7 +579,8 @@ class Tome
         auto shape = std::vector<size_t>{elems.size()};
         return array(std::move(elems), std::move(shape));
     }
-    static Tome array(std::vector<Tome> elems, std::vector<size_t> shape)
+    static Tome array(std::vector<Tome> elems, std::vector<size_t> shape,
+                      std::pmr::memory_resource *memory = nullptr)
     {
         std::vector<ptrdiff_t> strides(shape.size());
         auto size =
@@ -226,7 +591,7 @@ class Tome
                             elems.size(), fmt::join(shape, ", ")));
         auto data =
             array_type(std::move(elems), std::move(shape), std::move(strides));
-        return Tome(direct{}, std::move(data));
+        return Tome(direct{}, std::move(data), memory);
     }
     template <NumberType T> static Tome array(std::vector<T> data)
     {
@@ -234,7 +599,8 @@ class Tome
         return array(std::move(data), std::move(shape));
     }
     template <NumberType T>
-    static Tome array(std::vector<T> data, std::vector<size_t> shape)
+    static Tome array(std::vector<T> data, std::vector<size_t> shape,
+                      std::pmr::memory_resource *memory = nullptr)
     {
         std::vector<ptrdiff_t> strides(shape.size());
         auto size =
@@ -244,7 +610,8 @@ class Tome
                 fmt::format("size mismatch (got {} elements, shape = ({}))",
                             data.size(), fmt::join(shape, ", ")));
         return array(
-            Array<T>(std::move(data), std::move(shape), std::move(strides)));
+            Array<T>(std::move(data), std::move(shape), std::move(strides)),
+            memory);
     }
 
     // array from shape, data uninitialized
@@ -309,11 +676,11 @@ class Tome
     // dict-like access
     Tome &operator[](std::string_view key)
     {
-        return as_dict()[std::string(key)];
+        return as_dict()[key];
     }
     Tome const &operator[](std::string_view key) const
     {
-        return as_dict().at(std::string(key));
+        return as_dict().at(key);
     }
 
     // array-like access
@@ -375,13 +742,144 @@ class Tome
     }*/
 };
 
+inline internal::LazyValue::LazyValue(std::shared_ptr<const TomeLoader> l)
+    : loader(std::move(l))
+{
+    assert(loader);
+}
+inline internal::LazyValue::LazyValue(LazyValue const &other)
+    : loader(other.loader)
+{
+    if (auto *v = other.value.load(std::memory_order_acquire); v)
+        value = new Tome(*v);
+}
+inline internal::LazyValue::LazyValue(LazyValue &&other) noexcept
+    : loader(std::move(other.loader)), value(other.value.exchange(nullptr))
+{}
+inline internal::LazyValue &
+internal::LazyValue::operator=(LazyValue const &other)
+{
+    if (this != &other)
+        *this = LazyValue(other);
+    return *this;
+}
+inline internal::LazyValue &
+internal::LazyValue::operator=(LazyValue &&other) noexcept
+{
+    if (this != &other)
+    {
+        loader = std::move(other.loader);
+        delete value.exchange(other.value.exchange(nullptr));
+    }
+    return *this;
+}
+inline internal::LazyValue::~LazyValue() { delete value.load(); }
+
+inline void internal::LazyValue::unload() { delete value.exchange(nullptr); }
+
+inline Tome &internal::LazyValue::get() const
+{
+    if (auto *v = value.load(std::memory_order_acquire); v)
+        return *v;
+
+    // Threads racing for the first access might all load the value, but
+    // only one result is kept, and all of them return that one.
+    auto loaded = std::make_unique<Tome>(loader->load());
+    seal(*loaded);
+    Tome *expected = nullptr;
+    if (value.compare_exchange_strong(expected, loaded.get(),
+                                      std::memory_order_acq_rel))
+        return *loaded.release();
+    return *expected;
+}
+
+inline void internal::seal(Tome &tome) noexcept
+{
+    std::visit(
+        []<class V>(V &value) {
+            if constexpr (std::same_as<V, LazyValue>)
+            {
+                if (auto *v = value.value.load(std::memory_order_acquire); v)
+                    seal(*v);
+            }
+            else if constexpr (is_boxed<V>::value)
+            {
+                auto *inner = value.seal();
+                if constexpr (std::same_as<V, Boxed<Tome::dict_type>>)
+                {
+                    if (inner)
+                        for (auto &[key, child] : *inner)
+                            seal(child);
+                }
+                else if constexpr (std::same_as<V, Boxed<Tome::array_type>>)
+                {
+                    if (inner)
+                        for (auto &child : *inner)
+                            seal(child);
+                }
+            }
+        },
+        tome.data_);
+}
+
+struct ReadOptions
+{
+    // Only load data when it is accessed (see 'Tome::lazy'). Supported for
+    // HDF5 files without schema (i.e. AnySchema). The file stays open as long
+    // as any part of the Tome refers to it.
+    bool lazy = false;
+
+    // Number of threads reading the data of numeric arrays. If > 1, all
+    // metadata is processed first, and the actual data is read in parallel
+    // afterwards. HDF5 only, ignored otherwise.
+    int num_threads = 1;
+
+    // Allocate the nodes of all dicts and arrays, the items of dicts and long
+    // dict keys from this resource instead of the global heap. Typically a
+    // 'std::pmr::monotonic_buffer_resource', which makes allocation cheap and
+    // deallocation free. Strings and the elements of arrays still use the
+    // global heap (they are plain 'std::string'/'Array<T>'). The resource
+    // must outlive the Tome (and anything moved out of it). Copies use the
+    // global heap again. Ignored for lazy reads.
+    std::pmr::memory_resource *memory = nullptr;
+};
+
+struct WriteOptions
+{
+    // JSON only: number of spaces per nesting level. Negative for compact
+    // output without any whitespace.
+    int indent = 4;
+
+    // HDF5 only: update an existing file instead of rewriting it. 'base' is
+    // a copy of the Tome as it was last written to the file. Only the parts
+    // that changed since (see 'Tome::unchanged_since') are written. Numbers,
+    // strings and numeric arrays of unchanged type and shape are overwritten
+    // in place, other changed objects are replaced. The file itself is modified in place (no
+    // temporary file), so a failed update can leave it partially updated.
+    // Other formats write the full file.
+    Tome const *base = nullptr;
+};
+
 // read/write a tome from/to a file. File format is determined by suffix
-void read_file(Tome &, std::string_view filename, Schema const &);
-void write_file(std::string_view filename, Tome const &, Schema const &);
+// (.json, .cbor, .msgpack, .h5/.hdf5, .scb). Files are written to
+// '<filename>.tmp' first, so a failed write leaves an existing file untouched.
+// Except for HDF5 updates with 'WriteOptions::base', which modify the file in
+// place.
+void read_file(Tome &, std::string_view filename, Schema const &,
+               ReadOptions const & = {});
+void write_file(std::string_view filename, Tome const &, Schema const &,
+                WriteOptions const & = {});
+
+// read part of a numeric array from a file (HDF5 only). 'path' is the
+// location of the array inside the file, e.g. "/foo/bar". The result is a
+// compact numeric array of the same type as stored in the file.
+void read_file(Tome &, std::string_view filename, std::string_view path,
+               Hyperslab const &);
 
 // read/write a tome from/to a JSON string
 void read_json_string(Tome &, std::string_view json, Schema const &);
-void write_json_string(std::string &json, Tome const &, Schema const &);
+void write_json_string(std::string &json, Tome const &, Schema const &,
+                       WriteOptions const & = {});
 
 // throws ValidationError if the file does not follow the schema
 void validate_file(std::string_view filename, Schema const &s);
@@ -395,6 +893,36 @@ void validate_file(std::string_view filename, Schema const &s);
 //     schema.
 Schema guess_schema(Tome const &);
 
+struct DiffOptions
+{
+    // Floating point numbers (real and complex) 'x' and 'y' are considered
+    // equal if '|x - y| <= tolerance * max(1, |x|, |y|)', i.e. the tolerance
+    // is absolute for small and relative for large numbers. Integers are
+    // always compared exactly.
+    double tolerance = 0;
+
+    // stop after this many differences
+    size_t max_differences = SIZE_MAX;
+
+    // skip subtrees of equal hash (see 'Tome::hash') without visiting them.
+    // Cached hashes are never outdated, but computing missing ones costs about
+    // as much as comparing, so this pays off when comparing repeatedly.
+    bool use_hash = true;
+};
+
+struct TomeDifference
+{
+    std::string path; // e.g. "/foo/bar[3]". "/" for the root
+    std::string what; // human-readable description
+};
+
+// Differences between two Tomes, in order of their path. Subtrees with equal
+// hashes (see 'Tome::hash') are skipped without visiting them (unless
+// 'options.use_hash' is false), so comparing mostly identical data is cheap,
+// especially if the hashes were computed before. Loads lazy values.
+std::vector<TomeDifference> diff(Tome const &a, Tome const &b,
+                                 DiffOptions const &options = {});
+
 template <> struct TomeSerializer<bool>
 {
     static Tome to_tome(bool value) { return Tome::boolean(value); }
@@ -468,6 +996,15 @@ template <size_t n> struct TomeSerializer<char[n]>
 
 } // namespace scribe
 
+template <>
+struct fmt::formatter<scribe::DictKey> : fmt::formatter<std::string_view>
+{
+    auto format(scribe::DictKey const &key, format_context &ctx) const
+    {
+        return fmt::formatter<std::string_view>::format(key.view(), ctx);
+    }
+};
+
 template <> class fmt::formatter<scribe::Tome>
 {
     // NOTE: the formatting of 'Tome' has been chosen to be essentially JSON.
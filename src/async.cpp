@@ -0,0 +1,87 @@
+#include "scribe/async.h"
+
+#include <algorithm>
+
+scribe::AsyncWriter::AsyncWriter(size_t max_pending)
+    : max_pending_(std::max(max_pending, size_t(1)))
+{
+    thread_ = std::thread([this] { run(); });
+}
+
+scribe::AsyncWriter::~AsyncWriter()
+{
+    {
+        auto lock = std::lock_guard(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+}
+
+std::future<void> scribe::AsyncWriter::write(std::string_view filename,
+                                             Tome tome, Schema schema,
+                                             WriteOptions options)
+{
+    return submit([filename = std::string(filename), tome = std::move(tome),
+                   schema = std::move(schema), options] {
+        write_file(filename, tome, schema, options);
+    });
+}
+
+void scribe::AsyncWriter::wait()
+{
+    auto lock = std::unique_lock(mutex_);
+    cv_.wait(lock, [&] { return pending_ == 0; });
+}
+
+std::future<void> scribe::AsyncWriter::submit(std::function<void()> write)
+{
+    auto lock = std::unique_lock(mutex_);
+    cv_.wait(lock, [&] { return pending_ < max_pending_; });
+    ++pending_;
+    auto &job = queue_.emplace_back();
+    job.write = std::move(write);
+    auto future = job.done.get_future();
+    lock.unlock();
+    cv_.notify_all();
+    return future;
+}
+
+void scribe::AsyncWriter::run()
+{
+    for (;;)
+    {
+        Job job;
+        {
+            auto lock = std::unique_lock(mutex_);
+            cv_.wait(lock, [&] { return stop_ || !queue_.empty(); });
+            if (queue_.empty())
+                return; // stopped, and nothing left to write
+            job = std::move(queue_.front());
+            queue_.pop_front();
+        }
+
+        std::exception_ptr error;
+        try
+        {
+            job.write();
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        // release the data before making room for the next write
+        job.write = nullptr;
+        if (error)
+            job.done.set_exception(error);
+        else
+            job.done.set_value();
+
+        {
+            auto lock = std::lock_guard(mutex_);
+            --pending_;
+        }
+        cv_.notify_all();
+    }
+}
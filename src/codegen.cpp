@@ -5,6 +5,29 @@
 namespace scribe {
 namespace {
 
+// statements setting the storage hints of an array schema on a
+// 'scribe::StorageHints hints', or nothing if no hint is set
+std::vector<std::string> hints_setters(ArraySchema const &schema)
+{
+    std::vector<std::string> r;
+    auto const &h = schema.hdf5;
+    if (h.chunk_size)
+        r.push_back(
+            fmt::format("hints.hdf5.chunk_size = std::vector<int64_t>{{{}}};",
+                        fmt::join(*h.chunk_size, ", ")));
+    if (h.deflate)
+        r.push_back(fmt::format("hints.hdf5.deflate = {};", *h.deflate));
+    if (h.shuffle)
+        r.push_back("hints.hdf5.shuffle = true;");
+    if (h.szip)
+        r.push_back(fmt::format("hints.hdf5.szip = {};", *h.szip));
+    if (h.fletcher32)
+        r.push_back("hints.hdf5.fletcher32 = true;");
+    if (schema.json.base64)
+        r.push_back("hints.json.base64 = true;");
+    return r;
+}
+
 class Codegen
 {
     std::vector<std::string> source_forward_;
@@ -140,6 +163,34 @@ void Codegen::generate_implementation(DictSchema const &schema,
     }
     fmt::format_to(it, "}}\n");
 
+    fmt::format_to(
+        it,
+        "void write({} const& data, scribe::Writer auto& writer) {{\n"
+        "    using scribe::write;\n",
+        name);
+    for (auto const &item : schema.items)
+    {
+        // arrays pass on their storage hints (chunking, compression, ...)
+        auto array = std::get_if<ArraySchema>(&item.schema.impl().schema_);
+        auto setters =
+            array ? hints_setters(*array) : std::vector<std::string>();
+        if (setters.empty())
+        {
+            fmt::format_to(it, "    write(data.{0}, writer, \"{0}\");\n",
+                           item.key);
+            continue;
+        }
+        fmt::format_to(it, "    {{\n"
+                           "        auto hints = scribe::StorageHints();\n");
+        for (auto const &setter : setters)
+            fmt::format_to(it, "        {}\n", setter);
+        fmt::format_to(it,
+                       "        write(data.{0}, writer, \"{0}\", hints);\n"
+                       "    }}\n",
+                       item.key);
+    }
+    fmt::format_to(it, "}}\n");
+
     source_impl_.push_back(impl);
 }
 
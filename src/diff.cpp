@@ -0,0 +1,205 @@
+#include "scribe/tome.h"
+#include <algorithm>
+#include <cmath>
+
+namespace scribe {
+
+namespace {
+
+template <class T> std::string type_name()
+{
+    if constexpr (std::same_as<T, Tome::dict_type>)
+        return "dict";
+    else if constexpr (std::same_as<T, Tome::array_type>)
+        return "array";
+    else if constexpr (std::same_as<T, string_t>)
+        return "string";
+    else if constexpr (std::same_as<T, bool_t>)
+        return "boolean";
+    else if constexpr (NumberType<T>)
+        return to_string(num_type_of<T>());
+    else
+        return "array of " + to_string(num_type_of<typename T::value_type>());
+}
+
+// "[i, j, ...]" for the element at 'flat' index of a row-major array
+std::string index_string(size_t flat, std::span<const size_t> shape)
+{
+    std::vector<size_t> index(shape.size());
+    for (size_t d = shape.size(); d-- > 0;)
+    {
+        index[d] = flat % shape[d];
+        flat /= shape[d];
+    }
+    return fmt::format("[{}]", fmt::join(index, ", "));
+}
+
+template <NumberType T> bool is_nan(T x)
+{
+    if constexpr (ComplexType<T>)
+        return std::isnan(x.real()) || std::isnan(x.imag());
+    else if constexpr (RealType<T>)
+        return std::isnan(x);
+    else
+        return false;
+}
+
+class Differ
+{
+    DiffOptions const &options_;
+    std::vector<TomeDifference> result_;
+    std::string path_;
+
+    bool full() const { return result_.size() >= options_.max_differences; }
+
+    void report(std::string what)
+    {
+        result_.push_back({path_.empty() ? "/" : path_, std::move(what)});
+    }
+
+    template <NumberType T> bool equal(T x, T y) const
+    {
+        if (x == y)
+            return true;
+        if constexpr (IntegerType<T>)
+            return false;
+        else
+        {
+            if (is_nan(x) || is_nan(y))
+                return is_nan(x) && is_nan(y);
+            double scale = std::max({1.0, double(std::abs(x)),
+                                     double(std::abs(y))});
+            return double(std::abs(x - y)) <= options_.tolerance * scale;
+        }
+    }
+
+    bool compare_shapes(std::span<const size_t> a, std::span<const size_t> b)
+    {
+        if (std::ranges::equal(a, b))
+            return true;
+        report(fmt::format("shape [{}] vs [{}]", fmt::join(a, ", "),
+                           fmt::join(b, ", ")));
+        return false;
+    }
+
+    void compare_values(Tome::dict_type const &a, Tome::dict_type const &b)
+    {
+        auto old_size = path_.size();
+        auto enter = [&](DictKey const &key) {
+            path_.resize(old_size);
+            path_ += '/';
+            path_ += key.view();
+        };
+
+        // both dicts are sorted by key
+        auto it = a.begin();
+        auto jt = b.begin();
+        while ((it != a.end() || jt != b.end()) && !full())
+        {
+            if (jt == b.end() || (it != a.end() && it->first < jt->first))
+            {
+                enter(it++->first);
+                report("only in first");
+            }
+            else if (it == a.end() || jt->first < it->first)
+            {
+                enter(jt++->first);
+                report("only in second");
+            }
+            else
+            {
+                enter(it->first);
+                compare(it++->second, jt++->second);
+            }
+        }
+        path_.resize(old_size);
+    }
+
+    void compare_values(Tome::array_type const &a, Tome::array_type const &b)
+    {
+        if (!compare_shapes(a.shape(), b.shape()))
+            return;
+        auto old_size = path_.size();
+        for (size_t i = 0; i < a.size() && !full(); ++i)
+        {
+            path_ += index_string(i, a.shape());
+            compare(a.data()[i], b.data()[i]);
+            path_.resize(old_size);
+        }
+    }
+
+    // reports a single difference for the whole array, to keep the output
+    // readable for large arrays
+    template <NumberType T>
+    void compare_values(Array<T> const &a, Array<T> const &b)
+    {
+        if (!compare_shapes(a.shape(), b.shape()))
+            return;
+        size_t count = 0;
+        size_t first = 0;
+        for (size_t i = 0; i < a.size(); ++i)
+            if (!equal(a.data()[i], b.data()[i]) && count++ == 0)
+                first = i;
+        if (count)
+            report(fmt::format("{} of {} elements differ (first at {}: {} vs "
+                               "{})",
+                               count, a.size(), index_string(first, a.shape()),
+                               Tome(a.data()[first]), Tome(b.data()[first])));
+    }
+
+    template <NumberType T> void compare_values(T const &a, T const &b)
+    {
+        if (!equal(a, b))
+            report(fmt::format("{} vs {}", Tome(a), Tome(b)));
+    }
+
+    void compare_values(string_t const &a, string_t const &b)
+    {
+        if (a != b)
+            report(fmt::format("{} vs {}", Tome(a), Tome(b)));
+    }
+
+    void compare_values(bool_t const &a, bool_t const &b)
+    {
+        if (a != b)
+            report(fmt::format("{} vs {}", a, b));
+    }
+
+  public:
+    explicit Differ(DiffOptions const &options) : options_(options) {}
+
+    void compare(Tome const &a, Tome const &b)
+    {
+        // 'unchanged_since' is true for shared storage and equal atoms
+        if (full() || a.unchanged_since(b) ||
+            (options_.use_hash && a.hash() == b.hash()))
+            return;
+        a.visit([&]<class A>(A const &x) {
+            b.visit([&]<class B>(B const &y) {
+                if constexpr (std::same_as<A, B>)
+                    compare_values(x, y);
+                else
+                    report(fmt::format("type {} vs {}", type_name<A>(),
+                                       type_name<B>()));
+            });
+        });
+    }
+
+    std::vector<TomeDifference> result() && { return std::move(result_); }
+};
+} // namespace
+
+std::vector<TomeDifference> diff(Tome const &a, Tome const &b,
+                                 DiffOptions const &options)
+{
+    auto differ = Differ(options);
+    differ.compare(a, b);
+    return std::move(differ).result();
+}
+
+bool operator==(Tome const &a, Tome const &b)
+{
+    return diff(a, b, {.max_differences = 1, .use_hash = false}).empty();
+}
+
+} // namespace scribe
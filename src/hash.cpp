@@ -0,0 +1,305 @@
+#include "scribe/tome.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace scribe {
+
+namespace {
+constexpr uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t prime3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+
+template <class T> T read_le(std::byte const *p)
+{
+    T x;
+    std::memcpy(&x, p, sizeof(T));
+    if constexpr (std::endian::native == std::endian::big)
+        x = internal::byteswap(x);
+    return x;
+}
+
+uint64_t xxh_round(uint64_t acc, uint64_t input)
+{
+    acc += input * prime2;
+    acc = std::rotl(acc, 31);
+    return acc * prime1;
+}
+
+uint64_t xxh_merge(uint64_t acc, uint64_t value)
+{
+    acc ^= xxh_round(0, value);
+    return acc * prime1 + prime4;
+}
+
+// streaming XXH64: same result as hashing the concatenation of all updates
+class Xxh64
+{
+    uint64_t seed_;
+    uint64_t v_[4];
+    std::byte buf_[32]; // incomplete stripe
+    size_t buf_size_ = 0;
+    uint64_t total_ = 0;
+
+    void consume(std::byte const *p)
+    {
+        for (int i = 0; i < 4; ++i)
+            v_[i] = xxh_round(v_[i], read_le<uint64_t>(p + 8 * i));
+    }
+
+  public:
+    explicit Xxh64(uint64_t seed = 0)
+        : seed_(seed),
+          v_{seed + prime1 + prime2, seed + prime2, seed, seed - prime1}
+    {}
+
+    void update(std::span<const std::byte> data)
+    {
+        if (data.empty())
+            return;
+        auto p = data.data();
+        auto end = p + data.size();
+        total_ += data.size();
+        if (buf_size_ + data.size() < 32)
+        {
+            std::memcpy(buf_ + buf_size_, p, data.size());
+            buf_size_ += data.size();
+            return;
+        }
+        if (buf_size_)
+        {
+            auto n = 32 - buf_size_;
+            std::memcpy(buf_ + buf_size_, p, n);
+            p += n;
+            consume(buf_);
+        }
+
+        // four independent lanes, 32 bytes per iteration
+        for (; end - p >= 32; p += 32)
+            consume(p);
+        buf_size_ = end - p;
+        std::memcpy(buf_, p, buf_size_);
+    }
+
+    uint64_t digest() const
+    {
+        uint64_t h;
+        if (total_ >= 32)
+        {
+            h = std::rotl(v_[0], 1) + std::rotl(v_[1], 7) +
+                std::rotl(v_[2], 12) + std::rotl(v_[3], 18);
+            for (auto v : v_)
+                h = xxh_merge(h, v);
+        }
+        else
+            h = seed_ + prime5;
+
+        h += total_;
+
+        auto p = buf_;
+        auto end = buf_ + buf_size_;
+        for (; end - p >= 8; p += 8)
+        {
+            h ^= xxh_round(0, read_le<uint64_t>(p));
+            h = std::rotl(h, 27) * prime1 + prime4;
+        }
+        if (end - p >= 4)
+        {
+            h ^= uint64_t(read_le<uint32_t>(p)) * prime1;
+            h = std::rotl(h, 23) * prime2 + prime3;
+            p += 4;
+        }
+        for (; p != end; ++p)
+        {
+            h ^= uint64_t(*p) * prime5;
+            h = std::rotl(h, 11) * prime1;
+        }
+
+        // avalanche
+        h ^= h >> 33;
+        h *= prime2;
+        h ^= h >> 29;
+        h *= prime3;
+        h ^= h >> 32;
+        return h;
+    }
+};
+} // namespace
+
+uint64_t internal::xxhash64(std::span<const std::byte> data, uint64_t seed)
+{
+    auto state = Xxh64(seed);
+    state.update(data);
+    return state.digest();
+}
+
+namespace {
+
+// first word of the hashed data, such that values of different types never
+// hash the same. Numbers add their 'NumType'.
+enum class HashTag : uint64_t
+{
+    dict = 1,
+    array = 2,
+    string = 3,
+    boolean = 4,
+    number = 0x100,
+    numeric_array = 0x200
+};
+
+// Equal numbers (see 'operator==') have to hash equally, so '-0.0' is hashed
+// as '0.0', and all NaNs the same. A complex number is NaN if either part is.
+template <NumberType T> T canonical(T x)
+{
+    if constexpr (ComplexType<T>)
+    {
+        using R = typename T::value_type;
+        if (std::isnan(x.real()) || std::isnan(x.imag()))
+            return T(std::numeric_limits<R>::quiet_NaN(),
+                     std::numeric_limits<R>::quiet_NaN());
+        return T(canonical(x.real()), canonical(x.imag()));
+    }
+    else if constexpr (RealType<T>)
+    {
+        if (std::isnan(x))
+            return std::numeric_limits<T>::quiet_NaN();
+        return x == 0 ? T(0) : x;
+    }
+    else
+        return x;
+}
+
+// hashes the little-endian serialization of the parts of a value, without
+// allocating anything
+class Hasher
+{
+    Xxh64 state_;
+
+  public:
+    explicit Hasher(HashTag tag) { add(uint64_t(tag)); }
+    Hasher(HashTag tag, NumType type) { add(uint64_t(tag) + uint64_t(type)); }
+
+    template <NumberType T> void add(T value)
+    {
+        value = canonical(value);
+        if constexpr (std::endian::native == std::endian::big)
+            value = internal::byteswap(value);
+        state_.update(std::as_bytes(std::span(&value, 1)));
+    }
+    void add(std::string_view s)
+    {
+        add(uint64_t(s.size()));
+        state_.update(std::as_bytes(std::span(s)));
+    }
+    void add_shape(std::span<const size_t> shape)
+    {
+        add(uint64_t(shape.size()));
+        for (auto dim : shape)
+            add(uint64_t(dim));
+    }
+
+    // same as 'add' for each element, but integers are hashed in place
+    template <NumberType T> void add_values(std::span<const T> values)
+    {
+        if constexpr (IntegerType<T> &&
+                      std::endian::native == std::endian::little)
+            state_.update(std::as_bytes(values));
+        else
+        {
+            std::array<T, 64> chunk;
+            while (!values.empty())
+            {
+                auto n = std::min(chunk.size(), values.size());
+                for (size_t i = 0; i < n; ++i)
+                {
+                    chunk[i] = canonical(values[i]);
+                    if constexpr (std::endian::native == std::endian::big)
+                        chunk[i] = internal::byteswap(chunk[i]);
+                }
+                state_.update(std::as_bytes(std::span(chunk.data(), n)));
+                values = values.subspan(n);
+            }
+        }
+    }
+
+    uint64_t hash() const { return state_.digest(); }
+};
+
+uint64_t hash_value(Tome::dict_type const &dict)
+{
+    auto h = Hasher(HashTag::dict);
+    h.add(uint64_t(dict.size()));
+    for (auto const &[key, value] : dict)
+    {
+        h.add(std::string_view(key));
+        h.add(value.hash());
+    }
+    return h.hash();
+}
+
+uint64_t hash_value(Tome::array_type const &array)
+{
+    auto h = Hasher(HashTag::array);
+    h.add_shape(array.shape());
+    for (auto const &value : array)
+        h.add(value.hash());
+    return h.hash();
+}
+
+template <NumberType T> uint64_t hash_value(Array<T> const &array)
+{
+    auto h = Hasher(HashTag::numeric_array, num_type_of<T>());
+    h.add_shape(array.shape());
+    h.add_values(std::span(array.data(), array.size()));
+    return h.hash();
+}
+
+uint64_t hash_value(string_t const &value)
+{
+    auto h = Hasher(HashTag::string);
+    h.add(std::string_view(value));
+    return h.hash();
+}
+
+uint64_t hash_value(bool_t value)
+{
+    auto h = Hasher(HashTag::boolean);
+    h.add(uint8_t(value));
+    return h.hash();
+}
+
+template <NumberType T> uint64_t hash_value(T value)
+{
+    auto h = Hasher(HashTag::number, num_type_of<T>());
+    h.add(value);
+    return h.hash();
+}
+} // namespace
+
+uint64_t Tome::hash() const
+{
+    return std::visit(
+        []<class V>(V const &value) -> uint64_t {
+            if constexpr (internal::is_boxed<V>::value)
+            {
+                if (auto h = value.cached_hash(); h)
+                    return h;
+                // 0 marks a missing cache entry
+                auto h = std::max(hash_value(*value), uint64_t(1));
+                value.cache_hash(h);
+                return h;
+            }
+            else if constexpr (std::same_as<V, internal::LazyValue>)
+                return 0; // not reachable, 'data()' loads lazy values
+            else
+                return hash_value(value);
+        },
+        data());
+}
+
+} // namespace scribe
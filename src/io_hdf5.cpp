@@ -1,87 +1,376 @@
 #include "scribe/io_hdf5.h"
 
 #include "highfive/highfive.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
 
 namespace {
-using namespace scribe;
+// creation properties of a chunked dataset, including the filters given in
+// the storage hints
+HighFive::DataSetCreateProps
+chunked_props(scribe::Hdf5StorageHints const &hints,
+              std::vector<size_t> const &dims)
+{
+    HighFive::DataSetCreateProps props;
+    props.add(
+        HighFive::Chunking(std::vector<hsize_t>(dims.begin(), dims.end())));
+
+    // NOTE: filters are applied in order when writing. Shuffle has to come
+    // before compression, and the checksum covers the compressed data.
+    if (hints.shuffle)
+        props.add(HighFive::Shuffle());
+    if (hints.deflate)
+        props.add(HighFive::Deflate(*hints.deflate));
+    if (hints.szip)
+        props.add(HighFive::Szip(H5_SZIP_NN_OPTION_MASK, *hints.szip));
+    if (hints.fletcher32)
+        if (H5Pset_fletcher32(props.getId()) < 0)
+            throw scribe::WriteError("could not enable fletcher32 checksums");
+    return props;
+}
+} // namespace
 
-void read_impl(Tome *, HighFive::File &, std::string const &,
-               NoneSchema const &)
+HighFive::DataSetCreateProps
+scribe::internal::hdf5_create_props(ArraySchema const &schema,
+                                    std::vector<size_t> const &shape)
 {
-    throw ValidationError("NoneSchema is never valid");
+    return hdf5_create_props(schema.hdf5, shape);
 }
 
-void read_impl(Tome *tome, HighFive::File &file, std::string const &path,
-               AnySchema const &)
+HighFive::DataSetCreateProps
+scribe::internal::hdf5_create_props(Hdf5StorageHints const &hints,
+                                    std::vector<size_t> const &shape)
 {
-    if (!file.exist(path))
-        throw ReadError(fmt::format("object '{}' does not exist", path));
+    if (!hints.needs_chunking() || shape.empty())
+        return {};
+    return chunked_props(hints, hints.chunk_dims(shape));
+}
 
-    // validate-only -> no need to read anything
-    if (tome == nullptr)
+std::vector<size_t>
+scribe::internal::hdf5_appendable_chunk_dims(ArraySchema const &schema,
+                                             std::span<const size_t> row)
+{
+    size_t row_size = 1;
+    for (auto n : row)
+        row_size *= std::max(n, size_t(1));
+    auto const &chunk_size = schema.hdf5.chunk_size;
+    auto rows = chunk_size && !chunk_size->empty() && chunk_size->front() != -1
+                    ? size_t(chunk_size->front())
+                    : std::max((size_t(1) << 14) / row_size, size_t(1));
+
+    auto shape = std::vector<size_t>{rows};
+    shape.insert(shape.end(), row.begin(), row.end());
+    return schema.hdf5.chunk_dims(shape);
+}
+
+void scribe::internal::hdf5_validate_chunking(ArraySchema const &schema,
+                                              HighFive::DataSet const &dataset,
+                                              std::vector<size_t> const &shape)
+{
+    if (!schema.hdf5.chunk_size)
         return;
+    auto props = dataset.getCreatePropertyList();
+    if (H5Pget_layout(props.getId()) != H5D_CHUNKED)
+        throw ValidationError("expected chunked dataset");
+    auto max_dims = dataset.getSpace().getMaxDimensions();
+    auto expected =
+        schema.appendable() && !shape.empty() &&
+                max_dims.front() == HighFive::DataSpace::UNLIMITED
+            ? hdf5_appendable_chunk_dims(schema, std::span(shape).subspan(1))
+            : schema.hdf5.chunk_dims(shape);
+    auto actual = std::vector<hsize_t>(shape.size());
+    if (H5Pget_chunk(props.getId(), (int)actual.size(), actual.data()) !=
+        (int)actual.size())
+        throw ValidationError("chunk rank mismatch");
+    for (size_t i = 0; i < shape.size(); ++i)
+        if (expected[i] != actual[i])
+            throw ValidationError(
+                fmt::format("chunk size mismatch (expected ({}), got ({}))",
+                            fmt::join(expected, ","), fmt::join(actual, ",")));
+}
 
-    // check if the object is a group or dataset
-    auto obj_type = file.getObjectType(path);
-    if (obj_type == HighFive::ObjectType::Group)
+namespace {
+using namespace scribe;
+using NodeId = ValidationPlan::NodeId;
+
+// absolute path of the object 'key' inside the group at 'path'
+std::string child_path(std::string const &path, std::string const &key)
+{
+    return path == "/" ? path + key : path + "/" + key;
+}
+
+// split an absolute path into (already opened) parent group and name. The
+// root group is returned as itself with an empty name.
+std::pair<HighFive::Group, std::string> split_path(HighFive::File &file,
+                                                   std::string const &path)
+{
+    if (path == "/")
+        return {file.getGroup("/"), ""};
+    auto pos = path.rfind('/');
+    auto parent = pos == 0 ? std::string("/") : path.substr(0, pos);
+    return {file.getGroup(parent), path.substr(pos + 1)};
+}
+
+// file offset of the raw data of a dataset if it can be read directly from
+// the file, bypassing HDF5 (i.e. contiguous, unfiltered and allocated)
+std::optional<uint64_t> direct_offset(HighFive::DataSet const &dataset)
+{
+    auto props = dataset.getCreatePropertyList();
+    haddr_t offset = H5Dget_offset(dataset.getId());
+    if (H5Pget_layout(props.getId()) != H5D_CONTIGUOUS ||
+        H5Pget_nfilters(props.getId()) != 0 || offset == HADDR_UNDEF ||
+        H5Dget_storage_size(dataset.getId()) !=
+            dataset.getElementCount() * dataset.getDataType().getSize())
+        return std::nullopt;
+    return offset;
+}
+
+internal::Hdf5ObjectInfo describe_dataset(HighFive::DataSet const &dataset)
+{
+    internal::Hdf5ObjectInfo info;
+    auto type = dataset.getDataType();
+    info.type = HighFive::ObjectType::Dataset;
+    info.is_string = type == HighFive::AtomicType<std::string>();
+    info.num_type = internal::hdf5_num_type(type);
+    info.shape = dataset.getDimensions();
+    if (info.num_type)
+        info.offset = direct_offset(dataset);
+    return info;
+}
+
+// state of the 'H5Ovisit' building an 'Hdf5Index'
+struct IndexVisit
+{
+    std::unordered_map<std::string, internal::Hdf5ObjectInfo> &objects;
+    HighFive::Group const &root;
+    std::string const &root_path;
+    std::exception_ptr error;
+};
+
+template <class H5Info>
+herr_t index_object(hid_t, char const *name, H5Info const *h5info, void *data)
+{
+    auto &visit = *static_cast<IndexVisit *>(data);
+    try
     {
-        auto group = file.getGroup(path);
-        std::vector<std::string> item_keys = group.listObjectNames();
-        *tome = Tome::dict();
-        for (auto const &key : item_keys)
-            read_impl(&(*tome)[key], file, path + "/" + key, AnySchema{});
+        auto rel = std::string(name);
+        auto path =
+            rel == "." ? visit.root_path : child_path(visit.root_path, rel);
+        internal::Hdf5ObjectInfo info;
+        if (h5info->type == H5O_TYPE_GROUP)
+            info.type = HighFive::ObjectType::Group;
+        else if (h5info->type == H5O_TYPE_DATASET)
+            info = describe_dataset(visit.root.getDataSet(rel));
+        visit.objects.emplace(std::move(path), std::move(info));
+        return 0;
+    }
+    catch (...)
+    {
+        visit.error = std::current_exception();
+        return -1;
+    }
+}
+
+// create a dataset of element type T and write contiguous row-major data
+template <NumberType T>
+void write_dataset(HighFive::Group &parent, std::string const &name,
+                   ArraySchema const &schema, T const *data,
+                   std::vector<size_t> const &shape)
+{
+    auto props = internal::hdf5_create_props(schema, shape);
+    auto dataset =
+        parent.createDataSet<T>(name, HighFive::DataSpace(shape), props);
+    dataset.write_raw(data);
+}
+
+// read the data of a dataset into a numeric array, which has to be of
+// matching shape. The read is deferred if 'queue' is given.
+template <NumberType T>
+void read_array(Array<T> &values, HighFive::DataSet const &dataset,
+                internal::Hdf5ObjectInfo const &info,
+                internal::Hdf5ReadQueue *queue)
+{
+    if (queue)
+        queue->push(dataset, values.data(), info);
+    else
+        dataset.read_raw(values.data());
+}
+
+// read a dataset without schema. Rank-0 datasets become scalars, everything
+// else a compact numeric array of matching type. NOTE: this used to be decided
+// by size instead, reading any single-element dataset as a scalar. But then
+// arrays of shape [1] (or [1, 1], ...) would not survive a round trip.
+void read_dataset(Tome &tome, HighFive::DataSet const &dataset,
+                  internal::Hdf5ObjectInfo const &info, std::string const &path,
+                  internal::Hdf5ReadQueue *queue = nullptr,
+                  std::pmr::memory_resource *memory = nullptr)
+{
+    auto const &shape = info.shape;
+    if (shape.empty() && info.is_string)
+        tome = dataset.read<std::string>();
+    else if (!info.num_type)
+        throw ReadError(
+            fmt::format("unsupported data type for dataset at '{}'", path));
+    else if (shape.empty())
+        visit_num_type(*info.num_type,
+                       [&]<class T>(T) { tome = dataset.read<T>(); });
+    else
+        visit_num_type(*info.num_type, [&]<class T>(T) {
+            tome = Tome::array(Array<T>::from_shape(shape), memory);
+            read_array(tome.as_numeric_array<T>(), dataset, info, queue);
+        });
+}
+
+// Lazily loads an object of an HDF5 file. Groups become dicts of lazy
+// children, datasets are read as in 'read_dataset'. Type and shape of
+// datasets are recorded up front, so that the schema is known without
+// loading any data.
+class Hdf5Loader final : public TomeLoader
+{
+    // NOTE: lazy values may be loaded (and released) from several threads at
+    //       once, so all of this holds 'internal::hdf5_mutex()'
+    std::shared_ptr<HighFive::File> file_;
+    std::string path_;
+    internal::Hdf5ObjectInfo info_;
+
+  public:
+    Hdf5Loader(std::shared_ptr<HighFive::File> file, std::string path)
+        : file_(std::move(file)), path_(std::move(path))
+    {
+        auto lock = internal::hdf5_lock();
+        auto [parent, name] = split_path(*file_, path_);
+        auto info = internal::hdf5_object_info(parent, name);
+        if (!info)
+            throw ReadError(fmt::format("object '{}' does not exist", path_));
+        if (info->type != HighFive::ObjectType::Group &&
+            info->type != HighFive::ObjectType::Dataset)
+            throw ReadError(
+                fmt::format("unsupported hdf5-object type at '{}'", path_));
+        info_ = std::move(*info);
     }
-    else if (obj_type == HighFive::ObjectType::Dataset)
+
+    ~Hdf5Loader() override
     {
-        auto dataset = file.getDataSet(path);
-        auto shape = dataset.getDimensions();
-        size_t size = dataset.getElementCount();
-        auto type = dataset.getDataType();
+        // the last loader of a file closes it
+        auto lock = internal::hdf5_lock();
+        file_.reset();
+    }
 
-        if (size == 1)
+    Tome load() const override
+    {
+        auto lock = internal::hdf5_lock();
+        Tome r;
+        if (info_.type == HighFive::ObjectType::Group)
         {
-            // read a scalar
-            if (type == HighFive::AtomicType<int64_t>())
-            {
-                *tome = dataset.read<int64_t>();
-            }
-            else if (type == HighFive::AtomicType<double>())
-            {
-                *tome = dataset.read<double>();
-            }
-            else if (type == HighFive::AtomicType<std::string>())
-            {
-                *tome = dataset.read<std::string>();
-            }
-            else
-            {
-                throw ReadError(fmt::format(
-                    "unsupported data type for scalar dataset at '{}'", path));
-            }
+            r = Tome::dict();
+            for (auto const &key : file_->getGroup(path_).listObjectNames())
+                r[key] = Tome::lazy(std::make_shared<Hdf5Loader>(
+                    file_, child_path(path_, key)));
         }
         else
-        {
+            read_dataset(r, file_->getDataSet(path_), info_, path_);
+        return r;
+    }
 
-            // read an array
-            if (type == HighFive::AtomicType<double>())
-            {
-                std::vector<double> values(size);
-                dataset.read_raw(values.data());
-                *tome = Tome::array(std::move(values), shape);
-            }
-            else if (type == HighFive::AtomicType<int64_t>())
-            {
-                std::vector<int64_t> values(size);
-                dataset.read_raw(values.data());
-                *tome = Tome::array(std::move(values), shape);
-            }
-            else
-            {
-                throw ReadError(fmt::format(
-                    "unsupported data type for array dataset at '{}'", path));
-            }
-        }
+    std::optional<Schema> schema() const override
+    {
+        if (info_.type == HighFive::ObjectType::Group)
+            return std::nullopt;
+        if (!info_.num_type)
+            return info_.shape.empty() && info_.is_string
+                       ? std::optional(Schema::string())
+                       : std::nullopt;
+        auto elements = Schema::number(*info_.num_type);
+        if (info_.shape.empty())
+            return elements;
+        ArraySchema array_schema;
+        array_schema.elements = elements;
+        array_schema.shape =
+            std::vector<int64_t>(info_.shape.begin(), info_.shape.end());
+        return Schema(std::move(array_schema));
     }
+};
+
+// Everything needed while reading a file. Objects are addressed as 'name'
+// inside an already opened 'parent' group (empty name for the group itself),
+// so that HDF5 never has to resolve full paths from the root. 'path' is only
+// used for the index and for error messages.
+struct ReadContext
+{
+    ValidationPlan const &plan;
+    internal::Hdf5Index &index;
+    internal::Hdf5ReadQueue *queue;
+    std::pmr::memory_resource *memory; // nullptr for the global heap
+    KeyPool keys;                      // dict keys read without schema
+
+    internal::Hdf5ObjectInfo const &lookup(HighFive::Group const &parent,
+                                           std::string const &name,
+                                           std::string const &path)
+    {
+        auto info = index.find(parent, name, path);
+        if (!info)
+            throw ReadError(fmt::format("object '{}' does not exist", path));
+        return *info;
+    }
+
+    HighFive::DataSet dataset(HighFive::Group const &parent,
+                              std::string const &name, std::string const &path)
+    {
+        if (lookup(parent, name, path).type != HighFive::ObjectType::Dataset)
+            throw ValidationError(
+                fmt::format("expected dataset at '{}'", path));
+        return parent.getDataSet(name);
+    }
+
+    HighFive::Group group(HighFive::Group const &parent,
+                          std::string const &name, std::string const &path)
+    {
+        if (lookup(parent, name, path).type != HighFive::ObjectType::Group)
+            throw ValidationError(fmt::format("expected group at '{}'", path));
+        return name.empty() ? parent : parent.getGroup(name);
+    }
+};
+
+void read_object(Tome *, ReadContext &, HighFive::Group const &parent,
+                 std::string const &name, std::string const &path, NodeId);
+
+void read_impl(Tome *, ReadContext &, HighFive::Group const &,
+               std::string const &, std::string const &, NoneSchema const &,
+               NodeId)
+{
+    throw ValidationError("NoneSchema is never valid");
+}
+
+void read_impl(Tome *tome, ReadContext &ctx, HighFive::Group const &parent,
+               std::string const &name, std::string const &path,
+               AnySchema const &, NodeId node)
+{
+    auto const &info = ctx.lookup(parent, name, path);
+
+    // validate-only -> no need to read anything
+    if (tome == nullptr)
+        return;
+
+    // check if the object is a group or dataset
+    if (info.type == HighFive::ObjectType::Group)
+    {
+        auto group = ctx.group(parent, name, path);
+        std::vector<std::string> item_keys = group.listObjectNames();
+        *tome = Tome::dict(ctx.memory);
+        for (auto const &key : item_keys)
+            read_impl(&tome->as_dict()[ctx.keys.intern(key)], ctx, group, key,
+                      child_path(path, key), AnySchema{}, node);
+    }
+    else if (info.type == HighFive::ObjectType::Dataset)
+        read_dataset(*tome, parent.getDataSet(name), info, path, ctx.queue,
+                     ctx.memory);
     else
     {
         throw ReadError(
@@ -89,24 +378,26 @@ void read_impl(Tome *tome, HighFive::File &file, std::string const &path,
     }
 }
 
-void read_impl(Tome *tome, HighFive::File &file, std::string const &path,
-               BooleanSchema const &schema)
+void read_impl(Tome *tome, ReadContext &ctx, HighFive::Group const &parent,
+               std::string const &name, std::string const &path,
+               BooleanSchema const &schema, NodeId)
 {
     (void)tome;
-    (void)file;
+    (void)ctx;
+    (void)parent;
+    (void)name;
     (void)path;
     (void)schema;
     throw std::runtime_error("not implemented (BooleanSchema)");
 }
 
-void read_impl(Tome *tome, HighFive::File &file, std::string const &path,
-               NumberSchema const &schema)
+void read_impl(Tome *tome, ReadContext &ctx, HighFive::Group const &parent,
+               std::string const &name, std::string const &path,
+               NumberSchema const &schema, NodeId)
 {
     // NOTE: a raw number (not in a homogeneous array) is stored as a scalar
     // dataset in HDF5
-    if (!file.exist(path))
-        throw ReadError(fmt::format("object '{}' does not exist", path));
-    auto dataset = file.getDataSet(path);
+    auto dataset = ctx.dataset(parent, name, path);
     if (dataset.getElementCount() != 1)
         throw ReadError(fmt::format("expected scalar dataset at '{}'", path));
     if (schema.is_integer())
@@ -114,37 +405,41 @@ void read_impl(Tome *tome, HighFive::File &file, std::string const &path,
         auto value = dataset.read<int64_t>();
         schema.validate(value);
         if (tome)
-            *tome = value;
+            *tome = Tome::number_unchecked(value, schema.type);
     }
     else if (schema.is_real())
     {
         auto value = dataset.read<double>();
         schema.validate(value);
         if (tome)
-            *tome = value;
+            *tome = Tome::number_unchecked(value, schema.type);
     }
     else
-        throw std::runtime_error(
-            "invalid NumType (Complex not implemented yet)");
+    {
+        auto value = dataset.read<std::complex<double>>();
+        schema.validate(value.real(), value.imag());
+        if (tome && schema.type == NumType::COMPLEX_FLOAT32)
+            *tome = complex_float32_t(value);
+        else if (tome)
+            *tome = value;
+    }
 }
 
-void read_impl(Tome *tome, HighFive::File &file, std::string const &path,
-               StringSchema const &schema)
+void read_impl(Tome *tome, ReadContext &ctx, HighFive::Group const &parent,
+               std::string const &name, std::string const &path,
+               StringSchema const &schema, NodeId)
 {
-    if (!file.exist(path))
-        throw ReadError(fmt::format("object '{}' does not exist", path));
-    auto dataset = file.getDataSet(path);
+    auto dataset = ctx.dataset(parent, name, path);
     auto value = dataset.read<std::string>();
     schema.validate(value);
     if (tome)
         *tome = value;
 }
 
-void read_impl(Tome *tome, HighFive::File &file, std::string const &path,
-               ArraySchema const &schema)
+void read_impl(Tome *tome, ReadContext &ctx, HighFive::Group const &parent,
+               std::string const &name, std::string const &path,
+               ArraySchema const &schema, NodeId)
 {
-    if (!file.exist(path))
-        throw ReadError(fmt::format("object '{}' does not exist", path));
     NumberSchema item_schema;
     schema.elements.visit(overloaded{
         [&](NumberSchema const &s) { item_schema = s; },
@@ -153,138 +448,140 @@ void read_impl(Tome *tome, HighFive::File &file, std::string const &path,
                                      "than numbers is not implemented yet");
         }});
 
-    auto dataset = file.getDataSet(path);
-    auto shape = dataset.getDimensions();
-    size_t size = dataset.getElementCount();
+    auto dataset = ctx.dataset(parent, name, path);
+    auto const &info = ctx.lookup(parent, name, path);
+    auto const &shape = info.shape;
     schema.validate_shape(shape);
-    if (item_schema.is_real())
-    {
-        auto values = std::vector<double>(size);
-        dataset.read_raw(values.data());
-        if (tome)
-            *tome = Tome::array(std::move(values), shape);
-    }
+    internal::hdf5_validate_chunking(schema, dataset, shape);
+
+    // validate-only -> no need to read the actual data
+    if (!tome)
+        return;
+
+    // NOTE: HDF5 converts to the element type of the schema if necessary.
+    //       That bypasses validation, so it is done by hand instead.
+    visit_num_type(item_schema.type, [&]<class T>(T) {
+        *tome = Tome::array(Array<T>::from_shape(shape), ctx.memory);
+        auto &values = tome->as_numeric_array<T>();
+        if (info.num_type && *info.num_type != item_schema.type)
+            internal::hdf5_read_converted(dataset, info, item_schema.type,
+                                          values.data());
+        else
+            read_array(values, dataset, info, ctx.queue);
+    });
 }
 
-void read_impl(Tome *tome, HighFive::File &file, std::string const &path,
-               DictSchema const &schema)
+void read_impl(Tome *tome, ReadContext &ctx, HighFive::Group const &parent,
+               std::string const &name, std::string const &path,
+               DictSchema const &, NodeId node)
 {
-    assert(file.isValid());
-    if (!file.exist(path))
-        throw ReadError(fmt::format("object '{}' does not exist", path));
-    auto group = file.getGroup(path);
+    auto group = ctx.group(parent, name, path);
 
     // get and validate list of items inside this group
     std::vector<std::string> item_keys = group.listObjectNames();
-    std::vector<Schema> item_schemas = schema.validate(item_keys);
-    assert(item_keys.size() == item_schemas.size());
+    std::vector<uint32_t> indices;
+    ctx.plan.validate_keys(node, item_keys, indices);
+    assert(item_keys.size() == indices.size());
 
     // read and validate each item
+    auto const &n = ctx.plan.node(node);
     if (tome)
-        *tome = Tome::dict();
+        *tome = Tome::dict(ctx.memory);
     for (size_t i = 0; i < item_keys.size(); ++i)
-        internal::read_hdf5(tome ? &tome->as_dict()[item_keys[i]] : nullptr,
-                            file, path + "/" + item_keys[i], item_schemas[i]);
+        read_object(tome ? &tome->as_dict()[n.item_keys[indices[i]]] : nullptr,
+                    ctx, group, item_keys[i], child_path(path, item_keys[i]),
+                    n.items[indices[i]]);
 }
 
-void write_impl(HighFive::File &file, std::string const &path, Tome const &tome,
-                NoneSchema const &)
+void read_object(Tome *tome, ReadContext &ctx, HighFive::Group const &parent,
+                 std::string const &name, std::string const &path, NodeId node)
 {
-    (void)file;
-    (void)path;
+    ctx.plan.schema(node).visit([&](auto const &s) {
+        read_impl(tome, ctx, parent, name, path, s, node);
+    });
+}
+
+void write_object(HighFive::Group &parent, std::string const &name,
+                  Tome const &tome, ValidationPlan const &plan, NodeId node);
+
+void write_impl(HighFive::Group &parent, std::string const &name,
+                Tome const &tome, NoneSchema const &, ValidationPlan const &,
+                NodeId)
+{
+    (void)parent;
+    (void)name;
     (void)tome;
     throw ValidationError("NoneSchema is never valid");
 }
 
-void write_impl(HighFive::File &file, std::string const &path, Tome const &tome,
-                AnySchema const &)
+void write_impl(HighFive::Group &parent, std::string const &name,
+                Tome const &tome, AnySchema const &, ValidationPlan const &,
+                NodeId)
 {
-    (void)file;
-    (void)path;
+    (void)parent;
+    (void)name;
     (void)tome;
     throw std::runtime_error("AnySchema is not supported for writing");
 }
 
-void write_impl(HighFive::File &file, std::string const &path, Tome const &tome,
-                BooleanSchema const &schema)
+void write_impl(HighFive::Group &parent, std::string const &name,
+                Tome const &tome, BooleanSchema const &schema,
+                ValidationPlan const &, NodeId)
 {
-    (void)file;
-    (void)path;
+    (void)parent;
+    (void)name;
     (void)tome;
     (void)schema;
     throw std::runtime_error("not implemented (BooleanSchema)");
 }
 
-void write_impl(HighFive::File &file, std::string const &path, Tome const &tome,
-                NumberSchema const &schema)
+// validate a number, then convert it to the type given by the schema
+Tome number_value(Tome const &tome, NumberSchema const &schema)
 {
-    if (schema.is_integer())
-    {
-        auto value = tome.get<int64_t>();
-        schema.validate(value);
-        switch (schema.type)
-        {
-        case NumType::INT8:
-            file.createDataSet<int8_t>(path, value);
-            break;
-        case NumType::INT16:
-            file.createDataSet<int16_t>(path, value);
-            break;
-        case NumType::INT32:
-            file.createDataSet<int32_t>(path, value);
-            break;
-        case NumType::INT64:
-            file.createDataSet<int64_t>(path, value);
-            break;
-        case NumType::UINT8:
-            file.createDataSet<uint8_t>(path, value);
-            break;
-        case NumType::UINT16:
-            file.createDataSet<uint16_t>(path, value);
-            break;
-        case NumType::UINT32:
-            file.createDataSet<uint32_t>(path, value);
-            break;
-        case NumType::UINT64:
-            file.createDataSet<uint64_t>(path, value);
-            break;
-        default:
-            throw std::runtime_error("invalid NumType");
-        }
-    }
-    else if (schema.is_real())
-    {
-        auto value = tome.get<double>();
-        schema.validate(value);
-        switch (schema.type)
-        {
-        case NumType::FLOAT32:
-            file.createDataSet<float>(path, value);
-            break;
-        case NumType::FLOAT64:
-            file.createDataSet<double>(path, value);
-            break;
-        default:
-            throw std::runtime_error("invalid NumType");
-        }
-    }
-    else
-        throw std::runtime_error(
-            "invalid NumType (Complex not implemented yet)");
+    return tome.visit<Tome>(overloaded{
+        [&](IntegerType auto const &v) {
+            schema.validate_number(v);
+            return Tome::number_unchecked(v, schema.type);
+        },
+        [&](RealType auto const &v) {
+            schema.validate(static_cast<double>(v));
+            return Tome::number_unchecked(v, schema.type);
+        },
+        [&](ComplexType auto const &v) {
+            schema.validate(v.real(), v.imag());
+            if (schema.type == NumType::COMPLEX_FLOAT32)
+                return Tome(complex_float32_t(v));
+            return Tome(complex_float64_t(v));
+        },
+        [](auto const &) -> Tome {
+            throw ValidationError("expected number");
+        }});
+}
+
+void write_impl(HighFive::Group &parent, std::string const &name,
+                Tome const &tome, NumberSchema const &schema,
+                ValidationPlan const &, NodeId)
+{
+    // NOTE: a raw number (not in a homogeneous array) is stored as a scalar
+    // dataset in HDF5
+    number_value(tome, schema).visit(overloaded{
+        [&]<NumberType T>(T const &v) { parent.createDataSet<T>(name, v); },
+        [](auto const &) { assert(false); }});
 }
 
-void write_impl(HighFive::File &file, std::string const &path, Tome const &tome,
-                StringSchema const &schema)
+void write_impl(HighFive::Group &parent, std::string const &name,
+                Tome const &tome, StringSchema const &schema,
+                ValidationPlan const &, NodeId)
 {
-    auto value = tome.as_string();
+    auto const &value = tome.as_string();
     schema.validate(value);
-    file.createDataSet<std::string>(path, value);
+    parent.createDataSet<std::string>(name, value);
 }
 
-void write_impl(HighFive::File &file, std::string const &path, Tome const &tome,
-                ArraySchema const &schema)
+// validate a numeric array, then call 'f(data, shape)' with its elements in
+// contiguous storage of the element type given by the schema
+void visit_array_data(Tome const &tome, ArraySchema const &schema, auto &&f)
 {
-    auto values = tome.as_array();
     NumberSchema item_schema;
     schema.elements.visit(overloaded{
         [&](NumberSchema const &s) { item_schema = s; },
@@ -293,64 +590,742 @@ void write_impl(HighFive::File &file, std::string const &path, Tome const &tome,
             throw std::runtime_error("ArraySchema containing something other "
                                      "than numbers is not implemented yet");
         }});
-    if (item_schema.type == NumType::FLOAT64)
+
+    tome.visit(overloaded{
+        [&]<NumberType T>(Array<T> const &values) {
+            if (num_type_of<T>() != item_schema.type)
+                throw ValidationError(
+                    fmt::format("expected array of {}, got array of {}",
+                                to_string(item_schema.type),
+                                to_string(num_type_of<T>())));
+            schema.validate_shape(values.shape());
+
+            // compact array -> hand the storage directly to HDF5 (no copy)
+            f(values.data(), values.shape());
+        },
+        [&](Tome::array_type const &values) {
+            schema.validate_shape(values.shape());
+
+            // generic array -> gather elements into contiguous storage first
+            visit_num_type(item_schema.type, [&]<class T>(T) {
+                std::vector<T> data;
+                data.reserve(values.size());
+                for (Tome const &v : values)
+                    data.push_back(v.get<T>());
+                f(data.data(), values.shape());
+            });
+        },
+        [](auto const &) { throw ValidationError("expected array"); }});
+}
+
+void write_impl(HighFive::Group &parent, std::string const &name,
+                Tome const &tome, ArraySchema const &schema,
+                ValidationPlan const &, NodeId)
+{
+    visit_array_data(
+        tome, schema,
+        [&]<class T>(T const *data, std::vector<size_t> const &shape) {
+            write_dataset(parent, name, schema, data, shape);
+        });
+}
+
+// keys of a dict, validated against the DictSchema 'node'. 'indices' are the
+// items they belong to (see 'ValidationPlan::validate_keys').
+std::vector<std::string> dict_keys(Tome const &tome, ValidationPlan const &plan,
+                                   NodeId node, std::vector<uint32_t> &indices)
+{
+    std::vector<std::string> keys;
+    keys.reserve(tome.as_dict().size());
+    for (auto const &[key, _] : tome.as_dict())
+        keys.push_back(key.str());
+    plan.validate_keys(node, keys, indices);
+    return keys;
+}
+
+void write_impl(HighFive::Group &parent, std::string const &name,
+                Tome const &tome, DictSchema const &,
+                ValidationPlan const &plan, NodeId node)
+{
+    if (!tome.is_dict())
+        throw ValidationError("expected a dictionary");
+    std::vector<uint32_t> indices;
+    auto keys = dict_keys(tome, plan, node, indices);
+
+    // empty name -> write into 'parent' itself (e.g. the root group)
+    auto group = name.empty() ? parent : parent.createGroup(name);
+    auto const &items = plan.node(node).items;
+    size_t i = 0;
+    for (auto const &[_, value] : tome.as_dict())
     {
-        // TODO: aaaaaaah, this is so ugly
-        auto shape = values.shape();
-        auto dataset = file.createDataSet<double>(
-            path, HighFive::DataSpace(values.shape()));
-        std::vector<double> data;
-        for (Tome const &v : values)
-            data.push_back(v.get<double>());
-        dataset.write_raw<double>(data.data());
+        write_object(group, keys[i], value, plan, items[indices[i]]);
+        ++i;
     }
-    else if (item_schema.type == NumType::COMPLEX_FLOAT64)
+}
+
+void write_object(HighFive::Group &parent, std::string const &name,
+                  Tome const &tome, ValidationPlan const &plan, NodeId node)
+{
+    plan.schema(node).visit(
+        [&](auto const &s) { write_impl(parent, name, tome, s, plan, node); });
+}
+
+// overwrite the data of an existing dataset (number, string or numeric
+// array), if neither type nor shape changed. Returns false if the dataset has
+// to be recreated instead.
+bool overwrite_dataset(HighFive::Group &parent, std::string const &name,
+                       Tome const &tome, Schema const &schema)
+{
+    if (parent.getObjectType(name) != HighFive::ObjectType::Dataset)
+        return false;
+    auto dataset = parent.getDataSet(name);
+    auto type = internal::hdf5_num_type(dataset.getDataType());
+    auto const &impl = schema.impl().schema_;
+
+    if (auto const *s = std::get_if<NumberSchema>(&impl))
     {
-        auto shape = values.shape();
-        auto dataset = file.createDataSet<std::complex<double>>(
-            path, HighFive::DataSpace(values.shape()));
-        std::vector<std::complex<double>> data;
-        for (Tome const &v : values)
-            data.push_back(v.get<std::complex<double>>());
-        dataset.write_raw<std::complex<double>>(data.data());
+        if (type != s->type || !dataset.getDimensions().empty())
+            return false;
+        number_value(tome, *s).visit(overloaded{
+            [&]<NumberType T>(T const &v) { dataset.write(v); },
+            [](auto const &) { assert(false); }});
+        return true;
     }
-    else
-        throw std::runtime_error("not implemented (ArraySchema containing "
-                                 "something other than float64)");
+    if (auto const *s = std::get_if<StringSchema>(&impl))
+    {
+        // variable-length strings, as written by 'write_impl'
+        if (dataset.getDataType() != HighFive::AtomicType<std::string>() ||
+            !dataset.getDimensions().empty())
+            return false;
+        auto const &value = tome.as_string();
+        s->validate(value);
+        dataset.write(value);
+        return true;
+    }
+    if (auto const *s = std::get_if<ArraySchema>(&impl))
+    {
+        bool done = false;
+        visit_array_data(
+            tome, *s,
+            [&]<class T>(T const *data, std::vector<size_t> const &shape) {
+                if (type != num_type_of<T>() ||
+                    dataset.getDimensions() != shape)
+                    return;
+                dataset.write_raw(data);
+                done = true;
+            });
+        return done;
+    }
+    return false;
 }
 
-void write_impl(HighFive::File &file, std::string const &path, Tome const &tome,
-                DictSchema const &schema)
+// write the parts of 'tome' that changed since 'base', which is what the file
+// currently contains at that location (nullptr if unknown)
+void update_object(HighFive::Group &parent, std::string const &name,
+                   Tome const &tome, Tome const *base,
+                   ValidationPlan const &plan, NodeId node)
 {
-    if (!tome.is_dict())
-        throw ValidationError("expected a dictionary");
-    std::vector<std::string> keys;
-    for (auto const &[key, _] : tome.as_dict())
-        keys.push_back(key);
-    auto item_schemas = schema.validate(keys);
-    assert(keys.size() == item_schemas.size());
+    // empty name -> 'parent' itself (e.g. the root group)
+    bool exists = name.empty() || parent.exist(name);
+    if (exists && base && tome.unchanged_since(*base))
+        return;
+
+    // dicts are updated item by item
+    auto const &schema = plan.schema(node);
+    if (std::holds_alternative<DictSchema>(schema.impl().schema_) && exists &&
+        base && base->is_dict() && tome.is_dict() &&
+        (name.empty() ||
+         parent.getObjectType(name) == HighFive::ObjectType::Group))
+    {
+        std::vector<uint32_t> indices;
+        auto keys = dict_keys(tome, plan, node, indices);
+
+        auto group = name.empty() ? parent : parent.getGroup(name);
+        auto const &items = plan.node(node).items;
+        auto const &old = base->as_dict();
+        size_t i = 0;
+        for (auto const &[_, value] : tome.as_dict())
+        {
+            auto it = old.find(keys[i]);
+            update_object(group, keys[i], value,
+                          it == old.end() ? nullptr : &it->second, plan,
+                          items[indices[i]]);
+            ++i;
+        }
+        for (auto const &[key, _] : old)
+            if (!tome.as_dict().contains(key) && group.exist(key.str()))
+                group.unlink(key.str());
+        return;
+    }
+
+    if (exists && overwrite_dataset(parent, name, tome, schema))
+        return;
 
-    if (path != "/")
-        file.createGroup(path);
-    for (size_t i = 0; i < keys.size(); ++i)
-        internal::write_hdf5(file, path + "/" + keys[i],
-                             tome.as_dict().at(keys[i]), item_schemas[i]);
+    // NOTE: HDF5 does not reuse the space of unlinked objects after the
+    //       file is closed. Use 'h5repack' to reclaim it.
+    if (exists && !name.empty())
+        parent.unlink(name);
+    write_object(parent, name, tome, plan, node);
 }
 
 } // namespace
 
+std::recursive_mutex &scribe::internal::hdf5_mutex()
+{
+    static std::recursive_mutex mutex;
+    return mutex;
+}
+
+scribe::internal::Hdf5ReadQueue::Hdf5ReadQueue(HighFive::File const &file)
+    : filename_(file.getName())
+{
+    // direct reads need the plain POSIX file driver (no MPI, no in-memory,
+    // no split files, ...)
+    hid_t fapl = H5Fget_access_plist(file.getId());
+    direct_ = fapl >= 0 && H5Pget_driver(fapl) == H5FD_SEC2;
+    if (fapl >= 0)
+        H5Pclose(fapl);
+}
+
+void scribe::internal::Hdf5ReadQueue::push(HighFive::DataSet const &dataset,
+                                           HighFive::DataType const &mem_type,
+                                           void *data, size_t bytes)
+{
+    // all HDF5 calls happen here, so that 'run()' does not need them for
+    // directly readable datasets
+    std::optional<uint64_t> offset;
+    if (direct_ && dataset.getDataType() == mem_type)
+        offset = direct_offset(dataset);
+    push(dataset, mem_type, data, bytes, offset);
+}
+
+void scribe::internal::Hdf5ReadQueue::push(HighFive::DataSet const &dataset,
+                                           HighFive::DataType const &mem_type,
+                                           void *data, size_t bytes,
+                                           std::optional<uint64_t> offset)
+{
+    if (!direct_)
+        offset = std::nullopt;
+    items_.push_back({dataset, mem_type, data, bytes, offset});
+}
+
+void scribe::internal::Hdf5ReadQueue::run(int num_threads)
+{
+    // Only the calling thread calls into HDF5 (holding 'hdf5_mutex()', which
+    // it may already hold anyway). The other threads only do direct reads,
+    // so they never wait for that lock. Largest reads first for better load
+    // balancing.
+    std::sort(items_.begin(), items_.end(), [](Item const &a, Item const &b) {
+        return a.bytes > b.bytes;
+    });
+    auto direct_end = std::stable_partition(
+        items_.begin(), items_.end(),
+        [](Item const &item) { return item.offset.has_value(); });
+    size_t direct_count = direct_end - items_.begin();
+
+    int fd = -1;
+    if (direct_count)
+    {
+        fd = ::open(filename_.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw ReadError(fmt::format("could not open file '{}': {}",
+                                        filename_, std::strerror(errno)));
+    }
+
+    std::atomic<size_t> next = 0;
+    std::mutex error_mutex;
+    std::exception_ptr error;
+
+    auto read_direct = [&](Item const &item) {
+        auto ptr = static_cast<char *>(item.data);
+        size_t done = 0;
+        while (done < item.bytes)
+        {
+            // NOTE: some systems limit the size of a single read to 2 GB
+            size_t count = std::min(item.bytes - done, size_t(1) << 30);
+            ssize_t r = ::pread(fd, ptr + done, count, *item.offset + done);
+            if (r < 0 && errno == EINTR)
+                continue;
+            if (r <= 0)
+                throw ReadError(fmt::format("could not read from file '{}'",
+                                            filename_));
+            done += r;
+        }
+    };
+
+    auto catch_error = [&](auto &&f) {
+        try
+        {
+            f();
+        }
+        catch (...)
+        {
+            auto lock = std::lock_guard(error_mutex);
+            if (!error)
+                error = std::current_exception();
+        }
+    };
+
+    auto work = [&] {
+        for (size_t i; (i = next++) < direct_count;)
+            catch_error([&] { read_direct(items_[i]); });
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < std::min<int>(num_threads, direct_count); ++i)
+        threads.emplace_back(work);
+    {
+        auto lock = hdf5_lock();
+        for (size_t i = direct_count; i < items_.size(); ++i)
+            catch_error([&] {
+                auto const &item = items_[i];
+                if (H5Dread(item.dataset.getId(), item.mem_type.getId(),
+                            H5S_ALL, H5S_ALL, H5P_DEFAULT, item.data) < 0)
+                    throw ReadError("could not read dataset");
+            });
+    }
+    work();
+    for (auto &t : threads)
+        t.join();
+
+    if (fd >= 0)
+        ::close(fd);
+    {
+        auto lock = hdf5_lock();
+        items_.clear();
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+scribe::internal::Hdf5Index::Hdf5Index(HighFive::File const &file,
+                                       std::string const &root)
+{
+    if (root != "/" && !file.exist(root))
+        return;
+    if (file.getObjectType(root) != HighFive::ObjectType::Group)
+    {
+        if (auto info = hdf5_object_info(file.getGroup("/"), root); info)
+            objects_.emplace(root, std::move(*info));
+        return;
+    }
+
+    auto group = file.getGroup(root);
+    auto visit = IndexVisit{objects_, group, root, nullptr};
+#if H5_VERSION_GE(1, 12, 0)
+    herr_t r = H5Ovisit3(group.getId(), H5_INDEX_NAME, H5_ITER_INC,
+                         &index_object<H5O_info2_t>, &visit, H5O_INFO_BASIC);
+#else
+    herr_t r = H5Ovisit2(group.getId(), H5_INDEX_NAME, H5_ITER_INC,
+                         &index_object<H5O_info_t>, &visit, H5O_INFO_BASIC);
+#endif
+    if (visit.error)
+        std::rethrow_exception(visit.error);
+    if (r < 0)
+        throw ReadError(fmt::format("could not index hdf5 file '{}'",
+                                    file.getName()));
+}
+
+scribe::internal::Hdf5ObjectInfo const *
+scribe::internal::Hdf5Index::find(HighFive::Group const &parent,
+                                  std::string const &name,
+                                  std::string const &path)
+{
+    if (auto it = objects_.find(path); it != objects_.end())
+        return &it->second;
+    if (name.empty())
+        return nullptr;
+    auto info = hdf5_object_info(parent, name);
+    if (!info)
+        return nullptr;
+    return &objects_.emplace(path, std::move(*info)).first->second;
+}
+
+std::optional<scribe::internal::Hdf5ObjectInfo>
+scribe::internal::hdf5_object_info(HighFive::Group const &parent,
+                                   std::string const &name)
+{
+    if (name.empty() || name == "/")
+        return Hdf5ObjectInfo{.type = HighFive::ObjectType::Group};
+    if (!parent.exist(name))
+        return std::nullopt;
+    auto type = parent.getObjectType(name);
+    if (type == HighFive::ObjectType::Dataset)
+        return describe_dataset(parent.getDataSet(name));
+    return Hdf5ObjectInfo{.type = type};
+}
+
 void scribe::internal::read_hdf5(Tome *tome, HighFive::File &file,
-                                 std::string const &path, Schema const &schema)
+                                 std::string const &path, Schema const &schema,
+                                 Hdf5ReadQueue *queue,
+                                 std::pmr::memory_resource *memory)
 {
+    auto lock = hdf5_lock();
     assert(file.isValid());
     assert(!path.empty() && path.front() == '/');
-    schema.visit([&](auto const &s) { read_impl(tome, file, path, s); });
+    if (path != "/" && !file.exist(path))
+        throw ReadError(fmt::format("object '{}' does not exist", path));
+    auto plan = ValidationPlan(schema);
+    auto index = Hdf5Index(file, path);
+    auto ctx = ReadContext{plan, index, queue, memory, KeyPool(memory)};
+    auto [parent, name] = split_path(file, path);
+    read_object(tome, ctx, parent, name, path, plan.root());
 }
 
 void scribe::internal::write_hdf5(HighFive::File &file, std::string const &path,
                                   Tome const &tome, Schema const &schema)
 {
+    auto lock = hdf5_lock();
     assert(file.isValid());
     assert(!path.empty() && path.front() == '/');
-    schema.visit([&](auto const &s) { write_impl(file, path, tome, s); });
-}
\ No newline at end of file
+    auto plan = ValidationPlan(schema);
+    auto [parent, name] = split_path(file, path);
+    write_object(parent, name, tome, plan, plan.root());
+}
+
+void scribe::internal::update_hdf5(HighFive::File &file,
+                                   std::string const &path, Tome const &tome,
+                                   Tome const &base, Schema const &schema)
+{
+    auto lock = hdf5_lock();
+    assert(file.isValid());
+    assert(!path.empty() && path.front() == '/');
+    auto plan = ValidationPlan(schema);
+    auto [parent, name] = split_path(file, path);
+    update_object(parent, name, tome, &base, plan, plan.root());
+}
+
+void scribe::internal::read_hdf5_slice(Tome &tome, HighFive::File &file,
+                                       std::string const &path,
+                                       Hyperslab const &slab)
+{
+    auto lock = hdf5_lock();
+    if (!file.exist(path) ||
+        file.getObjectType(path) != HighFive::ObjectType::Dataset)
+        throw ReadError(fmt::format("no dataset at '{}'", path));
+    auto dataset = file.getDataSet(path);
+    slab.validate(dataset.getDimensions());
+    auto type = hdf5_num_type(dataset.getDataType());
+    if (!type)
+        throw ReadError(
+            fmt::format("partial read of non-numeric dataset '{}'", path));
+
+    visit_num_type(*type, [&]<class T>(T) {
+        auto values = Array<T>::from_shape(slab.count);
+        dataset.select(slab.offset, slab.count, slab.stride)
+            .read_raw(values.data());
+        tome = Tome::array(std::move(values));
+    });
+}
+
+void scribe::internal::read_hdf5_lazy(Tome &tome,
+                                      std::shared_ptr<HighFive::File> file,
+                                      std::string const &path)
+{
+    tome = Tome::lazy(std::make_shared<Hdf5Loader>(std::move(file), path));
+}
+
+std::optional<scribe::NumType>
+scribe::internal::hdf5_num_type(HighFive::DataType const &type)
+{
+    for (auto t : {NumType::INT8, NumType::INT16, NumType::INT32,
+                   NumType::INT64, NumType::UINT8, NumType::UINT16,
+                   NumType::UINT32, NumType::UINT64, NumType::FLOAT32,
+                   NumType::FLOAT64, NumType::COMPLEX_FLOAT32,
+                   NumType::COMPLEX_FLOAT64})
+        if (visit_num_type(t, [&]<class T>(T) {
+                return type == HighFive::create_datatype<T>();
+            }))
+            return t;
+    return std::nullopt;
+}
+
+void scribe::internal::hdf5_read_converted(HighFive::DataSet const &dataset,
+                                           Hdf5ObjectInfo const &info,
+                                           NumType type, void *data)
+{
+    assert(info.num_type && *info.num_type != type);
+    auto lock = hdf5_lock();
+    auto schema = NumberSchema{type};
+    size_t count = 1;
+    for (auto n : info.shape)
+        count *= n;
+    visit_num_type(*info.num_type, [&]<class U>(U) {
+        auto stored = std::vector<U>(count);
+        dataset.read_raw(stored.data());
+        visit_num_type(type, [&]<class T>(T) {
+            auto *out = static_cast<T *>(data);
+            for (size_t i = 0; i < count; ++i)
+            {
+                schema.validate_number(stored[i]);
+                if constexpr (ComplexType<U> && !ComplexType<T>)
+                    assert(false); // rejected by 'validate_number'
+                else
+                    out[i] = static_cast<T>(stored[i]);
+            }
+        });
+    });
+}
+
+namespace {
+// number of rows and shape of a single row of 'value' when appending it to an
+// array of given rank (see 'Appender')
+std::pair<size_t, std::vector<size_t>> appended_rows(Tome const &value,
+                                                     size_t rank)
+{
+    auto shape = value.visit<std::vector<size_t>>(overloaded{
+        [](ArrayType auto const &a) -> std::vector<size_t> {
+            return a.shape();
+        },
+        [](NumberType auto const &) { return std::vector<size_t>{}; },
+        [](auto const &) -> std::vector<size_t> {
+            throw ValidationError("expected array");
+        }});
+    if (shape.size() + 1 == rank)
+        return {1, std::move(shape)};
+    if (shape.size() != rank)
+        throw ValidationError("shape mismatch (wrong number of dimensions)");
+    size_t rows = shape.front();
+    shape.erase(shape.begin());
+    return {rows, std::move(shape)};
+}
+
+// append the elements of 'value' (a number or an array) to 'buffer'
+template <NumberType T>
+void append_elements(std::vector<std::byte> &buffer, Tome const &value)
+{
+    auto push = [&](T const *data, size_t n) {
+        auto bytes = std::as_bytes(std::span(data, n));
+        buffer.insert(buffer.end(), bytes.begin(), bytes.end());
+    };
+    value.visit(overloaded{
+        [&](Array<T> const &values) { push(values.data(), values.size()); },
+        [&]<NumberType U>(Array<U> const &) {
+            throw ValidationError(
+                fmt::format("expected array of {}, got array of {}",
+                            to_string(num_type_of<T>()),
+                            to_string(num_type_of<U>())));
+        },
+        [&](Tome::array_type const &values) {
+            for (Tome const &v : values)
+            {
+                T x = v.get<T>();
+                push(&x, 1);
+            }
+        },
+        [&](NumberType auto const &) {
+            T x = value.get<T>();
+            push(&x, 1);
+        },
+        [](auto const &) { throw ValidationError("expected array"); }});
+}
+} // namespace
+
+struct scribe::Appender::Series
+{
+    HighFive::DataSet dataset;
+    NumType type;
+    std::vector<size_t> shape; // of the dataset, without pending rows
+    size_t chunk_rows = 1;
+    std::vector<std::byte> pending; // rows not written to the file yet
+    size_t pending_rows = 0;
+};
+
+scribe::Appender::Appender(std::string_view filename, Schema const &schema)
+    : Appender(filename, schema, internal::hdf5_lock())
+{}
+
+scribe::Appender::Appender(std::string_view filename, Schema const &schema,
+                           std::unique_lock<std::recursive_mutex>)
+try : file_(std::string(filename), HighFive::File::OpenOrCreate),
+    plan_(schema)
+{
+    if (!std::holds_alternative<DictSchema>(schema.impl().schema_))
+        throw std::runtime_error("appending requires a dict schema");
+}
+catch (HighFive::FileException const &e)
+{
+    throw WriteError(e.what());
+}
+
+scribe::Appender::~Appender()
+{
+    auto lock = internal::hdf5_lock();
+    try
+    {
+        flush();
+    }
+    catch (...)
+    {
+        // destructors must not throw. Call 'flush()' to see errors.
+    }
+
+    // HDF5 handles are closed under the lock as well
+    series_.clear();
+    auto file = std::move(file_);
+}
+
+void scribe::Appender::append(Tome const &value)
+{
+    auto lock = internal::hdf5_lock();
+    auto root = file_.getGroup("/");
+    append(root, "", "/", value, plan_.root());
+}
+
+void scribe::Appender::flush()
+{
+    auto lock = internal::hdf5_lock();
+    for (auto &[path, series] : series_)
+        write(*series);
+    file_.flush();
+}
+
+void scribe::Appender::append(HighFive::Group &parent, std::string const &name,
+                              std::string const &path, Tome const &value,
+                              ValidationPlan::NodeId node)
+{
+    // non-appendable objects are written once, like 'write_file' does
+    auto write_new = [&] {
+        if (!name.empty() && parent.exist(name))
+            throw WriteError(fmt::format(
+                "'{}' already exists and can not be appended to", path));
+        write_object(parent, name, value, plan_, node);
+    };
+
+    plan_.schema(node).visit(overloaded{
+        [&](DictSchema const &) {
+            if (!value.is_dict())
+                throw ValidationError("expected a dictionary");
+            // empty name -> 'parent' itself (i.e. the root group)
+            auto group = name.empty()        ? parent
+                         : parent.exist(name) ? parent.getGroup(name)
+                                              : parent.createGroup(name);
+            for (auto const &[key, item] : value.as_dict())
+            {
+                int i = plan_.find_key(node, key.view());
+                if (i == -1)
+                    throw ValidationError("unexpected key: " + key.str());
+                append(group, key.str(), child_path(path, key.str()), item,
+                       plan_.node(node).items[i]);
+            }
+        },
+        [&](ArraySchema const &s) {
+            if (s.appendable())
+                append_rows(parent, name, path, value, s);
+            else
+                write_new();
+        },
+        [&](auto const &) { write_new(); }});
+}
+
+void scribe::Appender::append_rows(HighFive::Group &parent,
+                                   std::string const &name,
+                                   std::string const &path, Tome const &value,
+                                   ArraySchema const &schema)
+{
+    auto const *elements =
+        std::get_if<NumberSchema>(&schema.elements.impl().schema_);
+    if (!elements)
+        throw std::runtime_error("appending to arrays of something other than "
+                                 "numbers is not implemented");
+    auto type = elements->type;
+
+    auto [rows, row] = appended_rows(value, schema.shape->size());
+    auto shape = row;
+    shape.insert(shape.begin(), rows);
+    schema.validate_shape(shape);
+
+    auto it = series_.find(path);
+    if (it == series_.end() && parent.exist(name))
+    {
+        // continue an existing dataset
+        if (parent.getObjectType(name) != HighFive::ObjectType::Dataset)
+            throw ValidationError(
+                fmt::format("expected dataset at '{}'", path));
+        auto dataset = parent.getDataSet(name);
+        if (internal::hdf5_num_type(dataset.getDataType()) != type)
+            throw ValidationError(fmt::format(
+                "expected array of {} at '{}'", to_string(type), path));
+        auto dims = dataset.getDimensions();
+        schema.validate_shape(dims);
+        auto max_dims = dataset.getSpace().getMaxDimensions();
+        if (max_dims.front() != HighFive::DataSpace::UNLIMITED)
+            throw WriteError(
+                fmt::format("dataset '{}' can not be appended to", path));
+        internal::hdf5_validate_chunking(schema, dataset, dims);
+
+        auto props = dataset.getCreatePropertyList();
+        auto chunk = std::vector<hsize_t>(dims.size());
+        if (H5Pget_chunk(props.getId(), (int)chunk.size(), chunk.data()) !=
+            (int)chunk.size())
+            throw WriteError(
+                fmt::format("could not get chunk size of '{}'", path));
+        auto series = std::unique_ptr<Series>(
+            new Series{dataset, type, dims, size_t(chunk.front())});
+        it = series_.emplace(path, std::move(series)).first;
+    }
+    else if (it == series_.end())
+    {
+        // new dataset of unlimited leading dimension
+        auto dims = row;
+        dims.insert(dims.begin(), 0);
+        auto max_dims = dims;
+        max_dims.front() = HighFive::DataSpace::UNLIMITED;
+        auto chunk = internal::hdf5_appendable_chunk_dims(schema, row);
+        auto props = chunked_props(schema.hdf5, chunk);
+        auto dataset = visit_num_type(type, [&]<class T>(T) {
+            return parent.createDataSet<T>(
+                name, HighFive::DataSpace(dims, max_dims), props);
+        });
+        auto series = std::unique_ptr<Series>(
+            new Series{dataset, type, dims, chunk.front()});
+        it = series_.emplace(path, std::move(series)).first;
+    }
+    auto &series = *it->second;
+
+    if (!std::equal(row.begin(), row.end(), series.shape.begin() + 1,
+                    series.shape.end()))
+        throw ValidationError(fmt::format(
+            "shape mismatch (expected rows of shape ({}), got ({}))",
+            fmt::join(series.shape.begin() + 1, series.shape.end(), ","),
+            fmt::join(row, ",")));
+
+    // NOTE: roll back on invalid elements, so that no partial row remains
+    auto old_size = series.pending.size();
+    try
+    {
+        visit_num_type(type, [&]<class T>(T) {
+            append_elements<T>(series.pending, value);
+        });
+    }
+    catch (...)
+    {
+        series.pending.resize(old_size);
+        throw;
+    }
+    series.pending_rows += rows;
+    if (series.pending_rows >= series.chunk_rows)
+        write(series);
+}
+
+void scribe::Appender::write(Series &series)
+{
+    if (series.pending_rows == 0)
+        return;
+
+    auto offset = std::vector<size_t>(series.shape.size(), 0);
+    offset.front() = series.shape.front();
+    auto count = series.shape;
+    count.front() = series.pending_rows;
+    auto shape = series.shape;
+    shape.front() += series.pending_rows;
+
+    series.dataset.resize(shape);
+    if (!series.pending.empty()) // HDF5 does not like empty selections
+        visit_num_type(series.type, [&]<class T>(T) {
+            series.dataset.select(offset, count)
+                .write_raw(reinterpret_cast<T const *>(series.pending.data()));
+        });
+    series.shape = std::move(shape);
+    series.pending.clear();
+    series.pending_rows = 0;
+}
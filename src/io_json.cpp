@@ -1,25 +1,47 @@
 #include "scribe/io_json.h"
 
+#include "fmt/format.h"
 #include "nlohmann/json.hpp"
 #include "scribe/tome.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstring>
 #include <fstream>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <utility>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SCRIBE_BASE64_X86
+#include <immintrin.h>
+#endif
 
 namespace {
 using namespace scribe;
+using NodeId = ValidationPlan::NodeId;
+using internal::JsonStream;
+
+void read_node(Tome *, nlohmann::json const &, ValidationPlan const &, NodeId);
 
-void read_impl(Tome *tome, nlohmann::json const &, NoneSchema const &)
+void read_impl(Tome *tome, nlohmann::json const &, NoneSchema const &,
+               ValidationPlan const &, NodeId)
 {
     (void)tome;
     throw ValidationError("NoneSchema is never valid");
 }
 
-void read_impl(Tome *tome, nlohmann::json const &, AnySchema const &)
+void read_impl(Tome *tome, nlohmann::json const &, AnySchema const &,
+               ValidationPlan const &, NodeId)
 {
     if (tome)
         throw ReadError("AnySchema cannot be read into a Tome");
 }
 
-void read_impl(Tome *tome, nlohmann::json const &j, BooleanSchema const &)
+void read_impl(Tome *tome, nlohmann::json const &j, BooleanSchema const &,
+               ValidationPlan const &, NodeId)
 {
     if (!j.is_boolean())
         throw ValidationError("expected boolean");
@@ -28,9 +50,18 @@ void read_impl(Tome *tome, nlohmann::json const &j, BooleanSchema const &)
         *tome = Tome::boolean(j.get<bool>());
 }
 
-void read_impl(Tome *tome, nlohmann::json const &j, NumberSchema const &s)
+void read_impl(Tome *tome, nlohmann::json const &j, NumberSchema const &s,
+               ValidationPlan const &, NodeId)
 {
-    if (j.is_number_integer())
+    if (j.is_number_unsigned())
+    {
+        // values above INT64_MAX are only valid for uint64 (and floats)
+        auto value = j.get<uint64_t>();
+        s.validate(value);
+        if (tome)
+            *tome = Tome::number_unchecked(value, s.type);
+    }
+    else if (j.is_number_integer())
     {
         auto value = j.get<int64_t>();
         s.validate(value);
@@ -57,7 +88,8 @@ void read_impl(Tome *tome, nlohmann::json const &j, NumberSchema const &s)
         throw ValidationError("expected number");
 }
 
-void read_impl(Tome *tome, nlohmann::json const &j, StringSchema const &s)
+void read_impl(Tome *tome, nlohmann::json const &j, StringSchema const &s,
+               ValidationPlan const &, NodeId)
 {
     if (!j.is_string())
         throw ValidationError("expected string");
@@ -67,20 +99,63 @@ void read_impl(Tome *tome, nlohmann::json const &j, StringSchema const &s)
         *tome = value;
 }
 
-void read_elements(std::vector<Tome> *elements, nlohmann::json const &j,
-                   Schema const &s, int dim, std::vector<int64_t> &shape)
+// convert a (validated) number to the element type of a compact array
+template <NumberType T> T number_cast(auto value)
+{
+    return static_cast<T>(value);
+}
+template <NumberType T> T number_cast(double real, double imag)
+{
+    // validation only allows complex values for complex schemas
+    if constexpr (ComplexType<T>)
+        return T(real, imag);
+    else
+        throw ValidationError("expected real number, got complex");
+}
+
+// same as 'read_impl(Tome*, json, NumberSchema)', but without the Tome
+template <NumberType T>
+T read_number(nlohmann::json const &j, NumberSchema const &s)
+{
+    if (j.is_number_unsigned())
+    {
+        auto value = j.get<uint64_t>();
+        s.validate(value);
+        return number_cast<T>(value);
+    }
+    else if (j.is_number_integer())
+    {
+        auto value = j.get<int64_t>();
+        s.validate(value);
+        return number_cast<T>(value);
+    }
+    else if (j.is_number_float())
+    {
+        auto value = j.get<double>();
+        s.validate(value);
+        return number_cast<T>(value);
+    }
+    else if (j.is_array() && j.size() == 2 && j[0].is_number() &&
+             j[1].is_number())
+    {
+        auto real = j[0].get<double>();
+        auto imag = j[1].get<double>();
+        s.validate(real, imag);
+        return number_cast<T>(real, imag);
+    }
+    else
+        throw ValidationError("expected number");
+}
+
+// calls 'read(elem)' for each element of a multi-dimensional array in
+// row-major order. Dimensions of size -1 in 'shape' are set to the actual size
+template <class F>
+void read_elements(F &&read, nlohmann::json const &j, int dim,
+                   std::vector<int64_t> &shape)
 {
     if (dim == (int)shape.size())
     {
-        if (elements)
-        {
-            elements->emplace_back();
-            internal::read_json(&elements->back(), j, s);
-        }
-        else
-        {
-            internal::read_json(nullptr, j, s);
-        }
+        read(j);
         return;
     }
 
@@ -94,30 +169,77 @@ void read_elements(std::vector<Tome> *elements, nlohmann::json const &j,
             shape[dim], j.size(), dim, fmt::join(shape, ",")));
 
     for (auto const &elem : j)
-        read_elements(elements, elem, s, dim + 1, shape);
+        read_elements(read, elem, dim + 1, shape);
 }
 
-void read_impl(Tome *tome, nlohmann::json const &j, ArraySchema const &s)
+void read_impl(Tome *tome, nlohmann::json const &j, ArraySchema const &s,
+               ValidationPlan const &plan, NodeId node)
 {
+    auto elements_node = plan.node(node).elements;
+
+    // base64 form of an array of numbers (see 'JsonStorageHints')
+    auto number = std::get_if<NumberSchema>(&s.elements.impl().schema_);
+    if (number && j.is_object())
+    {
+        auto packed = internal::parse_base64_array(j);
+        visit_num_type(number->type, [&]<class T>(T) {
+            Array<T> values;
+            internal::read_base64_array(values, packed.dtype, packed.shape,
+                                        packed.data);
+            s.validate_shape(values.shape());
+            if (tome)
+                *tome = Tome::array(std::move(values));
+        });
+        return;
+    }
+
     if (!s.shape)
         throw ReadError(
             "ArraySchema without shape cannot be read/validated from JSON");
     auto shape = *s.shape;
 
-    if (tome)
+    // arrays of numbers are read into a compact 'Array<T>'
+    if (number)
+    {
+        visit_num_type(number->type, [&]<class T>(T) {
+            std::vector<T> values;
+            read_elements(
+                [&](nlohmann::json const &elem) {
+                    auto value = read_number<T>(elem, *number);
+                    if (tome)
+                        values.push_back(value);
+                },
+                j, 0, shape);
+            if (tome)
+                *tome = Tome::array(
+                    std::move(values),
+                    std::vector<size_t>(shape.begin(), shape.end()));
+        });
+    }
+    else if (tome)
     {
         std::vector<Tome> elements;
-        read_elements(&elements, j, s.elements, 0, shape);
+        read_elements(
+            [&](nlohmann::json const &elem) {
+                elements.emplace_back();
+                read_node(&elements.back(), elem, plan, elements_node);
+            },
+            j, 0, shape);
         *tome = Tome::array(std::move(elements),
                             std::vector<size_t>(shape.begin(), shape.end()));
     }
     else
     {
-        read_elements(nullptr, j, s.elements, 0, shape);
+        read_elements(
+            [&](nlohmann::json const &elem) {
+                read_node(nullptr, elem, plan, elements_node);
+            },
+            j, 0, shape);
     }
 }
 
-void read_impl(Tome *tome, nlohmann::json const &j, DictSchema const &s)
+void read_impl(Tome *tome, nlohmann::json const &j, DictSchema const &,
+               ValidationPlan const &plan, NodeId node)
 {
     if (!j.is_object())
         throw ValidationError("expected object");
@@ -126,151 +248,1898 @@ void read_impl(Tome *tome, nlohmann::json const &j, DictSchema const &s)
     std::vector<std::string> keys;
     for (auto const &item : j.items())
         keys.push_back(item.key());
-    auto schemas = s.validate(keys);
-    assert(keys.size() == schemas.size());
+    std::vector<uint32_t> indices;
+    plan.validate_keys(node, keys, indices);
+    assert(keys.size() == indices.size());
 
     // read and validate each item
+    auto const &n = plan.node(node);
     if (tome)
         *tome = Tome::dict();
-    for (size_t i = 0; i < keys.size(); ++i)
-        internal::read_json(tome ? &tome->as_dict()[keys[i]] : nullptr,
-                            j.at(keys[i]), schemas[i]);
+    size_t i = 0;
+    for (auto const &item : j.items())
+    {
+        auto k = indices[i++];
+        read_node(tome ? &tome->as_dict()[n.item_keys[k]] : nullptr,
+                  item.value(), plan, n.items[k]);
+    }
 }
 
-void write_impl(nlohmann::json &, Tome const &, NoneSchema const &)
+void read_node(Tome *tome, nlohmann::json const &j, ValidationPlan const &plan,
+               NodeId node)
 {
-    throw ValidationError("NoneSchema is never valid");
+    plan.schema(node).visit(
+        [&](auto const &s) { read_impl(tome, j, s, plan, node); });
 }
 
-void write_elements(nlohmann::json &j, Tome const *&elements, Schema const &s,
-                    int dim, std::vector<size_t> const &shape)
+// storage of the elements of a compact array while reading
+using NumberVector =
+    std::variant<std::vector<int8_t>, std::vector<int16_t>,
+                 std::vector<int32_t>, std::vector<int64_t>,
+                 std::vector<uint8_t>, std::vector<uint16_t>,
+                 std::vector<uint32_t>, std::vector<uint64_t>,
+                 std::vector<float32_t>, std::vector<float64_t>,
+                 std::vector<complex_float32_t>,
+                 std::vector<complex_float64_t>>;
+
+// Tag of a little-endian typed array (RFC 8746). Complex numbers are stored
+// as interleaved real and imaginary parts.
+template <NumberType T> constexpr uint8_t typed_array_tag()
 {
-    if (dim == (int)shape.size())
+    if constexpr (ComplexType<T>)
+        return typed_array_tag<typename T::value_type>();
+    else if constexpr (std::same_as<T, uint8_t>)
+        return 64;
+    else if constexpr (std::same_as<T, uint16_t>)
+        return 69;
+    else if constexpr (std::same_as<T, uint32_t>)
+        return 70;
+    else if constexpr (std::same_as<T, uint64_t>)
+        return 71;
+    else if constexpr (std::same_as<T, int8_t>)
+        return 72;
+    else if constexpr (std::same_as<T, int16_t>)
+        return 77;
+    else if constexpr (std::same_as<T, int32_t>)
+        return 78;
+    else if constexpr (std::same_as<T, int64_t>)
+        return 79;
+    else if constexpr (std::same_as<T, float32_t>)
+        return 85;
+    else
+        return 86;
+}
+
+// Calls 'f(T{})' with the element type of a typed array (RFC 8746), like
+// 'visit_num_type'. The tag is 0b010fsell (float, signed, little-endian,
+// log2 of the size). Binary values without tag are arrays of uint8.
+template <class F>
+void visit_typed_array(nlohmann::json::binary_t const &b, bool &big_endian,
+                       F &&f)
+{
+    big_endian = false;
+    if (!b.has_subtype())
+        return f(uint8_t{});
+    auto tag = b.subtype();
+    if (tag < 64 || tag > 87)
+        throw ReadError(fmt::format("unsupported binary value (tag {})", tag));
+    big_endian = !(tag & 4);
+    if (tag & 16)
     {
-        internal::write_json(j, *elements++, s);
-        return;
+        if ((tag & 3) == 1)
+            return f(float32_t{});
+        if ((tag & 3) == 2)
+            return f(float64_t{});
+        throw ReadError("unsupported typed array (only 32 and 64 bit floats)");
     }
-
-    j = nlohmann::json::array();
-
-    for (size_t i = 0; i < shape[dim]; ++i)
+    bool is_signed = tag & 8;
+    switch (tag & 3)
     {
-        j.push_back(nullptr);
-        write_elements(j[i], elements, s, dim + 1, shape);
+    case 0:
+        big_endian = false; // 'e' means 'clamped' for uint8
+        return is_signed ? f(int8_t{}) : f(uint8_t{});
+    case 1:
+        return is_signed ? f(int16_t{}) : f(uint16_t{});
+    case 2:
+        return is_signed ? f(int32_t{}) : f(uint32_t{});
+    default:
+        return is_signed ? f(int64_t{}) : f(uint64_t{});
     }
 }
 
-void write_impl(nlohmann::json &j, Tome const &tome, AnySchema const &)
+// Streaming reader. Validates (and optionally builds the Tome) directly from
+// the SAX events of the parser, without creating a nlohmann::json document.
+// Semantics are the same as 'read_impl(Tome*, nlohmann::json const&, ...)'.
+// Used for JSON text as well as CBOR/MessagePack, where the innermost rows of
+// numeric arrays can also be typed arrays (see 'read_binary_stream').
+class SaxReader
 {
-    if (tome.is_boolean())
-        j = tome.as<bool>();
-    else if (tome.is_integer())
-        j = tome.get<int64_t>();
-    else if (tome.is_real())
-        j = tome.get<double>();
-    else if (tome.is_complex())
+    using json = nlohmann::json;
+
+    struct Frame
+    {
+        enum class Kind
+        {
+            Dict,
+            Array,
+            Complex,
+            Packed,
+            Skip
+        };
+        Kind kind;
+        Tome *tome; // nullptr when only validating
+
+        Frame(Kind k, Tome *t) : kind(k), tome(t) {}
+
+        // Dict: plan node of the dict, items seen so far (bitmask), plan node
+        // and destination of the current item
+        NodeId dict = 0;
+        std::vector<uint64_t> seen;
+        NodeId item_node = 0;
+        Tome *item = nullptr;
+
+        // Array: 'counts[d]' is the number of entries seen so far in the
+        // currently open array at nesting level 'd'. Arrays of numbers are
+        // stored in 'numbers' instead of 'elements'.
+        ArraySchema const *array = nullptr;
+        NodeId elements_node = 0;
+        NumberSchema const *element_number = nullptr;
+        std::vector<int64_t> shape;
+        std::vector<int64_t> counts;
+        std::vector<Tome> elements;
+        NumberVector numbers;
+
+        // Complex: real and imaginary part
+        NumberSchema const *number = nullptr;
+        double parts[2] = {};
+        int n_parts = 0;
+
+        // Packed: base64 form of an array of numbers (uses 'array' and
+        // 'element_number' as well). Current key, bitmask of keys seen so far
+        // and their values.
+        std::string packed_key;
+        int packed_seen = 0;
+        bool in_shape = false;
+        std::string dtype;
+        std::vector<size_t> packed_shape;
+        std::string data;
+
+        // Skip: nesting depth of the skipped value
+        int depth = 0;
+    };
+
+    ValidationPlan plan_;
+    Tome *tome_;
+    std::pmr::memory_resource *memory_; // nullptr for the global heap
+    std::vector<Frame> stack_;
+
+    bool skipping() const
     {
-        auto value = tome.get<std::complex<double>>();
-        j = {value.real(), value.imag()};
+        return !stack_.empty() && stack_.back().kind == Frame::Kind::Skip;
     }
-    else if (tome.is_string())
-        j = tome.as_string();
-    else if (tome.is_dict())
+
+    [[noreturn]] static void type_mismatch(Schema const &schema)
     {
-        auto dict = tome.as_dict();
-        j = nlohmann::json::object();
-        for (auto const &item : dict)
-            write_impl(j[item.first], item.second, AnySchema{});
+        schema.visit(overloaded{
+            [](NoneSchema const &) {
+                throw ValidationError("NoneSchema is never valid");
+            },
+            [](AnySchema const &) {
+                throw ReadError("AnySchema cannot be read into a Tome");
+            },
+            [](BooleanSchema const &) {
+                throw ValidationError("expected boolean");
+            },
+            [](NumberSchema const &) {
+                throw ValidationError("expected number");
+            },
+            [](StringSchema const &) {
+                throw ValidationError("expected string");
+            },
+            [](ArraySchema const &) {
+                throw ValidationError("expected array");
+            },
+            [](DictSchema const &) {
+                throw ValidationError("expected object");
+            }});
+        assert(false);
+        std::abort();
     }
-    else if (tome.is_array())
+
+    struct Slot
     {
-        auto array = tome.as_array();
-        j = nlohmann::json::array();
-        Tome const *it = &*array.linear_begin();
-        write_elements(j, it, Schema::any(), 0, tome.shape());
+        NodeId node;
+        Schema const *schema;
+        Tome *tome;
+    };
+
+    Slot make_slot(NodeId node, Tome *tome) const
+    {
+        return {node, &plan_.schema(node), tome};
+    }
+
+    // schema and destination of the next value
+    Slot next_value()
+    {
+        if (stack_.empty())
+            return make_slot(plan_.root(), tome_);
+
+        auto &f = stack_.back();
+        switch (f.kind)
+        {
+        case Frame::Kind::Dict:
+            return make_slot(f.item_node, f.item);
+        case Frame::Kind::Array:
+            if (f.counts.size() < f.shape.size())
+                throw ValidationError("expected array");
+            if (!f.counts.empty())
+                count_entry(f);
+            // elements of number arrays are not stored as Tome
+            if (f.tome && !f.element_number)
+            {
+                f.elements.emplace_back();
+                return make_slot(f.elements_node, &f.elements.back());
+            }
+            return make_slot(f.elements_node, nullptr);
+        case Frame::Kind::Complex:
+            throw ValidationError("expected number");
+        case Frame::Kind::Packed:
+            invalid_packed();
+        case Frame::Kind::Skip:
+            break;
+        }
+        assert(false);
+        std::abort();
+    }
+
+    // one more entry in the innermost open array of 'f'
+    static void count_entry(Frame &f)
+    {
+        auto dim = f.counts.size() - 1;
+        auto &count = f.counts.back();
+        ++count;
+        if (f.shape[dim] != -1 && count > f.shape[dim])
+            throw ValidationError(fmt::format(
+                "expected array of size {}, got more (dim={}, shape=({}))",
+                f.shape[dim], dim, fmt::join(f.shape, ",")));
+    }
+
+    void push_array(Tome *tome, ArraySchema const &s, NodeId node)
+    {
+        if (!s.shape)
+            throw ReadError(
+                "ArraySchema without shape cannot be read/validated from JSON");
+        auto f = Frame(Frame::Kind::Array, tome);
+        f.array = &s;
+        f.elements_node = plan_.node(node).elements;
+        f.shape = *s.shape;
+        f.element_number =
+            std::get_if<NumberSchema>(&s.elements.impl().schema_);
+        if (f.element_number)
+            visit_num_type(f.element_number->type, [&]<class T>(T) {
+                f.numbers = std::vector<T>();
+            });
+        stack_.push_back(std::move(f));
+    }
+
+    // innermost frame, if it is an array of numbers expecting an element
+    Frame *number_array()
+    {
+        if (stack_.empty())
+            return nullptr;
+        auto &f = stack_.back();
+        if (f.kind != Frame::Kind::Array || !f.element_number ||
+            f.counts.size() != f.shape.size())
+            return nullptr;
+        return &f;
+    }
+
+    // add a (validated) number to an array of numbers
+    static void push_number(Frame &f, auto... value)
+    {
+        if (f.tome)
+            std::visit(
+                [&]<class T>(std::vector<T> &values) {
+                    values.push_back(number_cast<T>(value...));
+                },
+                f.numbers);
+    }
+
+    // innermost frame, if it is an array of numbers expecting a row of
+    // elements (i.e. an array of the last dimension)
+    Frame *number_row()
+    {
+        if (stack_.empty())
+            return nullptr;
+        auto &f = stack_.back();
+        if (f.kind != Frame::Kind::Array || !f.element_number ||
+            f.counts.size() + 1 != f.shape.size())
+            return nullptr;
+        return &f;
+    }
+
+    // add (and validate) the numbers of a typed array to an array of
+    // numbers. Returns the number of elements.
+    static size_t push_typed_array(Frame &f, json::binary_t const &bytes)
+    {
+        auto const &s = *f.element_number;
+        bool big_endian;
+        size_t count = 0;
+        visit_typed_array(bytes, big_endian, [&]<class T>(T) {
+            if (bytes.size() % sizeof(T) != 0)
+                throw ReadError("invalid size of typed array");
+            count = bytes.size() / sizeof(T);
+            bool swap = big_endian != (std::endian::native == std::endian::big);
+            auto load = [&](size_t i) {
+                T value;
+                std::memcpy(&value, bytes.data() + i * sizeof(T), sizeof(T));
+                return swap ? internal::byteswap(value) : value;
+            };
+
+            if (s.is_complex())
+            {
+                // interleaved real and imaginary parts
+                if constexpr (RealType<T>)
+                {
+                    if (count % 2 != 0)
+                        throw ValidationError("expected complex numbers");
+                    count /= 2;
+                    for (size_t i = 0; i < count; ++i)
+                        push_number(f, static_cast<double>(load(2 * i)),
+                                    static_cast<double>(load(2 * i + 1)));
+                    return;
+                }
+                else
+                    throw ValidationError("expected complex numbers");
+            }
+
+            // exact type: always valid, copied as a block
+            if (num_type_of<T>() == s.type)
+            {
+                if (!f.tome || count == 0)
+                    return;
+                auto &values = std::get<std::vector<T>>(f.numbers);
+                auto old_size = values.size();
+                values.resize(old_size + count);
+                if (swap)
+                    for (size_t i = 0; i < count; ++i)
+                        values[old_size + i] = load(i);
+                else
+                    std::memcpy(values.data() + old_size, bytes.data(),
+                                bytes.size());
+                return;
+            }
+
+            // no narrowing before validation (e.g. uint64 above INT64_MAX)
+            for (size_t i = 0; i < count; ++i)
+            {
+                auto value = load(i);
+                s.validate_number(value);
+                push_number(f, value);
+            }
+        });
+        return count;
     }
-    else
-        throw WriteError("unsupported type when writing AnySchema to JSON");
-}
 
-void write_impl(nlohmann::json &j, Tome const &tome, BooleanSchema const &)
+    // innermost frame, if it is the base64 form of an array
+    Frame *packed()
+    {
+        if (stack_.empty() || stack_.back().kind != Frame::Kind::Packed)
+            return nullptr;
+        return &stack_.back();
+    }
+
+    [[noreturn]] static void invalid_packed()
+    {
+        throw ValidationError("invalid base64 array (expected 'dtype' string, "
+                              "'shape' array and 'data' string)");
+    }
+
+    void finish_packed()
+    {
+        auto f = std::move(stack_.back());
+        stack_.pop_back();
+        if (f.packed_seen != 7)
+            invalid_packed();
+        visit_num_type(f.element_number->type, [&]<class T>(T) {
+            Array<T> values;
+            internal::read_base64_array(values, f.dtype, f.packed_shape,
+                                        f.data);
+            f.array->validate_shape(values.shape());
+            if (f.tome)
+                *f.tome = Tome::array(std::move(values), memory_);
+        });
+        value_done();
+    }
+
+    void push_skip()
+    {
+        stack_.emplace_back(Frame::Kind::Skip, nullptr);
+        stack_.back().depth = 1;
+    }
+
+    void finish_array()
+    {
+        auto f = std::move(stack_.back());
+        stack_.pop_back();
+        if (f.tome)
+        {
+            // dimensions inside of empty arrays are never seen
+            auto shape = std::vector<size_t>(f.shape.size());
+            for (size_t i = 0; i < shape.size(); ++i)
+                shape[i] = f.shape[i] == -1 ? 0 : f.shape[i];
+            if (f.element_number)
+                std::visit(
+                    [&](auto &values) {
+                        *f.tome =
+                            Tome::array(std::move(values), shape, memory_);
+                    },
+                    f.numbers);
+            else
+                *f.tome = Tome::array(std::move(f.elements), shape, memory_);
+        }
+        value_done();
+    }
+
+    // called after any value is complete
+    void value_done()
+    {
+        // arrays of rank zero consist of exactly one element
+        if (!stack_.empty() && stack_.back().kind == Frame::Kind::Array &&
+            stack_.back().shape.empty())
+            finish_array();
+    }
+
+    // common handling of non-compound values. 'read(tome, s)' is called if
+    // it accepts the schema 's', otherwise the value is invalid
+    template <class F> bool scalar(F &&read)
+    {
+        if (skipping())
+            return true;
+        auto slot = next_value();
+
+        // only arrays of rank zero can start with a non-array value
+        if (auto s = std::get_if<ArraySchema>(&slot.schema->impl().schema_))
+        {
+            push_array(slot.tome, *s, slot.node);
+            if (!s->shape->empty())
+                throw ValidationError("expected array");
+            return scalar(read);
+        }
+
+        slot.schema->visit([&](auto const &s) {
+            using S = std::decay_t<decltype(s)>;
+            if constexpr (std::same_as<S, AnySchema>)
+            {
+                if (slot.tome)
+                    type_mismatch(*slot.schema);
+            }
+            else if constexpr (std::invocable<F &, Tome *, S const &>)
+                read(slot.tome, s);
+            else
+                type_mismatch(*slot.schema);
+        });
+        value_done();
+        return true;
+    }
+
+    bool number(auto value)
+    {
+        if (auto f = packed(); f)
+        {
+            if constexpr (std::integral<decltype(value)>)
+                if (f->in_shape && std::cmp_greater_equal(value, 0))
+                {
+                    f->packed_shape.push_back(static_cast<size_t>(value));
+                    return true;
+                }
+            invalid_packed();
+        }
+
+        if (!stack_.empty() && stack_.back().kind == Frame::Kind::Complex)
+        {
+            auto &f = stack_.back();
+            if (f.n_parts == 2)
+                throw ValidationError("expected number");
+            f.parts[f.n_parts++] = static_cast<double>(value);
+            return true;
+        }
+
+        // element of an array of numbers -> no Tome needed
+        if (auto f = number_array(); f)
+        {
+            if (!f->counts.empty())
+                count_entry(*f);
+            f->element_number->validate(value);
+            push_number(*f, value);
+            value_done();
+            return true;
+        }
+
+        return scalar([&](Tome *tome, NumberSchema const &s) {
+            s.validate(value);
+            if (tome)
+                *tome = Tome::number_unchecked(value, s.type);
+        });
+    }
+
+  public:
+    SaxReader(Tome *tome, Schema const &schema,
+              std::pmr::memory_resource *memory)
+        : plan_(schema), tome_(tome), memory_(memory)
+    {}
+
+    bool null()
+    {
+        if (packed())
+            invalid_packed();
+        // null is not valid for any schema (except AnySchema)
+        return scalar([](Tome *, std::nullptr_t) {});
+    }
+
+    bool boolean(bool value)
+    {
+        if (packed())
+            invalid_packed();
+        return scalar([&](Tome *tome, BooleanSchema const &) {
+            if (tome)
+                *tome = Tome::boolean(value);
+        });
+    }
+
+    bool number_integer(json::number_integer_t value)
+    {
+        return number(static_cast<int64_t>(value));
+    }
+    bool number_unsigned(json::number_unsigned_t value)
+    {
+        // same as 'j.get<uint64_t>()' in the DOM-based reader
+        return number(static_cast<uint64_t>(value));
+    }
+    bool number_float(json::number_float_t value, json::string_t const &)
+    {
+        return number(static_cast<double>(value));
+    }
+
+    bool string(json::string_t &value)
+    {
+        if (auto f = packed(); f)
+        {
+            if (f->in_shape)
+                invalid_packed();
+            if (f->packed_key == "dtype")
+                f->dtype = std::move(value);
+            else if (f->packed_key == "data")
+                f->data = std::move(value);
+            else
+                invalid_packed();
+            return true;
+        }
+        return scalar([&](Tome *tome, StringSchema const &s) {
+            s.validate(value);
+            if (tome)
+                *tome = std::move(value);
+        });
+    }
+
+    // typed array (CBOR/MessagePack only). Replaces the innermost array of
+    // an array of numbers
+    bool binary(json::binary_t &bytes)
+    {
+        if (skipping())
+            return true;
+        if (packed())
+            invalid_packed();
+
+        auto f = number_row();
+        if (f)
+        {
+            if (!f->counts.empty())
+                count_entry(*f);
+        }
+        else
+        {
+            auto slot = next_value();
+            auto const &impl = slot.schema->impl().schema_;
+            auto s = std::get_if<ArraySchema>(&impl);
+            if (!s)
+            {
+                if (!slot.tome && std::holds_alternative<AnySchema>(impl))
+                {
+                    value_done();
+                    return true;
+                }
+                type_mismatch(*slot.schema);
+            }
+            push_array(slot.tome, *s, slot.node);
+            f = number_row();
+            if (!f)
+                throw ValidationError("expected array");
+        }
+
+        auto dim = f->shape.size() - 1;
+        auto count = static_cast<int64_t>(push_typed_array(*f, bytes));
+        if (f->shape[dim] == -1)
+            f->shape[dim] = count;
+        if (count != f->shape[dim])
+            throw ValidationError(fmt::format(
+                "expected array of size {}, got {} (dim={}, shape=({}))",
+                f->shape[dim], count, dim, fmt::join(f->shape, ",")));
+        if (f->counts.empty())
+            finish_array();
+        return true;
+    }
+
+    bool start_object(size_t)
+    {
+        if (skipping())
+        {
+            ++stack_.back().depth;
+            return true;
+        }
+        if (packed())
+            invalid_packed();
+        auto slot = next_value();
+        slot.schema->visit(overloaded{
+            [&](DictSchema const &) {
+                if (slot.tome)
+                    *slot.tome = Tome::dict(memory_);
+                auto f = Frame(Frame::Kind::Dict, slot.tome);
+                f.dict = slot.node;
+                f.seen.resize(plan_.node(slot.node).required.size(), 0);
+                stack_.push_back(std::move(f));
+            },
+            [&](AnySchema const &) {
+                if (slot.tome)
+                    type_mismatch(*slot.schema);
+                push_skip();
+            },
+            [&](ArraySchema const &s) {
+                // base64 form of an array of numbers
+                if (auto number =
+                        std::get_if<NumberSchema>(&s.elements.impl().schema_))
+                {
+                    auto f = Frame(Frame::Kind::Packed, slot.tome);
+                    f.array = &s;
+                    f.element_number = number;
+                    stack_.push_back(std::move(f));
+                    return;
+                }
+                push_array(slot.tome, s, slot.node);
+                if (!s.shape->empty())
+                    throw ValidationError("expected array");
+                start_object(0);
+            },
+            [&](auto const &) { type_mismatch(*slot.schema); }});
+        return true;
+    }
+
+    bool key(json::string_t &key)
+    {
+        if (skipping())
+            return true;
+        if (auto p = packed(); p)
+        {
+            int bit = key == "dtype"   ? 1
+                      : key == "shape" ? 2
+                      : key == "data"  ? 4
+                                       : 0;
+            if (!bit || (p->packed_seen & bit))
+                invalid_packed();
+            p->packed_seen |= bit;
+            p->packed_key = std::move(key);
+            return true;
+        }
+        auto &f = stack_.back();
+        assert(f.kind == Frame::Kind::Dict);
+        int i = plan_.find_key(f.dict, key);
+        if (i == -1)
+            throw ValidationError("unexpected key: " + key);
+        auto bit = uint64_t(1) << (i % 64);
+        bool duplicate = f.seen[i / 64] & bit;
+        f.seen[i / 64] |= bit;
+        auto const &n = plan_.node(f.dict);
+        f.item_node = n.items[i];
+        f.item = nullptr;
+        if (!f.tome)
+            return true;
+
+        // the dict is sorted once in 'end_object', as keys come in any order
+        auto &dict = f.tome->as_dict();
+        if (!duplicate)
+            f.item = &dict.append_unsorted(n.item_keys[i]);
+        else // the last value wins
+            for (auto &[k, v] : dict)
+                if (k == n.item_keys[i])
+                    f.item = &v;
+        return true;
+    }
+
+    bool end_object()
+    {
+        auto &f = stack_.back();
+        if (f.kind == Frame::Kind::Packed)
+        {
+            finish_packed();
+            return true;
+        }
+        if (f.kind == Frame::Kind::Skip)
+        {
+            if (--f.depth == 0)
+            {
+                stack_.pop_back();
+                value_done();
+            }
+            return true;
+        }
+
+        assert(f.kind == Frame::Kind::Dict);
+        plan_.check_required(f.dict, f.seen);
+        if (f.tome)
+            f.tome->as_dict().sort();
+        stack_.pop_back();
+        value_done();
+        return true;
+    }
+
+    bool start_array(size_t)
+    {
+        if (skipping())
+        {
+            ++stack_.back().depth;
+            return true;
+        }
+        if (auto f = packed(); f)
+        {
+            if (f->packed_key != "shape" || f->in_shape)
+                invalid_packed();
+            f->in_shape = true;
+            return true;
+        }
+
+        // next nesting level of a multi-dimensional array
+        if (!stack_.empty() && stack_.back().kind == Frame::Kind::Array &&
+            stack_.back().counts.size() < stack_.back().shape.size())
+        {
+            auto &f = stack_.back();
+            if (!f.counts.empty())
+                count_entry(f);
+            f.counts.push_back(0);
+            return true;
+        }
+
+        auto slot = next_value();
+        slot.schema->visit(overloaded{
+            [&](ArraySchema const &s) {
+                push_array(slot.tome, s, slot.node);
+                start_array(0);
+            },
+            [&](NumberSchema const &s) {
+                stack_.emplace_back(Frame::Kind::Complex, slot.tome);
+                stack_.back().number = &s;
+            },
+            [&](AnySchema const &) {
+                if (slot.tome)
+                    type_mismatch(*slot.schema);
+                push_skip();
+            },
+            [&](auto const &) { type_mismatch(*slot.schema); }});
+        return true;
+    }
+
+    bool end_array()
+    {
+        auto &f = stack_.back();
+        switch (f.kind)
+        {
+        case Frame::Kind::Skip:
+            if (--f.depth == 0)
+            {
+                stack_.pop_back();
+                value_done();
+            }
+            return true;
+        case Frame::Kind::Complex: {
+            if (f.n_parts != 2)
+                throw ValidationError("expected number");
+            f.number->validate(f.parts[0], f.parts[1]);
+            auto real = f.parts[0], imag = f.parts[1];
+            if (f.tome)
+                *f.tome = std::complex<double>(real, imag);
+            stack_.pop_back();
+            if (auto parent = number_array(); parent)
+                push_number(*parent, real, imag);
+            value_done();
+            return true;
+        }
+        case Frame::Kind::Array: {
+            auto dim = f.counts.size() - 1;
+            if (f.shape[dim] == -1)
+                f.shape[dim] = f.counts.back();
+            if (f.counts.back() != f.shape[dim])
+                throw ValidationError(fmt::format(
+                    "expected array of size {}, got {} (dim={}, shape=({}))",
+                    f.shape[dim], f.counts.back(), dim,
+                    fmt::join(f.shape, ",")));
+            f.counts.pop_back();
+            if (f.counts.empty())
+                finish_array();
+            return true;
+        }
+        case Frame::Kind::Packed:
+            f.in_shape = false;
+            return true;
+        case Frame::Kind::Dict:
+            break;
+        }
+        assert(false);
+        std::abort();
+    }
+
+    bool parse_error(size_t, std::string const &, json::exception const &e)
+    {
+        throw ReadError(e.what());
+    }
+};
+
+// Streaming CBOR input (RFC 8949), generating the same events for a
+// 'SaxReader' as 'json::sax_parse' does for MessagePack. The latter rejects
+// all CBOR tags, so tags are handled here: the tag of a byte string is kept as
+// its subtype, which 'SaxReader::binary' accepts for typed arrays (RFC 8746).
+// Tags of other values are ignored.
+class CborReader
 {
-    if (!tome.is_boolean())
-        throw ValidationError("expected boolean");
-    j = tome.as<bool>();
-}
+    using json = nlohmann::json;
+
+    std::streambuf &in_;
+    SaxReader &sax_;
+
+    uint8_t byte()
+    {
+        auto c = in_.sbumpc();
+        if (c == std::char_traits<char>::eof())
+            throw ReadError("unexpected end of CBOR input");
+        return static_cast<uint8_t>(c);
+    }
 
-void write_impl(nlohmann::json &j, Tome const &tome, NumberSchema const &s)
+    uint64_t big_endian(int n)
+    {
+        uint64_t value = 0;
+        for (int i = 0; i < n; ++i)
+            value = (value << 8) | byte();
+        return value;
+    }
+
+    // value or size encoded by the lower 5 bits of a head
+    uint64_t argument(unsigned info)
+    {
+        if (info < 24)
+            return info;
+        if (info < 28)
+            return big_endian(1 << (info - 24));
+        throw ReadError("invalid CBOR data item");
+    }
+
+    // appends 'size' bytes of input. Grows with the data actually read, not
+    // with the (possibly bogus) announced size.
+    void read_bytes(auto &out, uint64_t size)
+    {
+        constexpr uint64_t chunk = uint64_t(1) << 16;
+        while (size > 0)
+        {
+            auto n = std::min(size, chunk);
+            auto old_size = out.size();
+            out.resize(old_size + n);
+            auto p = reinterpret_cast<char *>(out.data() + old_size);
+            if (in_.sgetn(p, std::streamsize(n)) != std::streamsize(n))
+                throw ReadError("unexpected end of CBOR input");
+            size -= n;
+        }
+    }
+
+    // byte or text string, possibly of indefinite length (i.e. in chunks)
+    void read_string(auto &out, unsigned major, unsigned info)
+    {
+        if (info != 31)
+            return read_bytes(out, argument(info));
+        while (true)
+        {
+            auto head = byte();
+            if (head == 0xff)
+                return;
+            if (head >> 5 != major || (head & 31) == 31)
+                throw ReadError("invalid chunk of CBOR string");
+            read_bytes(out, argument(head & 31));
+        }
+    }
+
+    // entries of an array or map, up to the 'break' for indefinite length
+    void read_entries(unsigned info, auto &&entry)
+    {
+        if (info != 31)
+        {
+            for (uint64_t i = 0, n = argument(info); i < n; ++i)
+                entry();
+            return;
+        }
+        while (in_.sgetc() != 0xff)
+            entry();
+        in_.sbumpc();
+    }
+
+    static double half_float(uint16_t bits)
+    {
+        int exponent = (bits >> 10) & 31;
+        int mantissa = bits & 1023;
+        double value = exponent == 0    ? std::ldexp(mantissa, -24)
+                       : exponent != 31 ? std::ldexp(mantissa + 1024,
+                                                     exponent - 25)
+                       : mantissa == 0
+                           ? std::numeric_limits<double>::infinity()
+                           : std::numeric_limits<double>::quiet_NaN();
+        return bits & 0x8000 ? -value : value;
+    }
+
+    void read_key()
+    {
+        auto head = byte();
+        if (head >> 5 != 3)
+            throw ReadError("CBOR map keys have to be strings");
+        json::string_t key;
+        read_string(key, 3, head & 31);
+        sax_.key(key);
+    }
+
+    void read_item(std::optional<uint64_t> tag = std::nullopt)
+    {
+        auto head = byte();
+        unsigned major = head >> 5;
+        unsigned info = head & 31;
+        auto size = info == 31 ? size_t(-1) : size_t(0);
+        switch (major)
+        {
+        case 0:
+            sax_.number_unsigned(argument(info));
+            break;
+        case 1:
+            if (auto n = argument(info); n <= uint64_t(INT64_MAX))
+                sax_.number_integer(-1 - static_cast<int64_t>(n));
+            else
+                throw ReadError("CBOR integer out of range");
+            break;
+        case 2: {
+            json::binary_t bytes;
+            read_string(bytes, major, info);
+            if (tag)
+                bytes.set_subtype(*tag);
+            sax_.binary(bytes);
+            break;
+        }
+        case 3: {
+            json::string_t value;
+            read_string(value, major, info);
+            sax_.string(value);
+            break;
+        }
+        case 4:
+            sax_.start_array(size);
+            read_entries(info, [&] { read_item(); });
+            sax_.end_array();
+            break;
+        case 5:
+            sax_.start_object(size);
+            read_entries(info, [&] {
+                read_key();
+                read_item();
+            });
+            sax_.end_object();
+            break;
+        case 6:
+            read_item(argument(info));
+            break;
+        default:
+            switch (info)
+            {
+            case 20:
+            case 21:
+                sax_.boolean(info == 21);
+                break;
+            case 22:
+                sax_.null();
+                break;
+            case 25:
+                sax_.number_float(
+                    half_float(static_cast<uint16_t>(big_endian(2))), {});
+                break;
+            case 26:
+                sax_.number_float(std::bit_cast<float>(static_cast<uint32_t>(
+                                      big_endian(4))),
+                                  {});
+                break;
+            case 27:
+                sax_.number_float(std::bit_cast<double>(big_endian(8)), {});
+                break;
+            default:
+                throw ReadError("unsupported CBOR simple value");
+            }
+        }
+    }
+
+  public:
+    CborReader(std::istream &input, SaxReader &sax)
+        : in_(*input.rdbuf()), sax_(sax)
+    {}
+
+    void read()
+    {
+        read_item();
+        if (in_.sgetc() != std::char_traits<char>::eof())
+            throw ReadError("unexpected data after CBOR value");
+    }
+};
+
+// Streaming CBOR/MessagePack output, same interface as 'JsonStream'. Rows of
+// numeric arrays are written as typed arrays (see 'write_binary_stream').
+// Integers use the shortest encoding, floating point numbers keep their
+// precision.
+class BinaryStream
 {
-    if (tome.is_integer())
+    static constexpr size_t block_size = size_t(1) << 16;
+
+    internal::JsonSink const &sink_;
+    bool cbor_; // otherwise MessagePack
+    fmt::memory_buffer buf_;
+
+    void byte(unsigned b) { buf_.push_back(static_cast<char>(b)); }
+
+    // lowest 'n' bytes of 'value' in big-endian order
+    void big_endian(uint64_t value, int n)
+    {
+        for (int i = n - 1; i >= 0; --i)
+            byte(static_cast<uint8_t>(value >> (8 * i)));
+    }
+
+    // CBOR: major type with an argument (value or size) in the shortest form
+    void cbor_head(unsigned major, uint64_t arg)
+    {
+        major <<= 5;
+        if (arg < 24)
+            byte(major | static_cast<unsigned>(arg));
+        else if (arg <= 0xff)
+        {
+            byte(major | 24);
+            big_endian(arg, 1);
+        }
+        else if (arg <= 0xffff)
+        {
+            byte(major | 25);
+            big_endian(arg, 2);
+        }
+        else if (arg <= 0xffffffff)
+        {
+            byte(major | 26);
+            big_endian(arg, 4);
+        }
+        else
+        {
+            byte(major | 27);
+            big_endian(arg, 8);
+        }
+    }
+
+    // MessagePack: size of a string/array/map/ext. 'fix' is the prefix for
+    // sizes up to 'fix_max', 'm8', 'm16' and 'm32' the prefixes for 8/16/32 bit
+    // sizes (zero if not available)
+    void msgpack_head(size_t size, unsigned fix, size_t fix_max, unsigned m8,
+                      unsigned m16, unsigned m32)
     {
-        auto val = tome.get<int64_t>();
-        s.validate(val);
-        j = val;
+        if (fix && size <= fix_max)
+            byte(fix | static_cast<unsigned>(size));
+        else if (m8 && size <= 0xff)
+        {
+            byte(m8);
+            big_endian(size, 1);
+        }
+        else if (size <= 0xffff)
+        {
+            byte(m16);
+            big_endian(size, 2);
+        }
+        else if (size <= 0xffffffff)
+        {
+            byte(m32);
+            big_endian(size, 4);
+        }
+        else
+            throw WriteError("value too large for MessagePack");
     }
-    else if (tome.is_real())
+
+    void append(char const *data, size_t size)
     {
-        auto val = tome.get<double>();
-        s.validate(val);
-        j = val;
+        // large blocks go to the sink directly, without a copy
+        if (size >= block_size)
+        {
+            flush();
+            sink_(std::string_view(data, size));
+        }
+        else
+        {
+            buf_.append(data, data + size);
+            maybe_flush();
+        }
     }
-    else if (tome.is_complex())
+
+    void maybe_flush()
     {
-        auto val = tome.get<std::complex<double>>();
-        s.validate(val.real(), val.imag());
-        j = {val.real(), val.imag()};
+        if (buf_.size() >= block_size)
+            flush();
     }
-    else
-        throw ValidationError("expected number");
+
+  public:
+    BinaryStream(internal::JsonSink const &sink, internal::BinaryFormat format)
+        : sink_(sink), cbor_(format == internal::BinaryFormat::CBOR)
+    {}
+
+    void flush()
+    {
+        if (buf_.size())
+            sink_(std::string_view(buf_.data(), buf_.size()));
+        buf_.clear();
+    }
+
+    void begin_object(size_t size)
+    {
+        if (cbor_)
+            cbor_head(5, size);
+        else
+            msgpack_head(size, 0x80, 15, 0, 0xde, 0xdf);
+    }
+    void begin_array(size_t size)
+    {
+        if (cbor_)
+            cbor_head(4, size);
+        else
+            msgpack_head(size, 0x90, 15, 0, 0xdc, 0xdd);
+    }
+    void end_object() { maybe_flush(); }
+    void end_array() { maybe_flush(); }
+
+    void key(std::string_view k) { value(k); }
+
+    void value(bool v)
+    {
+        if (cbor_)
+            byte(v ? 0xf5 : 0xf4);
+        else
+            byte(v ? 0xc3 : 0xc2);
+    }
+    void value(std::string_view v)
+    {
+        if (cbor_)
+            cbor_head(3, v.size());
+        else
+            msgpack_head(v.size(), 0xa0, 31, 0xd9, 0xda, 0xdb);
+        append(v.data(), v.size());
+    }
+    template <IntegerType T> void value(T v)
+    {
+        if constexpr (std::is_signed_v<T>)
+            if (auto i = static_cast<int64_t>(v); i < 0)
+            {
+                auto bits = static_cast<uint64_t>(i);
+                if (cbor_)
+                    cbor_head(1, static_cast<uint64_t>(-1 - i));
+                else if (i >= -32)
+                    byte(static_cast<uint8_t>(bits)); // negative fixint
+                else if (i >= INT8_MIN)
+                {
+                    byte(0xd0);
+                    big_endian(bits, 1);
+                }
+                else if (i >= INT16_MIN)
+                {
+                    byte(0xd1);
+                    big_endian(bits, 2);
+                }
+                else if (i >= INT32_MIN)
+                {
+                    byte(0xd2);
+                    big_endian(bits, 4);
+                }
+                else
+                {
+                    byte(0xd3);
+                    big_endian(bits, 8);
+                }
+                return;
+            }
+
+        auto u = static_cast<uint64_t>(v);
+        if (cbor_)
+            cbor_head(0, u);
+        else if (u <= 0x7f)
+            byte(static_cast<unsigned>(u)); // positive fixint
+        else if (u <= 0xff)
+        {
+            byte(0xcc);
+            big_endian(u, 1);
+        }
+        else if (u <= 0xffff)
+        {
+            byte(0xcd);
+            big_endian(u, 2);
+        }
+        else if (u <= 0xffffffff)
+        {
+            byte(0xce);
+            big_endian(u, 4);
+        }
+        else
+        {
+            byte(0xcf);
+            big_endian(u, 8);
+        }
+    }
+    void value(RealType auto v)
+    {
+        if constexpr (std::same_as<decltype(v), float32_t>)
+        {
+            byte(cbor_ ? 0xfa : 0xca);
+            big_endian(std::bit_cast<uint32_t>(v), 4);
+        }
+        else
+        {
+            byte(cbor_ ? 0xfb : 0xcb);
+            big_endian(std::bit_cast<uint64_t>(v), 8);
+        }
+    }
+    void value(ComplexType auto v)
+    {
+        begin_array(2);
+        value(v.real());
+        value(v.imag());
+        end_array();
+    }
+
+    // innermost row of an array of numbers, as a single typed array
+    template <NumberType T> void row(T const *data, size_t n)
+    {
+        constexpr auto tag = typed_array_tag<T>();
+        size_t size = n * sizeof(T);
+        if (cbor_)
+        {
+            cbor_head(6, tag);
+            cbor_head(2, size);
+        }
+        else if (size == 1 || size == 2 || size == 4 || size == 8 ||
+                 size == 16)
+        {
+            byte(0xd4 + std::countr_zero(size)); // fixext
+            byte(tag);
+        }
+        else
+        {
+            msgpack_head(size, 0, 0, 0xc7, 0xc8, 0xc9); // ext
+            byte(tag);
+        }
+
+        if constexpr (std::endian::native == std::endian::little)
+            append(reinterpret_cast<char const *>(data), size);
+        else
+        {
+            // typed arrays are always written in little-endian order
+            auto put = [&](auto x) {
+                auto swapped = internal::byteswap(x);
+                buf_.append(reinterpret_cast<char const *>(&swapped),
+                            reinterpret_cast<char const *>(&swapped + 1));
+            };
+            for (size_t i = 0; i < n; ++i)
+            {
+                if constexpr (ComplexType<T>)
+                {
+                    put(data[i].real());
+                    put(data[i].imag());
+                }
+                else
+                    put(data[i]);
+            }
+            maybe_flush();
+        }
+    }
+};
+
+// 'Out' is 'JsonStream' or 'BinaryStream'
+template <class Out> void write_node(Out &, Tome const &, Schema const &);
+
+template <class Out> void write_impl(Out &, Tome const &, NoneSchema const &)
+{
+    throw ValidationError("NoneSchema is never valid");
 }
 
-void write_impl(nlohmann::json &j, Tome const &tome, StringSchema const &)
+// elements are either 'Tome's or the numbers of a compact array
+template <class Out, class T>
+void write_elements(Out &out, T const *&elements, Schema const &s, size_t dim,
+                    std::vector<size_t> const &shape)
 {
-    j = tome.as_string();
+    if (dim == shape.size())
+    {
+        if constexpr (NumberType<T>)
+            out.value(*elements);
+        else
+            write_node(out, *elements, s);
+        ++elements;
+        return;
+    }
+
+    if constexpr (NumberType<T>)
+        if (dim + 1 == shape.size())
+        {
+            out.row(elements, shape[dim]);
+            elements += shape[dim];
+            return;
+        }
+
+    out.begin_array(shape[dim]);
+    for (size_t i = 0; i < shape[dim]; ++i)
+        write_elements(out, elements, s, dim + 1, shape);
+    out.end_array();
 }
 
-void write_impl(nlohmann::json &j, Tome const &tome, ArraySchema const &s)
+template <class Out>
+void write_impl(Out &out, Tome const &tome, AnySchema const &)
 {
-    if (!tome.is_array())
-        throw ValidationError("expected array");
-    auto const &a = tome.as_array();
-    auto shape = tome.shape();
+    tome.visit(overloaded{
+        [&](bool_t value) { out.value(value); },
+        [&](NumberType auto value) { out.value(value); },
+        [&](string_t const &value) { out.value(value); },
+        [&](Tome::dict_type const &dict) {
+            out.begin_object(dict.size());
+            for (auto const &[key, value] : dict)
+            {
+                out.key(key);
+                write_impl(out, value, AnySchema{});
+            }
+            out.end_object();
+        },
+        [&](Tome::array_type const &values) {
+            Tome const *it = values.data();
+            write_elements(out, it, Schema::any(), 0, values.shape());
+        },
+        [&]<NumberType T>(Array<T> const &values) {
+            T const *it = values.data();
+            write_elements(out, it, Schema::any(), 0, values.shape());
+        }});
+}
+
+template <class Out>
+void write_impl(Out &out, Tome const &tome, BooleanSchema const &)
+{
+    if (!tome.is_boolean())
+        throw ValidationError("expected boolean");
+    out.value(tome.as<bool>());
+}
+
+template <class Out>
+void write_impl(Out &out, Tome const &tome, NumberSchema const &s)
+{
+    // NOTE: '.get<int64_t>()' and friends would only accept the exact type
+    tome.visit(overloaded{
+        [&](NumberType auto const &val) {
+            s.validate_number(val);
+            out.value(val);
+        },
+        [](auto const &) { throw ValidationError("expected number"); }});
+}
+
+template <class Out>
+void write_impl(Out &out, Tome const &tome, StringSchema const &)
+{
+    out.value(tome.as_string());
+}
 
-    Tome const *it = &*a.linear_begin();
-    write_elements(j, it, s.elements, 0, shape);
+// validate all elements before anything is written
+template <NumberType U, NumberType T>
+Array<U> convert_array(Array<T> const &values, NumberSchema const &s)
+{
+    auto result = Array<U>::from_shape(values.shape());
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        auto value = values.data()[i];
+        s.validate_number(value);
+        if constexpr (ComplexType<T>)
+            result.data()[i] = number_cast<U>(value.real(), value.imag());
+        else
+            result.data()[i] = number_cast<U>(value);
+    }
+    return result;
 }
 
-void write_impl(nlohmann::json &j, Tome const &tome, DictSchema const &s)
+template <class Out>
+void write_impl(Out &out, Tome const &tome, ArraySchema const &s)
+{
+    tome.visit(overloaded{
+        [&]<NumberType T>(Array<T> const &values) {
+            auto number = std::get_if<NumberSchema>(&s.elements.impl().schema_);
+            if (!number)
+                throw ValidationError("unexpected array of numbers");
+            s.validate_shape(values.shape());
+
+            // same as for single numbers: other number types are accepted if
+            // every element is valid, and converted to the schema's type
+            if (num_type_of<T>() != number->type)
+            {
+                visit_num_type(number->type, [&]<class U>(U) {
+                    auto converted = convert_array<U>(values, *number);
+                    write_impl(out, Tome::array(std::move(converted)), s);
+                });
+                return;
+            }
+
+            if constexpr (std::same_as<Out, JsonStream>)
+                if (s.json.base64)
+                {
+                    out.base64_array(values);
+                    return;
+                }
+
+            T const *it = values.data();
+            write_elements(out, it, s.elements, 0, values.shape());
+        },
+        [&](Tome::array_type const &values) {
+            s.validate_shape(values.shape());
+            Tome const *it = values.data();
+            write_elements(out, it, s.elements, 0, values.shape());
+        },
+        [](auto const &) { throw ValidationError("expected array"); }});
+}
+
+template <class Out>
+void write_impl(Out &out, Tome const &tome, DictSchema const &s)
 {
     if (!tome.is_dict())
         throw ValidationError("expected dict");
     auto const &d = tome.as_dict();
 
+    // binary formats need the number of items up front
+    size_t size = 0;
+    for (auto const &item : s.items)
+    {
+        if (d.contains(item.key))
+            ++size;
+        else if (!item.optional)
+            throw ValidationError("missing key: " + item.key);
+    }
+
+    out.begin_object(size);
     for (auto const &item : s.items)
     {
         auto it = d.find(item.key);
         if (it == d.end())
-        {
-            if (!item.optional)
-                throw ValidationError("missing key: " + item.key);
             continue;
-        }
 
-        internal::write_json(j[item.key], it->second, item.schema);
+        out.key(item.key);
+        write_node(out, it->second, item.schema);
     }
+    out.end_object();
+}
+
+template <class Out>
+void write_node(Out &out, Tome const &tome, Schema const &s)
+{
+    s.visit([&](auto const &s) { write_impl(out, tome, s); });
 }
 } // namespace
 
 void scribe::internal::read_json(Tome *tome, nlohmann::json const &j,
                                  Schema const &s)
 {
-    s.visit([&](auto const &s) { read_impl(tome, j, s); });
+    auto plan = ValidationPlan(s);
+    read_node(tome, j, plan, plan.root());
+}
+
+void scribe::internal::write_json_stream(JsonSink const &sink,
+                                         Tome const &tome, Schema const &s,
+                                         int indent)
+{
+    auto out = JsonStream(sink, indent);
+    write_node(out, tome, s);
+    out.flush();
+}
+
+void scribe::internal::write_binary_stream(JsonSink const &sink,
+                                           Tome const &tome, Schema const &s,
+                                           BinaryFormat format)
+{
+    auto out = BinaryStream(sink, format);
+    write_node(out, tome, s);
+    out.flush();
+}
+
+void scribe::internal::read_binary_stream(Tome *tome, std::istream &input,
+                                          Schema const &s, BinaryFormat format,
+                                          std::pmr::memory_resource *memory)
+{
+    using json = nlohmann::json;
+    auto reader = SaxReader(tome, s, memory);
+    if (format == BinaryFormat::MessagePack)
+    {
+        json::sax_parse(input, &reader, json::input_format_t::msgpack);
+        return;
+    }
+
+    CborReader(input, reader).read();
+}
+
+void scribe::internal::read_json_stream(Tome *tome, std::istream &input,
+                                        Schema const &s,
+                                        std::pmr::memory_resource *memory)
+{
+    auto reader = SaxReader(tome, s, memory);
+    nlohmann::json::sax_parse(input, &reader,
+                              nlohmann::json::input_format_t::json, true, true);
+}
+
+void scribe::internal::read_json_stream(Tome *tome, std::string_view input,
+                                        Schema const &s,
+                                        std::pmr::memory_resource *memory)
+{
+    auto reader = SaxReader(tome, s, memory);
+    nlohmann::json::sax_parse(input, &reader,
+                              nlohmann::json::input_format_t::json, true, true);
+}
+
+namespace {
+constexpr char base64_chars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// inverse of 'base64_chars', 0xff for invalid characters
+constexpr auto base64_values = [] {
+    std::array<uint8_t, 256> table = {};
+    table.fill(0xff);
+    for (uint8_t i = 0; i < 64; ++i)
+        table[static_cast<unsigned char>(base64_chars[i])] = i;
+    return table;
+}();
+
+#ifdef SCRIBE_BASE64_X86
+// SIMD versions of the base64 codec, following W. Muła and D. Lemire, "Faster
+// Base64 Encoding and Decoding Using AVX2 Instructions" (2018). Every 128-bit
+// lane converts 12 bytes to 16 characters (or back). The kernels only handle
+// full blocks and return the number of bytes or 4-character groups they
+// converted, the scalar code does the rest. The instruction set is selected
+// at runtime, such that the default build runs on any x86-64 CPU.
+
+enum class SimdLevel
+{
+    none,
+    ssse3,
+    avx2
+};
+
+SimdLevel simd_level()
+{
+    static SimdLevel const level = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return SimdLevel::avx2;
+        if (__builtin_cpu_supports("ssse3"))
+            return SimdLevel::ssse3;
+        return SimdLevel::none;
+    }();
+    return level;
+}
+
+[[gnu::target("ssse3")]] __m128i base64_encode_lane(__m128i in)
+{
+    // spread each group of 3 bytes over 4 bytes, one 6-bit value per byte
+    in = _mm_shuffle_epi8(
+        in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+    auto ac = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)),
+                              _mm_set1_epi32(0x04000040));
+    auto bd = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)),
+                              _mm_set1_epi32(0x01000010));
+    auto values = _mm_or_si128(ac, bd);
+
+    // Offset from the value to its character, by range of the value:
+    // [0, 26) -> 13, [26, 52) -> 0, [52, 62) -> 1..10, 62 -> 11, 63 -> 12.
+    auto range = _mm_subs_epu8(values, _mm_set1_epi8(51));
+    auto upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), values);
+    range = _mm_or_si128(range, _mm_and_si128(upper, _mm_set1_epi8(13)));
+    auto offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52,
+                                 '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                 '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                 '/' - 63, 'A', 0, 0);
+    return _mm_add_epi8(values, _mm_shuffle_epi8(offsets, range));
+}
+
+[[gnu::target("avx2")]] __m256i base64_encode_lanes(__m256i in)
+{
+    // same as 'base64_encode_lane', for both lanes at once
+    in = _mm256_shuffle_epi8(
+        in, _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11,
+                             10, 1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9,
+                             11, 10));
+    auto ac = _mm256_mulhi_epu16(
+        _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)),
+        _mm256_set1_epi32(0x04000040));
+    auto bd = _mm256_mullo_epi16(
+        _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)),
+        _mm256_set1_epi32(0x01000010));
+    auto values = _mm256_or_si256(ac, bd);
+
+    auto range = _mm256_subs_epu8(values, _mm256_set1_epi8(51));
+    auto upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), values);
+    range = _mm256_or_si256(range,
+                            _mm256_and_si256(upper, _mm256_set1_epi8(13)));
+    auto offsets = _mm256_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    return _mm256_add_epi8(values, _mm256_shuffle_epi8(offsets, range));
+}
+
+// NOTE: the loads are 4 bytes wider than a block, so the last 4+ bytes are
+//       always left to the scalar code
+[[gnu::target("ssse3")]] size_t base64_encode_ssse3(uint8_t const *in,
+                                                    size_t n, char *out)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 12, out += 16)
+    {
+        auto bytes = _mm_loadu_si128(reinterpret_cast<__m128i const *>(in + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out),
+                         base64_encode_lane(bytes));
+    }
+    return i;
+}
+
+[[gnu::target("avx2")]] size_t base64_encode_avx2(uint8_t const *in, size_t n,
+                                                  char *out)
+{
+    size_t i = 0;
+    for (; i + 28 <= n; i += 24, out += 32)
+    {
+        auto lo = _mm_loadu_si128(reinterpret_cast<__m128i const *>(in + i));
+        auto hi =
+            _mm_loadu_si128(reinterpret_cast<__m128i const *>(in + i + 12));
+        auto bytes = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out),
+                            base64_encode_lanes(bytes));
+    }
+    return i;
+}
+
+// Decoding classifies each character by its low and high nibble. A character
+// is invalid if the bit sets of both nibbles intersect (the tables have one
+// bit per group of valid characters, and 0x10 marks invalid nibbles).
+// Returns the number of decoded groups. Stops before the first block with an
+// invalid character, which the scalar code then reports.
+// NOTE: writes up to 4 (SSSE3) or 8 (AVX2) bytes past the last converted
+//       block, so 'groups' must leave that much room in the output.
+[[gnu::target("ssse3")]] size_t
+base64_decode_ssse3(uint8_t const *in, size_t groups, uint8_t *out)
+{
+    auto const lut_lo =
+        _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                      0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    auto const lut_hi =
+        _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10,
+                      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    // offset from character to value, by high nibble ('/' uses index 1)
+    auto const lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0,
+                                        0, 0, 0, 0, 0, 0, 0);
+    auto const mask_2f = _mm_set1_epi8(0x2f);
+
+    size_t g = 0;
+    for (; g + 4 <= groups; g += 4, in += 16, out += 12)
+    {
+        auto chars = _mm_loadu_si128(reinterpret_cast<__m128i const *>(in));
+        auto hi_nibbles = _mm_and_si128(_mm_srli_epi32(chars, 4), mask_2f);
+        auto lo_nibbles = _mm_and_si128(chars, mask_2f);
+        auto invalid = _mm_and_si128(_mm_shuffle_epi8(lut_lo, lo_nibbles),
+                                     _mm_shuffle_epi8(lut_hi, hi_nibbles));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(invalid, _mm_setzero_si128())) !=
+            0xffff)
+            break;
+        auto is_slash = _mm_cmpeq_epi8(chars, mask_2f);
+        auto roll =
+            _mm_shuffle_epi8(lut_roll, _mm_add_epi8(is_slash, hi_nibbles));
+        auto values = _mm_add_epi8(chars, roll);
+
+        // pack 4 x 6 bits into 3 bytes, big-endian
+        auto pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+        auto quads = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+        auto bytes = _mm_shuffle_epi8(
+            quads, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1,
+                                 -1, -1, -1));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), bytes);
+    }
+    return g;
+}
+
+[[gnu::target("avx2")]] size_t
+base64_decode_avx2(uint8_t const *in, size_t groups, uint8_t *out)
+{
+    auto const lut_lo = _mm256_setr_epi8(
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a,
+        0x1b, 0x1b, 0x1b, 0x1a, 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+        0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    auto const lut_hi = _mm256_setr_epi8(
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    auto const lut_roll = _mm256_setr_epi8(
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0, 0, 16, 19, 4,
+        -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    auto const mask_2f = _mm256_set1_epi8(0x2f);
+
+    size_t g = 0;
+    for (; g + 8 <= groups; g += 8, in += 32, out += 24)
+    {
+        auto chars =
+            _mm256_loadu_si256(reinterpret_cast<__m256i const *>(in));
+        auto hi_nibbles =
+            _mm256_and_si256(_mm256_srli_epi32(chars, 4), mask_2f);
+        auto lo_nibbles = _mm256_and_si256(chars, mask_2f);
+        if (!_mm256_testz_si256(_mm256_shuffle_epi8(lut_lo, lo_nibbles),
+                                _mm256_shuffle_epi8(lut_hi, hi_nibbles)))
+            break;
+        auto is_slash = _mm256_cmpeq_epi8(chars, mask_2f);
+        auto roll = _mm256_shuffle_epi8(lut_roll,
+                                        _mm256_add_epi8(is_slash, hi_nibbles));
+        auto values = _mm256_add_epi8(chars, roll);
+
+        auto pairs =
+            _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+        auto quads = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+        auto bytes = _mm256_shuffle_epi8(
+            quads, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1,
+                                    -1, -1, -1, 2, 1, 0, 6, 5, 4, 10, 9, 8, 14,
+                                    13, 12, -1, -1, -1, -1));
+        // 12 bytes per lane -> 24 contiguous bytes
+        bytes = _mm256_permutevar8x32_epi32(
+            bytes, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), bytes);
+    }
+    return g;
+}
+#endif
+} // namespace
+
+char *internal::base64_encode(std::span<const std::byte> data, char *out)
+{
+    auto in = reinterpret_cast<uint8_t const *>(data.data());
+    size_t n = data.size();
+
+    size_t i = 0;
+#ifdef SCRIBE_BASE64_X86
+    switch (simd_level())
+    {
+    case SimdLevel::avx2:
+        i = base64_encode_avx2(in, n, out);
+        break;
+    case SimdLevel::ssse3:
+        i = base64_encode_ssse3(in, n, out);
+        break;
+    case SimdLevel::none:
+        break;
+    }
+    out += i / 3 * 4;
+#endif
+
+    // groups of 3 bytes -> 4 characters, without any branches
+    for (; i + 3 <= n; i += 3, out += 4)
+    {
+        uint32_t v = (uint32_t(in[i]) << 16) | (uint32_t(in[i + 1]) << 8) |
+                     uint32_t(in[i + 2]);
+        out[0] = base64_chars[v >> 18];
+        out[1] = base64_chars[(v >> 12) & 63];
+        out[2] = base64_chars[(v >> 6) & 63];
+        out[3] = base64_chars[v & 63];
+    }
+
+    // last 1 or 2 bytes, padded with '='
+    if (i < n)
+    {
+        uint32_t v = uint32_t(in[i]) << 16;
+        if (i + 1 < n)
+            v |= uint32_t(in[i + 1]) << 8;
+        out[0] = base64_chars[v >> 18];
+        out[1] = base64_chars[(v >> 12) & 63];
+        out[2] = i + 1 < n ? base64_chars[(v >> 6) & 63] : '=';
+        out[3] = '=';
+        out += 4;
+    }
+    return out;
+}
+
+size_t internal::base64_decoded_size(std::string_view text)
+{
+    if (text.size() % 4 != 0)
+        throw ReadError("invalid base64 data (length not a multiple of 4)");
+    size_t size = text.size() / 4 * 3;
+    if (!text.empty() && text.back() == '=')
+        --size;
+    if (text.size() >= 2 && text[text.size() - 2] == '=')
+        --size;
+    return size;
 }
 
-void scribe::internal::write_json(nlohmann::json &j, Tome const &tome,
-                                  Schema const &s)
+void internal::base64_decode(std::string_view text, std::span<std::byte> out)
 {
-    s.visit([&](auto const &s) { write_impl(j, tome, s); });
+    assert(out.size() == base64_decoded_size(text));
+    auto in = reinterpret_cast<uint8_t const *>(text.data());
+    auto dst = reinterpret_cast<uint8_t *>(out.data());
+
+    // Invalid characters (including misplaced padding) map to 0xff. Errors
+    // are accumulated and checked only once at the end, so that the main
+    // loop has no branches.
+    uint32_t error = 0;
+    size_t groups = out.size() / 3;
+    size_t g = 0;
+#ifdef SCRIBE_BASE64_X86
+    // the kernels store whole vectors, keep the last few groups scalar
+    switch (simd_level())
+    {
+    case SimdLevel::avx2:
+        g = base64_decode_avx2(in, groups - std::min<size_t>(groups, 3), dst);
+        break;
+    case SimdLevel::ssse3:
+        g = base64_decode_ssse3(in, groups - std::min<size_t>(groups, 2), dst);
+        break;
+    case SimdLevel::none:
+        break;
+    }
+    in += 4 * g;
+    dst += 3 * g;
+#endif
+    for (; g < groups; ++g, in += 4, dst += 3)
+    {
+        uint32_t a = base64_values[in[0]], b = base64_values[in[1]],
+                 c = base64_values[in[2]], d = base64_values[in[3]];
+        error |= a | b | c | d;
+        uint32_t v = (a << 18) | (b << 12) | (c << 6) | d;
+        dst[0] = static_cast<uint8_t>(v >> 16);
+        dst[1] = static_cast<uint8_t>(v >> 8);
+        dst[2] = static_cast<uint8_t>(v);
+    }
+
+    // last 1 or 2 bytes (followed by padding)
+    if (size_t rest = out.size() - groups * 3; rest)
+    {
+        uint32_t a = base64_values[in[0]], b = base64_values[in[1]];
+        uint32_t c = rest == 2 ? base64_values[in[2]] : 0;
+        error |= a | b | c;
+        uint32_t v = (a << 18) | (b << 12) | (c << 6);
+        dst[0] = static_cast<uint8_t>(v >> 16);
+        if (rest == 2)
+            dst[1] = static_cast<uint8_t>(v >> 8);
+    }
+
+    if (error & 0x80)
+        throw ReadError("invalid character in base64 data");
+}
+
+internal::Base64Array internal::parse_base64_array(nlohmann::json const &j)
+{
+    if (!j.is_object() || j.size() != 3 || !j.contains("dtype") ||
+        !j.contains("shape") || !j.contains("data") ||
+        !j["dtype"].is_string() || !j["shape"].is_array() ||
+        !j["data"].is_string())
+        throw ValidationError("invalid base64 array (expected 'dtype' "
+                              "string, 'shape' array and 'data' string)");
+
+    Base64Array r;
+    r.dtype = j["dtype"].get_ref<std::string const &>();
+    r.data = j["data"].get_ref<std::string const &>();
+    for (auto const &dim : j["shape"])
+    {
+        if (!dim.is_number_unsigned())
+            throw ValidationError("invalid shape of base64 array");
+        r.shape.push_back(dim.get<size_t>());
+    }
+    return r;
 }
 
 std::vector<size_t> internal::guess_array_shape(nlohmann::json const &json)
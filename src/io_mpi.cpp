@@ -0,0 +1,258 @@
+#include "scribe/io_mpi.h"
+
+#include <algorithm>
+#include <exception>
+
+namespace {
+using namespace scribe;
+
+// Collective. Rethrows 'error' if set. If instead any other rank failed, an
+// exception of type E is thrown on this rank as well.
+template <class E> void check_all_ranks(MPI_Comm comm, std::exception_ptr error)
+{
+    int local = error ? 1 : 0;
+    int global = 0;
+    MPI_Allreduce(&local, &global, 1, MPI_INT, MPI_MAX, comm);
+    if (error)
+        std::rethrow_exception(error);
+    if (global)
+        throw E("error on another MPI rank");
+}
+
+// schema of a distributed array, which has to contain numbers of type 'type'
+ArraySchema const &array_schema(Schema const &schema, NumType type)
+{
+    auto const *array = std::get_if<ArraySchema>(&schema.impl().schema_);
+    if (!array)
+        throw ValidationError("distributed data has to be an array");
+    auto const *elements =
+        std::get_if<NumberSchema>(&array->elements.impl().schema_);
+    if (!elements)
+        throw ValidationError("distributed arrays have to contain numbers");
+    if (elements->type != type)
+        throw ValidationError(
+            fmt::format("expected array of {}, got array of {}",
+                        to_string(elements->type), to_string(type)));
+    return *array;
+}
+
+// collective transfer of the block 'slab' of a dataset from/to memory
+void transfer(HighFive::DataSet const &dataset, NumType type, void *data,
+              Hyperslab const &slab, bool write)
+{
+    auto file_space = dataset.getSpace();
+    auto mem_space = HighFive::DataSpace(slab.count);
+    auto offset = std::vector<hsize_t>(slab.offset.begin(), slab.offset.end());
+    auto count = std::vector<hsize_t>(slab.count.begin(), slab.count.end());
+    auto stride = std::vector<hsize_t>(slab.stride.begin(), slab.stride.end());
+
+    // NOTE: ranks without data still have to take part in the transfer
+    bool empty = std::find(count.begin(), count.end(), 0) != count.end();
+    herr_t status;
+    if (empty)
+        status = std::min(H5Sselect_none(file_space.getId()),
+                          H5Sselect_none(mem_space.getId()));
+    else
+        status = H5Sselect_hyperslab(file_space.getId(), H5S_SELECT_SET,
+                                     offset.data(),
+                                     stride.empty() ? nullptr : stride.data(),
+                                     count.data(), nullptr);
+    if (status < 0)
+        throw std::runtime_error("could not select hyperslab");
+
+    HighFive::DataTransferProps xfer;
+    if (H5Pset_dxpl_mpio(xfer.getId(), H5FD_MPIO_COLLECTIVE) < 0)
+        throw std::runtime_error("could not enable collective I/O");
+    auto mem_type = visit_num_type(
+        type, []<class T>(T) { return HighFive::DataType(
+                                   HighFive::create_datatype<T>()); });
+
+    if (write)
+    {
+        if (H5Dwrite(dataset.getId(), mem_type.getId(), mem_space.getId(),
+                     file_space.getId(), xfer.getId(), data) < 0)
+            throw WriteError("collective write failed");
+    }
+    else if (H5Dread(dataset.getId(), mem_type.getId(), mem_space.getId(),
+                     file_space.getId(), xfer.getId(), data) < 0)
+        throw ReadError("collective read failed");
+}
+
+HighFive::FileAccessProps mpio_access(MPI_Comm comm)
+{
+    HighFive::FileAccessProps fapl;
+    if (H5Pset_fapl_mpio(fapl.getId(), comm, MPI_INFO_NULL) < 0)
+        throw std::runtime_error("could not enable MPI-IO");
+
+    // metadata is identical on all ranks, so it is enough if one rank
+    // reads/writes it and broadcasts the result
+    H5Pset_all_coll_metadata_ops(fapl.getId(), true);
+    H5Pset_coll_metadata_write(fapl.getId(), true);
+    return fapl;
+}
+} // namespace
+
+scribe::MpiHdf5File::MpiHdf5File(std::string_view filename, Mode mode,
+                                 MPI_Comm comm)
+    : MpiHdf5File(filename, mode, comm, internal::hdf5_lock())
+{}
+
+scribe::MpiHdf5File::MpiHdf5File(std::string_view filename, Mode mode,
+                                 MPI_Comm comm,
+                                 std::unique_lock<std::recursive_mutex>)
+try : comm_(comm),
+    file_(std::string(filename),
+          mode == Mode::Read ? HighFive::File::ReadOnly
+                             : HighFive::File::ReadWrite |
+                                   HighFive::File::Create |
+                                   HighFive::File::Truncate,
+          mpio_access(comm))
+{}
+catch (HighFive::FileException const &e)
+{
+    throw ReadError(e.what());
+}
+
+scribe::MpiHdf5File::~MpiHdf5File()
+{
+    // HDF5 handles are closed under the lock as well
+    auto lock = internal::hdf5_lock();
+    auto file = std::move(file_);
+}
+
+void scribe::MpiHdf5File::read(Tome &tome, std::string const &path,
+                               Schema const &schema)
+{
+    auto lock = internal::hdf5_lock();
+    std::exception_ptr error;
+    try
+    {
+        internal::read_hdf5(&tome, file_, path, schema);
+        internal::seal(tome);
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+    check_all_ranks<ReadError>(comm_, error);
+}
+
+void scribe::MpiHdf5File::write(std::string const &path, Tome const &tome,
+                                Schema const &schema)
+{
+    auto lock = internal::hdf5_lock();
+    // NOTE: Creating groups/datasets is collective in parallel HDF5, so a
+    //       rank that fails halfway through would leave the others waiting.
+    //       Thus every rank first writes into a private in-memory file, which
+    //       runs all validation, and the ranks agree on the outcome before
+    //       the shared file is touched. Raw data is written by all ranks,
+    //       which is redundant but harmless.
+    std::exception_ptr error;
+    try
+    {
+        HighFive::FileAccessProps fapl;
+        if (H5Pset_fapl_core(fapl.getId(), 1 << 16, false) < 0)
+            throw std::runtime_error("could not create in-memory HDF5 file");
+        auto scratch = HighFive::File("scribe-dry-run.h5",
+                                      HighFive::File::ReadWrite |
+                                          HighFive::File::Create |
+                                          HighFive::File::Truncate,
+                                      fapl);
+
+        // parent groups are metadata, which is the same on all ranks
+        auto name = path == "/" ? path : path.substr(path.rfind('/'));
+        internal::write_hdf5(scratch, name, tome, schema);
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+    check_all_ranks<ValidationError>(comm_, error);
+
+    internal::write_hdf5(file_, path, tome, schema);
+}
+
+void scribe::internal::write_hdf5_block(HighFive::File &file, MPI_Comm comm,
+                                        std::string const &path,
+                                        Schema const &schema, NumType type,
+                                        void const *data,
+                                        std::vector<size_t> const &offset,
+                                        std::vector<size_t> const &count)
+{
+    auto lock = hdf5_lock();
+    // the schema is the same on all ranks, so this fails on all or none
+    auto const &array = array_schema(schema, type);
+
+    // ranks of blocks have to agree with each other and with the schema
+    int rank = int(count.size());
+    int ranks[2] = {rank, -rank};
+    MPI_Allreduce(MPI_IN_PLACE, ranks, 2, MPI_INT, MPI_MAX, comm);
+    if (ranks[0] != -ranks[1])
+        throw ValidationError("distributed array blocks of different rank");
+    if (array.shape && array.shape->size() != count.size())
+        throw ValidationError("shape mismatch (wrong number of dimensions)");
+
+    // global shape: given by the schema or the maximum extent of all blocks
+    auto extent = std::vector<uint64_t>(rank, 0);
+    bool empty = std::find(count.begin(), count.end(), 0) != count.end();
+    if (!empty && offset.size() == count.size())
+        for (int i = 0; i < rank; ++i)
+            extent[i] = offset[i] + count[i];
+    MPI_Allreduce(MPI_IN_PLACE, extent.data(), rank, MPI_UINT64_T, MPI_MAX,
+                  comm);
+    auto shape = std::vector<size_t>(extent.begin(), extent.end());
+    if (array.shape)
+        for (int i = 0; i < rank; ++i)
+            if ((*array.shape)[i] != -1)
+                shape[i] = size_t((*array.shape)[i]);
+
+    auto slab = Hyperslab{offset, count, {}};
+    std::exception_ptr error;
+    try
+    {
+        slab.validate(shape);
+    }
+    catch (ReadError const &e)
+    {
+        error = std::make_exception_ptr(ValidationError(e.what()));
+    }
+    check_all_ranks<ValidationError>(comm, error);
+
+    auto dataset = visit_num_type(type, [&]<class T>(T) {
+        return file.createDataSet<T>(path, HighFive::DataSpace(shape),
+                                     hdf5_create_props(array, shape));
+    });
+    transfer(dataset, type, const_cast<void *>(data), slab, true);
+}
+
+void scribe::internal::read_hdf5_block(HighFive::File &file, MPI_Comm comm,
+                                       std::string const &path,
+                                       Schema const &schema, NumType type,
+                                       void *data, Hyperslab const &slab)
+{
+    auto lock = hdf5_lock();
+    auto const &array = array_schema(schema, type);
+
+    // NOTE: metadata is the same on all ranks, so only the hyperslab can fail
+    //       on some ranks and not others
+    if (!file.exist(path) ||
+        file.getObjectType(path) != HighFive::ObjectType::Dataset)
+        throw ReadError(fmt::format("no dataset at '{}'", path));
+    auto dataset = file.getDataSet(path);
+    auto shape = dataset.getDimensions();
+    array.validate_shape(shape);
+    hdf5_validate_chunking(array, dataset, shape);
+
+    std::exception_ptr error;
+    try
+    {
+        slab.validate(shape);
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+    check_all_ranks<ReadError>(comm, error);
+
+    transfer(dataset, type, data, slab, false);
+}
@@ -0,0 +1,593 @@
+#include "scribe/io_scb.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+using namespace scribe;
+using json = nlohmann::json;
+using NodeId = ValidationPlan::NodeId;
+
+constexpr char scb_magic[8] = {'S', 'C', 'R', 'I', 'B', 'E', '\0', '\0'};
+constexpr uint32_t scb_version = 1;
+constexpr uint32_t scb_byte_order = 0x01020304;
+constexpr size_t scb_alignment = 64;
+
+struct ScbHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t index_offset;
+    uint64_t index_size;
+    char reserved[32];
+};
+static_assert(sizeof(ScbHeader) == 64);
+
+std::optional<NumType> parse_num_type(std::string_view name)
+{
+    for (auto t : {NumType::INT8, NumType::INT16, NumType::INT32,
+                   NumType::INT64, NumType::UINT8, NumType::UINT16,
+                   NumType::UINT32, NumType::UINT64, NumType::FLOAT32,
+                   NumType::FLOAT64, NumType::COMPLEX_FLOAT32,
+                   NumType::COMPLEX_FLOAT64})
+        if (to_string(t) == name)
+            return t;
+    return std::nullopt;
+}
+
+// Number of elements of an array of the given shape. Throws ReadError if that
+// is larger than 'limit' (without overflowing for any shape).
+size_t checked_size(std::vector<size_t> const &shape, size_t limit)
+{
+    if (std::find(shape.begin(), shape.end(), 0) != shape.end())
+        return 0;
+    size_t r = 1;
+    for (auto n : shape)
+    {
+        if (r > limit / n)
+            throw ReadError("array in .scb file is too large");
+        r *= n;
+    }
+    return r;
+}
+
+// validate a number against the schema and convert it to the schema's type
+Tome convert_number(Tome const &tome, NumberSchema const &schema)
+{
+    return tome.visit<Tome>(overloaded{
+        [&](IntegerType auto const &v) {
+            schema.validate_number(v);
+            return Tome::number_unchecked(v, schema.type);
+        },
+        [&](RealType auto const &v) {
+            schema.validate(static_cast<double>(v));
+            return Tome::number_unchecked(v, schema.type);
+        },
+        [&](ComplexType auto const &v) {
+            schema.validate(v.real(), v.imag());
+            if (schema.type == NumType::COMPLEX_FLOAT32)
+                return Tome(complex_float32_t(v));
+            return Tome(complex_float64_t(v));
+        },
+        [](auto const &) -> Tome {
+            throw ValidationError("expected number");
+        }});
+}
+
+// Writes payloads directly to the file while the index is being built
+class ScbWriter
+{
+    std::ofstream file_;
+    uint64_t pos_ = sizeof(ScbHeader);
+
+    void pad()
+    {
+        static constexpr char zeros[scb_alignment] = {};
+        size_t n = (scb_alignment - pos_ % scb_alignment) % scb_alignment;
+        file_.write(zeros, n);
+        pos_ += n;
+    }
+
+  public:
+    explicit ScbWriter(std::string const &filename)
+        : file_(filename, std::ios::binary | std::ios::trunc)
+    {
+        if (!file_)
+            throw WriteError("could not open file " + filename);
+        ScbHeader header = {};
+        file_.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    }
+
+    // append (aligned) raw data, returns its offset in the file
+    uint64_t write_payload(void const *data, size_t bytes)
+    {
+        pad();
+        uint64_t offset = pos_;
+        file_.write(static_cast<char const *>(data), bytes);
+        pos_ += bytes;
+        return offset;
+    }
+
+    void finish(json const &index)
+    {
+        pad();
+        auto s = index.dump();
+        ScbHeader header = {};
+        std::memcpy(header.magic, scb_magic, sizeof(scb_magic));
+        header.version = scb_version;
+        header.byte_order = scb_byte_order;
+        header.index_offset = pos_;
+        header.index_size = s.size();
+        file_.write(s.data(), s.size());
+        file_.seekp(0);
+        file_.write(reinterpret_cast<char const *>(&header), sizeof(header));
+        if (!file_.flush())
+            throw WriteError("could not write .scb file");
+    }
+};
+
+// 'data' are all elements of an array of the given shape
+template <NumberType T>
+json array_entry(ScbWriter &w, std::span<const T> data,
+                 std::vector<size_t> const &shape)
+{
+    return {{"type", "array"},
+            {"elements", to_string(num_type_of<T>())},
+            {"shape", shape},
+            {"offset", w.write_payload(data.data(), data.size_bytes())}};
+}
+
+json number_entry(Tome const &tome)
+{
+    return tome.visit<json>(overloaded{
+        [&]<NumberType T>(T const &v) -> json {
+            if constexpr (ComplexType<T>)
+                return {{"type", to_string(num_type_of<T>())},
+                        {"value", {v.real(), v.imag()}}};
+            else
+                return {{"type", to_string(num_type_of<T>())}, {"value", v}};
+        },
+        [](auto const &) -> json {
+            throw ValidationError("expected number");
+        }});
+}
+
+void write_any(ScbWriter &w, json &entry, Tome const &tome);
+void write_node(ScbWriter &w, json &entry, Tome const &tome,
+                ValidationPlan const &plan, NodeId node);
+
+void write_impl(ScbWriter &, json &, Tome const &, NoneSchema const &,
+                ValidationPlan const &, NodeId)
+{
+    throw ValidationError("NoneSchema is never valid");
+}
+
+void write_impl(ScbWriter &w, json &entry, Tome const &tome, AnySchema const &,
+                ValidationPlan const &, NodeId)
+{
+    write_any(w, entry, tome);
+}
+
+void write_impl(ScbWriter &, json &entry, Tome const &tome,
+                BooleanSchema const &, ValidationPlan const &, NodeId)
+{
+    if (!tome.is<bool>())
+        throw ValidationError("expected boolean");
+    entry = {{"type", "bool"}, {"value", tome.as<bool>()}};
+}
+
+void write_impl(ScbWriter &, json &entry, Tome const &tome,
+                NumberSchema const &schema, ValidationPlan const &, NodeId)
+{
+    entry = number_entry(convert_number(tome, schema));
+}
+
+void write_impl(ScbWriter &, json &entry, Tome const &tome,
+                StringSchema const &schema, ValidationPlan const &, NodeId)
+{
+    auto const &value = tome.as_string();
+    schema.validate(value);
+    entry = {{"type", "string"}, {"value", value}};
+}
+
+void write_impl(ScbWriter &w, json &entry, Tome const &tome,
+                ArraySchema const &schema, ValidationPlan const &plan,
+                NodeId node)
+{
+    auto const *item_schema =
+        std::get_if<NumberSchema>(&schema.elements.impl().schema_);
+
+    tome.visit(overloaded{
+        [&]<NumberType T>(Array<T> const &values) {
+            if (!item_schema || num_type_of<T>() != item_schema->type)
+                throw ValidationError(fmt::format(
+                    "unexpected array of {}", to_string(num_type_of<T>())));
+            schema.validate_shape(values.shape());
+            entry = array_entry(w, std::span(values.data(), values.size()),
+                                values.shape());
+        },
+        [&](Tome::array_type const &values) {
+            schema.validate_shape(values.shape());
+            if (item_schema)
+            {
+                // array of numbers -> store compact
+                visit_num_type(item_schema->type, [&]<class T>(T) {
+                    std::vector<T> data;
+                    data.reserve(values.size());
+                    for (Tome const &v : values)
+                        data.push_back(convert_number(v, *item_schema).as<T>());
+                    entry = array_entry(w, std::span<const T>(data),
+                                        values.shape());
+                });
+                return;
+            }
+            entry = {{"type", "tome_array"},
+                     {"shape", values.shape()},
+                     {"elements", json::array()}};
+            for (Tome const &v : values)
+            {
+                write_node(w, entry["elements"].emplace_back(), v, plan,
+                           plan.node(node).elements);
+            }
+        },
+        [](auto const &) { throw ValidationError("expected array"); }});
+}
+
+void write_impl(ScbWriter &w, json &entry, Tome const &tome,
+                DictSchema const &, ValidationPlan const &plan, NodeId node)
+{
+    if (!tome.is_dict())
+        throw ValidationError("expected a dictionary");
+    auto const &dict = tome.as_dict();
+    std::vector<std::string> keys;
+    keys.reserve(dict.size());
+    for (auto const &[key, _] : dict)
+        keys.push_back(key.str());
+    std::vector<uint32_t> indices;
+    plan.validate_keys(node, keys, indices);
+
+    entry = {{"type", "dict"}, {"items", json::object()}};
+    auto &items = entry["items"];
+    auto const &n = plan.node(node);
+    size_t i = 0;
+    for (auto const &[_, value] : dict)
+    {
+        write_node(w, items[keys[i]], value, plan, n.items[indices[i]]);
+        ++i;
+    }
+}
+
+void write_node(ScbWriter &w, json &entry, Tome const &tome,
+                ValidationPlan const &plan, NodeId node)
+{
+    plan.schema(node).visit(
+        [&](auto const &s) { write_impl(w, entry, tome, s, plan, node); });
+}
+
+void write_any(ScbWriter &w, json &entry, Tome const &tome)
+{
+    tome.visit(overloaded{
+        [&](Tome::dict_type const &dict) {
+            entry = {{"type", "dict"}, {"items", json::object()}};
+            for (auto const &[key, value] : dict)
+                write_any(w, entry["items"][key.str()], value);
+        },
+        [&](Tome::array_type const &values) {
+            entry = {{"type", "tome_array"},
+                     {"shape", values.shape()},
+                     {"elements", json::array()}};
+            for (Tome const &v : values)
+                write_any(w, entry["elements"].emplace_back(), v);
+        },
+        [&]<NumberType T>(Array<T> const &values) {
+            entry = array_entry(w, std::span(values.data(), values.size()),
+                                values.shape());
+        },
+        [&](bool const &v) { entry = {{"type", "bool"}, {"value", v}}; },
+        [&](std::string const &v) {
+            entry = {{"type", "string"}, {"value", v}};
+        },
+        [&](auto const &) { entry = number_entry(tome); }});
+}
+
+// number stored in the index, with exactly the stored type
+Tome read_number(json const &entry)
+{
+    auto type = parse_num_type(entry.at("type").get<std::string>());
+    if (!type)
+        throw ValidationError("expected number");
+    auto const &v = entry.at("value");
+    return visit_num_type(*type, [&]<class T>(T) -> Tome {
+        if constexpr (ComplexType<T>)
+        {
+            using R = typename T::value_type;
+            return T(v.at(0).get<R>(), v.at(1).get<R>());
+        }
+        else
+            return v.get<T>();
+    });
+}
+
+std::string_view entry_type(json const &entry)
+{
+    return entry.at("type").get_ref<std::string const &>();
+}
+
+struct ReadContext
+{
+    ScbFile const &file;
+    ValidationPlan const &plan;
+    std::pmr::memory_resource *memory;
+    KeyPool &keys; // dict keys read without schema
+};
+
+void read_any(Tome &tome, ReadContext const &ctx, json const &entry);
+
+void read_node(Tome *, ReadContext const &, json const &, NodeId);
+
+void read_impl(Tome *, ReadContext const &, json const &, NoneSchema const &,
+               NodeId)
+{
+    throw ValidationError("NoneSchema is never valid");
+}
+
+void read_impl(Tome *tome, ReadContext const &ctx, json const &entry,
+               AnySchema const &, NodeId)
+{
+    if (tome)
+        read_any(*tome, ctx, entry);
+}
+
+void read_impl(Tome *tome, ReadContext const &, json const &entry,
+               BooleanSchema const &, NodeId)
+{
+    if (entry_type(entry) != "bool")
+        throw ValidationError("expected boolean");
+    if (tome)
+        *tome = entry.at("value").get<bool>();
+}
+
+void read_impl(Tome *tome, ReadContext const &, json const &entry,
+               NumberSchema const &schema, NodeId)
+{
+    auto value = convert_number(read_number(entry), schema);
+    if (tome)
+        *tome = std::move(value);
+}
+
+void read_impl(Tome *tome, ReadContext const &, json const &entry,
+               StringSchema const &schema, NodeId)
+{
+    if (entry_type(entry) != "string")
+        throw ValidationError("expected string");
+    auto const &value = entry.at("value").get_ref<std::string const &>();
+    schema.validate(value);
+    if (tome)
+        *tome = value;
+}
+
+void read_impl(Tome *tome, ReadContext const &ctx, json const &entry,
+               ArraySchema const &schema, NodeId node)
+{
+    auto type = entry_type(entry);
+    if (type == "array")
+    {
+        auto const *item_schema =
+            std::get_if<NumberSchema>(&schema.elements.impl().schema_);
+        auto elements = entry.at("elements").get<std::string>();
+        if (!item_schema || to_string(item_schema->type) != elements)
+            throw ValidationError(
+                fmt::format("unexpected array of {}", elements));
+        visit_num_type(item_schema->type, [&]<class T>(T) {
+            // no copy, the array refers to the mapped file
+            auto array = ctx.file.array_entry<T>(entry);
+            schema.validate_shape(array.shape());
+            if (tome)
+                *tome = Tome::array(std::move(array), ctx.memory);
+        });
+    }
+    else if (type == "tome_array")
+    {
+        auto shape = entry.at("shape").get<std::vector<size_t>>();
+        auto const &elements = entry.at("elements");
+        schema.validate_shape(shape);
+        if (elements.size() != checked_size(shape, elements.size()))
+            throw ReadError("inconsistent array in .scb file");
+        std::vector<Tome> values(tome ? elements.size() : 0);
+        auto elements_node = ctx.plan.node(node).elements;
+        for (size_t i = 0; i < elements.size(); ++i)
+            read_node(tome ? &values[i] : nullptr, ctx, elements[i],
+                      elements_node);
+        if (tome)
+            *tome = Tome::array(std::move(values), shape, ctx.memory);
+    }
+    else
+        throw ValidationError("expected array");
+}
+
+void read_impl(Tome *tome, ReadContext const &ctx, json const &entry,
+               DictSchema const &, NodeId node)
+{
+    if (entry_type(entry) != "dict")
+        throw ValidationError("expected a dictionary");
+    auto const &items = entry.at("items");
+    std::vector<std::string> keys;
+    for (auto const &[key, _] : items.items())
+        keys.push_back(key);
+    std::vector<uint32_t> indices;
+    ctx.plan.validate_keys(node, keys, indices);
+    assert(keys.size() == indices.size());
+
+    auto const &n = ctx.plan.node(node);
+    if (tome)
+        *tome = Tome::dict(ctx.memory);
+    size_t i = 0;
+    for (auto const &[key, value] : items.items())
+    {
+        auto k = indices[i++];
+        read_node(tome ? &tome->as_dict()[n.item_keys[k]] : nullptr, ctx,
+                  value, n.items[k]);
+    }
+}
+
+void read_node(Tome *tome, ReadContext const &ctx, json const &entry,
+               NodeId node)
+{
+    ctx.plan.schema(node).visit(
+        [&](auto const &s) { read_impl(tome, ctx, entry, s, node); });
+}
+
+void read_any(Tome &tome, ReadContext const &ctx, json const &entry)
+{
+    auto type = entry_type(entry);
+    if (type == "dict")
+    {
+        tome = Tome::dict(ctx.memory);
+        for (auto const &[key, value] : entry.at("items").items())
+            read_any(tome.as_dict()[ctx.keys.intern(key)], ctx, value);
+    }
+    else if (type == "tome_array")
+    {
+        auto shape = entry.at("shape").get<std::vector<size_t>>();
+        auto const &elements = entry.at("elements");
+        if (elements.size() != checked_size(shape, elements.size()))
+            throw ReadError("inconsistent array in .scb file");
+        std::vector<Tome> values(elements.size());
+        for (size_t i = 0; i < elements.size(); ++i)
+            read_any(values[i], ctx, elements[i]);
+        tome = Tome::array(std::move(values), shape, ctx.memory);
+    }
+    else if (type == "array")
+    {
+        auto elements = entry.at("elements").get<std::string>();
+        auto num_type = parse_num_type(elements);
+        if (!num_type)
+            throw ReadError(fmt::format("unknown element type '{}'", elements));
+        visit_num_type(*num_type, [&]<class T>(T) {
+            tome = Tome::array(ctx.file.array_entry<T>(entry), ctx.memory);
+        });
+    }
+    else if (type == "bool")
+        tome = entry.at("value").get<bool>();
+    else if (type == "string")
+        tome = entry.at("value").get<std::string>();
+    else
+        tome = read_number(entry);
+}
+} // namespace
+
+scribe::ScbFile::ScbFile(std::string_view filename) : filename_(filename)
+{
+    int fd = ::open(filename_.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw ReadError("could not open file " + filename_);
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(ScbHeader))
+    {
+        size_ = st.st_size;
+        void *p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED)
+            data_ = std::shared_ptr<const char>(
+                static_cast<char const *>(p),
+                [size = size_](char const *q) {
+                    ::munmap(const_cast<char *>(q), size);
+                });
+    }
+    ::close(fd); // the mapping stays valid
+    if (!data_)
+        throw ReadError("could not map file " + filename_);
+
+    ScbHeader header;
+    std::memcpy(&header, data_.get(), sizeof(header));
+    if (std::memcmp(header.magic, scb_magic, sizeof(scb_magic)) != 0)
+        throw ReadError("not a .scb file: " + filename_);
+    if (header.version != scb_version)
+        throw ReadError(fmt::format("unsupported .scb version {} in {}",
+                                    header.version, filename_));
+    if (header.byte_order != scb_byte_order)
+        throw ReadError("byte order of .scb file does not match: " +
+                        filename_);
+    if (header.index_offset > size_ ||
+        header.index_size > size_ - header.index_offset)
+        throw ReadError("truncated .scb file: " + filename_);
+    auto index = data_.get() + header.index_offset;
+    index_ = json::parse(index, index + header.index_size);
+}
+
+scribe::Schema scribe::ScbFile::schema() const
+{
+    return Schema::from_json(index_.at("schema"));
+}
+
+std::pair<void const *, size_t>
+scribe::ScbFile::payload(nlohmann::json const &e, NumType type) const
+{
+    if (entry_type(e) != "array")
+        throw TomeTypeError("not a numeric array");
+    auto elements = e.at("elements").get<std::string>();
+    if (elements != to_string(type))
+        throw TomeTypeError(fmt::format("expected array of {}, got {}",
+                                        to_string(type), elements));
+    auto offset = e.at("offset").get<uint64_t>();
+    if (offset % scb_alignment != 0 || offset > size_)
+        throw ReadError("invalid array offset in " + filename_);
+
+    // the array has to fit into the rest of the file
+    auto element_size =
+        visit_num_type(type, []<class T>(T) { return sizeof(T); });
+    auto size = checked_size(e.at("shape").get<std::vector<size_t>>(),
+                             (size_ - offset) / element_size);
+    return {data_.get() + offset, size};
+}
+
+nlohmann::json const &scribe::ScbFile::entry(std::string_view path) const
+{
+    json const *e = &index();
+    size_t pos = 0;
+    while (pos < path.size())
+    {
+        size_t next = std::min(path.find('/', pos), path.size());
+        if (next > pos)
+        {
+            auto key = std::string(path.substr(pos, next - pos));
+            if (entry_type(*e) != "dict" || !e->at("items").contains(key))
+                throw ReadError(fmt::format("object '{}' does not exist in {}",
+                                            path, filename_));
+            e = &e->at("items").at(key);
+        }
+        pos = next + 1;
+    }
+    return *e;
+}
+
+void scribe::internal::read_scb(Tome *tome, ScbFile const &file,
+                                Schema const &schema,
+                                std::pmr::memory_resource *memory)
+{
+    try
+    {
+        auto plan = ValidationPlan(schema);
+        auto keys = KeyPool(memory);
+        auto ctx = ReadContext{file, plan, memory, keys};
+        read_node(tome, ctx, file.index(), plan.root());
+    }
+    catch (json::exception const &e)
+    {
+        throw ReadError(fmt::format("invalid .scb index: {}", e.what()));
+    }
+}
+
+void scribe::internal::write_scb(std::string const &filename,
+                                 Tome const &tome, Schema const &schema)
+{
+    auto w = ScbWriter(filename);
+    json index = {{"schema", schema.to_json()}};
+    auto plan = ValidationPlan(schema);
+    write_node(w, index["data"], tome, plan, plan.root());
+    w.finish(index);
+}
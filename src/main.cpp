@@ -21,7 +21,8 @@ int main(int argc, char **argv)
     bool verbose = false;
 
     auto validate_command = app.add_subcommand(
-        "validate", "validate a data file (json/hdf5) against a schema");
+        "validate",
+        "validate a data file (json/cbor/msgpack/scb) against a schema");
     validate_command->add_option("--schema", schema_filename, "schema file")
         ->required();
     validate_command->add_option("data", data_filename, "data file")
@@ -38,6 +39,12 @@ int main(int argc, char **argv)
     convert_command->add_option("--schema", schema_filename, "schema file");
     convert_command->add_option("in", data_filename, "input file")->required();
     convert_command->add_option("out", out_filename, "output file")->required();
+    int num_threads = 1;
+    convert_command->add_option("--threads,-j", num_threads,
+                                "number of threads for reading (hdf5 only)");
+    bool compact = false;
+    convert_command->add_flag("--compact", compact,
+                              "write JSON without any whitespace");
 
     auto guess_schema_command = app.add_subcommand(
         "guess-schema", "guess a schema from a data file (hdf5 only)");
@@ -46,6 +53,43 @@ int main(int argc, char **argv)
     guess_schema_command->add_option("schema", schema_filename,
                                      "schema file (output. default to stdout)");
 
+    std::string other_filename;
+    DiffOptions diff_options;
+    auto diff_command = app.add_subcommand(
+        "diff", "compare two data files (exit code 1 if they differ)");
+    diff_command->add_option("--schema", schema_filename,
+                             "schema file (required for json/cbor/msgpack)");
+    diff_command->add_option("a", data_filename, "first data file")
+        ->required();
+    diff_command->add_option("b", other_filename, "second data file")
+        ->required();
+    diff_command->add_option(
+        "--tolerance", diff_options.tolerance,
+        "tolerance for floating point numbers (relative, absolute below 1)");
+    diff_command->add_option("--max-differences", diff_options.max_differences,
+                             "stop after this many differences");
+
+    std::string path;
+    Hyperslab slab;
+    auto slice_command = app.add_subcommand(
+        "slice", "print part of a numeric array from a data file (hdf5 only)");
+    slice_command->add_option("data", data_filename, "data file")->required();
+    slice_command->add_option("path", path, "path of the array inside the file")
+        ->required();
+    slice_command
+        ->add_option("--offset", slab.offset, "first index in each dimension")
+        ->delimiter(',')
+        ->required();
+    slice_command
+        ->add_option("--count", slab.count,
+                     "number of elements in each dimension")
+        ->delimiter(',')
+        ->required();
+    slice_command
+        ->add_option("--stride", slab.stride,
+                     "step size in each dimension (default: 1)")
+        ->delimiter(',');
+
     CLI11_PARSE(app, argc, argv);
 
     if (validate_command->parsed())
@@ -75,13 +119,15 @@ int main(int argc, char **argv)
                           ? Schema::any()
                           : scribe::Schema::from_file(schema_filename);
         Tome tome;
-        read_file(tome, data_filename, schema);
-        write_file(out_filename, tome, schema);
+        read_file(tome, data_filename, schema, {.num_threads = num_threads});
+        write_file(out_filename, tome, schema,
+                   {.indent = compact ? -1 : 4});
     }
     else if (guess_schema_command->parsed())
     {
+        // lazy reading, so that only the metadata is read
         Tome tome;
-        read_file(tome, data_filename, Schema::any());
+        read_file(tome, data_filename, Schema::any(), {.lazy = true});
         auto schema = guess_schema(tome);
         if (schema_filename.empty())
         {
@@ -93,6 +139,25 @@ int main(int argc, char **argv)
             file << schema.to_json().dump(4) << '\n';
         }
     }
+    else if (diff_command->parsed())
+    {
+        auto schema = schema_filename.empty()
+                          ? Schema::any()
+                          : scribe::Schema::from_file(schema_filename);
+        Tome a, b;
+        read_file(a, data_filename, schema);
+        read_file(b, other_filename, schema);
+        auto differences = diff(a, b, diff_options);
+        for (auto const &d : differences)
+            fmt::print("{}: {}\n", d.path, d.what);
+        return differences.empty() ? 0 : 1;
+    }
+    else if (slice_command->parsed())
+    {
+        Tome tome;
+        read_file(tome, data_filename, path, slab);
+        fmt::print("{}\n", tome);
+    }
     else
     {
         assert(false);
@@ -1,6 +1,8 @@
 #include "scribe/schema.h"
 
 #include "fmt/format.h"
+#include <algorithm>
+#include <bit>
 #include <fstream>
 
 std::string scribe::to_string(NumType type)
@@ -59,6 +61,72 @@ scribe::Schema::Schema(DictSchema s)
 {}
 
 namespace scribe {
+namespace {
+
+Hdf5StorageHints hdf5_hints_from_json(nlohmann::json const &j)
+{
+    Hdf5StorageHints hints;
+    if (j.contains("chunk_size"))
+        hints.chunk_size = j.at("chunk_size").get<std::vector<int64_t>>();
+    if (j.contains("deflate"))
+        hints.deflate = j.at("deflate").get<int>();
+    hints.shuffle = j.value<bool>("shuffle", false);
+    if (j.contains("szip"))
+        hints.szip = j.at("szip").get<int>();
+    hints.fletcher32 = j.value<bool>("fletcher32", false);
+
+    if (hints.chunk_size)
+        for (auto c : *hints.chunk_size)
+            if (c != -1 && c <= 0)
+                throw std::runtime_error(
+                    "invalid 'chunk_size' (must be positive or -1)");
+    if (hints.deflate && (*hints.deflate < 0 || *hints.deflate > 9))
+        throw std::runtime_error("invalid 'deflate' level (must be 0-9)");
+    if (hints.szip &&
+        (*hints.szip <= 0 || *hints.szip > 32 || *hints.szip % 2 != 0))
+        throw std::runtime_error(
+            "invalid 'szip' pixels-per-block (must be even and <= 32)");
+    return hints;
+}
+
+nlohmann::json hdf5_hints_to_json(Hdf5StorageHints const &hints)
+{
+    nlohmann::json j = nlohmann::json::object();
+    if (hints.chunk_size)
+        j["chunk_size"] = *hints.chunk_size;
+    if (hints.deflate)
+        j["deflate"] = *hints.deflate;
+    if (hints.shuffle)
+        j["shuffle"] = true;
+    if (hints.szip)
+        j["szip"] = *hints.szip;
+    if (hints.fletcher32)
+        j["fletcher32"] = true;
+    return j;
+}
+
+JsonStorageHints json_hints_from_json(nlohmann::json const &j)
+{
+    JsonStorageHints hints;
+    auto encoding = j.value<std::string>("encoding", "text");
+    if (encoding == "base64")
+        hints.base64 = true;
+    else if (encoding != "text")
+        throw std::runtime_error("invalid json 'encoding' (must be 'text' or "
+                                 "'base64'): " +
+                                 encoding);
+    return hints;
+}
+
+nlohmann::json json_hints_to_json(JsonStorageHints const &hints)
+{
+    nlohmann::json j = nlohmann::json::object();
+    if (hints.base64)
+        j["encoding"] = "base64";
+    return j;
+}
+
+} // namespace
 
 const std::shared_ptr<const SchemaImpl> g_schemaimpl_any =
     std::make_shared<SchemaImpl>(AnySchema{});
@@ -162,6 +230,19 @@ Schema Schema::from_json(nlohmann::json const &j)
         ArraySchema array_schema;
         get_optional(array_schema.shape, "shape");
         array_schema.elements = Schema::from_json(j.at("elements"));
+        if (j.contains("hdf5"))
+            array_schema.hdf5 = hdf5_hints_from_json(j.at("hdf5"));
+        if (array_schema.shape && array_schema.hdf5.chunk_size &&
+            array_schema.shape->size() != array_schema.hdf5.chunk_size->size())
+            throw std::runtime_error(
+                "'chunk_size' does not match the rank of 'shape'");
+        if (j.contains("json"))
+            array_schema.json = json_hints_from_json(j.at("json"));
+        if (array_schema.json.base64 &&
+            !std::holds_alternative<NumberSchema>(
+                array_schema.elements.impl().schema_))
+            throw std::runtime_error(
+                "base64 encoding is only supported for arrays of numbers");
         s.schema_ = array_schema;
     }
     else if (type == "dict")
@@ -212,6 +293,10 @@ nlohmann::json Schema::to_json() const
             if (s.shape)
                 j["shape"] = *s.shape;
             j["elements"] = s.elements.to_json();
+            if (!s.hdf5.empty())
+                j["hdf5"] = hdf5_hints_to_json(s.hdf5);
+            if (!s.json.empty())
+                j["json"] = json_hints_to_json(s.json);
         },
         [&](DictSchema const &s) {
             j["type"] = "dict";
@@ -312,6 +397,26 @@ void NumberSchema::validate(int64_t value) const
     }
 }
 
+void NumberSchema::validate(uint64_t value) const
+{
+    if (value <= uint64_t(std::numeric_limits<int64_t>::max()))
+        return validate(static_cast<int64_t>(value));
+
+    // too large for any integer type except uint64
+    switch (type)
+    {
+    case NumType::UINT64:
+    case NumType::FLOAT32:
+    case NumType::FLOAT64:
+    case NumType::COMPLEX_FLOAT32:
+    case NumType::COMPLEX_FLOAT64:
+        break;
+    default:
+        throw ValidationError(
+            fmt::format("integer value out of range of {}", to_string(type)));
+    }
+}
+
 void NumberSchema::validate(double) const
 {
     switch (type)
@@ -423,6 +528,40 @@ void ArraySchema::validate_shape(std::span<const size_t> shape) const
     }
 }
 
+bool ArraySchema::appendable() const
+{
+    return shape && !shape->empty() && shape->front() == -1;
+}
+
+bool Hdf5StorageHints::empty() const
+{
+    return !chunk_size && !deflate && !shuffle && !szip && !fletcher32;
+}
+
+bool Hdf5StorageHints::needs_chunking() const
+{
+    return chunk_size || deflate || shuffle || szip || fletcher32;
+}
+
+std::vector<size_t>
+Hdf5StorageHints::chunk_dims(std::span<const size_t> shape) const
+{
+    // NOTE: HDF5 does not allow zero-sized chunks, even for empty datasets
+    std::vector<size_t> dims(shape.begin(), shape.end());
+    if (chunk_size)
+    {
+        if (chunk_size->size() != shape.size())
+            throw ValidationError(
+                "chunk_size does not match the rank of the array");
+        for (size_t i = 0; i < dims.size(); ++i)
+            if ((*chunk_size)[i] != -1)
+                dims[i] = std::min(dims[i], (size_t)(*chunk_size)[i]);
+    }
+    for (auto &d : dims)
+        d = std::max(d, size_t(1));
+    return dims;
+}
+
 int DictSchema::find_key(std::string_view key) const
 {
     for (size_t i = 0; i < items.size(); ++i)
@@ -453,4 +592,86 @@ DictSchema::validate(std::span<const std::string> keys) const
     return schemas;
 }
 
-} // namespace scribe
\ No newline at end of file
+} // namespace scribe
+
+scribe::ValidationPlan::ValidationPlan(Schema const &schema) : root_(schema)
+{
+    // sub-schemas shared between multiple parents are compiled only once
+    std::map<SchemaImpl const *, NodeId> cache;
+    compile(root_, cache);
+}
+
+scribe::ValidationPlan::NodeId
+scribe::ValidationPlan::compile(Schema const &schema,
+                                std::map<SchemaImpl const *, NodeId> &cache)
+{
+    if (auto it = cache.find(&schema.impl()); it != cache.end())
+        return it->second;
+
+    // NOTE: 'nodes_' may be reallocated by the recursion, so build the node
+    // separately and only move it in at the end
+    NodeId id = nodes_.size();
+    cache[&schema.impl()] = id;
+    nodes_.emplace_back();
+    Node node;
+    node.schema = &schema;
+    schema.visit(overloaded{
+        [&](ArraySchema const &s) {
+            node.elements = compile(s.elements, cache);
+        },
+        [&](DictSchema const &s) {
+            node.keys.reserve(s.items.size());
+            node.required.resize((s.items.size() + 63) / 64, 0);
+            for (size_t i = 0; i < s.items.size(); ++i)
+            {
+                node.keys.emplace(s.items[i].key, i);
+                node.items.push_back(compile(s.items[i].schema, cache));
+                node.item_keys.push_back(key_pool_.intern(s.items[i].key));
+                if (!s.items[i].optional)
+                    node.required[i / 64] |= uint64_t(1) << (i % 64);
+            }
+        },
+        [](auto const &) {}});
+    nodes_[id] = std::move(node);
+    return id;
+}
+
+int scribe::ValidationPlan::find_key(NodeId dict, std::string_view key) const
+{
+    auto const &keys = nodes_[dict].keys;
+    auto it = keys.find(key);
+    return it == keys.end() ? -1 : (int)it->second;
+}
+
+void scribe::ValidationPlan::check_required(
+    NodeId dict, std::span<const uint64_t> seen) const
+{
+    auto const &required = nodes_[dict].required;
+    assert(seen.size() == required.size());
+    for (size_t w = 0; w < required.size(); ++w)
+        if (auto missing = required[w] & ~seen[w]; missing)
+        {
+            auto i = w * 64 + std::countr_zero(missing);
+            auto const &s = std::get<DictSchema>(schema(dict).impl().schema_);
+            throw ValidationError("missing key: " + s.items[i].key);
+        }
+}
+
+void scribe::ValidationPlan::validate_keys(NodeId dict,
+                                           std::span<const std::string> keys,
+                                           std::vector<uint32_t> &indices) const
+{
+    auto const &n = nodes_[dict];
+    auto seen = std::vector<uint64_t>(n.required.size(), 0);
+    indices.clear();
+    indices.reserve(keys.size());
+    for (auto const &key : keys)
+    {
+        int i = find_key(dict, key);
+        if (i == -1)
+            throw ValidationError("unexpected key: " + key);
+        seen[i / 64] |= uint64_t(1) << (i % 64);
+        indices.push_back(i);
+    }
+    check_required(dict, seen);
+}
@@ -2,44 +2,172 @@
 
 #include "scribe/io_hdf5.h"
 #include "scribe/io_json.h"
+#include "scribe/io_scb.h"
+#include <filesystem>
 #include <fstream>
 
+namespace {
+// CBOR/MessagePack file endings
+std::optional<scribe::internal::BinaryFormat>
+binary_format(std::string_view filename)
+{
+    if (filename.ends_with(".cbor"))
+        return scribe::internal::BinaryFormat::CBOR;
+    if (filename.ends_with(".msgpack"))
+        return scribe::internal::BinaryFormat::MessagePack;
+    return std::nullopt;
+}
+
+// Calls 'write' with a temporary filename next to 'filename', which then
+// replaces 'filename' on success. Thus a failed write (e.g. invalid data
+// found halfway through) never leaves a truncated file behind.
+template <class F> void write_via_temp_file(std::string_view filename, F write)
+{
+    auto path = std::filesystem::path(filename);
+    auto temp = path;
+    temp += ".tmp";
+    std::error_code ec;
+    try
+    {
+        write(temp.string());
+        std::filesystem::rename(temp, path);
+    }
+    catch (std::filesystem::filesystem_error const &)
+    {
+        std::filesystem::remove(temp, ec);
+        throw scribe::WriteError("could not write file " + path.string());
+    }
+    catch (...)
+    {
+        std::filesystem::remove(temp, ec);
+        throw;
+    }
+}
+} // namespace
+
 void scribe::read_file(Tome &tome, std::string_view filename,
-                       Schema const &schema)
+                       Schema const &schema, ReadOptions const &options)
 {
-    if (filename.ends_with(".json"))
+    if (options.lazy)
+    {
+        if (!(filename.ends_with(".h5") || filename.ends_with(".hdf5")))
+            throw ReadError("lazy reading is only supported for hdf5");
+        if (!std::holds_alternative<AnySchema>(schema.impl().schema_))
+            throw ReadError("lazy reading is only supported without schema");
+        auto lock = internal::hdf5_lock();
+        auto file = std::make_shared<HighFive::File>(std::string(filename),
+                                                     HighFive::File::ReadOnly);
+        internal::read_hdf5_lazy(tome, std::move(file), "/");
+    }
+    else if (filename.ends_with(".json"))
     {
-        auto j = nlohmann::json::parse(std::ifstream(std::string(filename)),
-                                       nullptr, true, true);
-        internal::read_json(&tome, j, schema);
+        auto file = std::ifstream(std::string(filename));
+        if (!file)
+            throw ReadError("could not open file " + std::string(filename));
+        internal::read_json_stream(&tome, file, schema, options.memory);
+    }
+    else if (auto format = binary_format(filename); format)
+    {
+        auto file = std::ifstream(std::string(filename), std::ios::binary);
+        if (!file)
+            throw ReadError("could not open file " + std::string(filename));
+        internal::read_binary_stream(&tome, file, schema, *format,
+                                     options.memory);
+    }
+    else if (filename.ends_with(".scb"))
+    {
+        auto file = ScbFile(filename);
+        internal::read_scb(&tome, file, schema, options.memory);
     }
     else if (filename.ends_with(".h5") || filename.ends_with(".hdf5"))
     {
+        auto lock = internal::hdf5_lock();
         auto file =
             HighFive::File(std::string(filename), HighFive::File::ReadOnly);
-        internal::read_hdf5(&tome, file, "/", schema);
+        if (options.num_threads > 1)
+        {
+            auto queue = internal::Hdf5ReadQueue(file);
+            internal::read_hdf5(&tome, file, "/", schema, &queue,
+                                options.memory);
+            queue.run(options.num_threads);
+        }
+        else
+            internal::read_hdf5(&tome, file, "/", schema, nullptr,
+                                options.memory);
     }
     else
         throw std::runtime_error("unknown file ending when reading a file");
+    internal::seal(tome);
 }
 
-void scribe::write_file(std::string_view filename, Tome const &tome,
-                        Schema const &schema)
+void scribe::read_file(Tome &tome, std::string_view filename,
+                       std::string_view path, Hyperslab const &slab)
 {
-    if (filename.ends_with(".json"))
+    if (filename.ends_with(".h5") || filename.ends_with(".hdf5"))
     {
-        nlohmann::json j;
-        internal::write_json(j, tome, schema);
-        std::ofstream(std::string(filename)) << j.dump(4) << '\n';
+        auto lock = internal::hdf5_lock();
+        auto file =
+            HighFive::File(std::string(filename), HighFive::File::ReadOnly);
+        internal::read_hdf5_slice(tome, file, std::string(path), slab);
     }
-    else if (filename.ends_with(".h5") || filename.ends_with(".hdf5"))
+    else
+        throw std::runtime_error("partial reads are only supported for hdf5");
+    internal::seal(tome);
+}
+
+void scribe::write_file(std::string_view filename, Tome const &tome,
+                        Schema const &schema, WriteOptions const &options)
+{
+    if (filename.ends_with(".json"))
+        write_via_temp_file(filename, [&](std::string const &temp) {
+            auto file = std::ofstream(temp, std::ios::binary);
+            if (!file)
+                throw WriteError("could not open file " + temp);
+            internal::write_json_stream(
+                [&](std::string_view block) {
+                    file.write(block.data(), block.size());
+                },
+                tome, schema, options.indent);
+            file << '\n';
+            file.close();
+            if (!file)
+                throw WriteError("could not write file " + temp);
+        });
+    else if (auto format = binary_format(filename); format)
+        write_via_temp_file(filename, [&](std::string const &temp) {
+            auto file = std::ofstream(temp, std::ios::binary);
+            if (!file)
+                throw WriteError("could not open file " + temp);
+            internal::write_binary_stream(
+                [&](std::string_view block) {
+                    file.write(block.data(), block.size());
+                },
+                tome, schema, *format);
+            file.close();
+            if (!file)
+                throw WriteError("could not write file " + temp);
+        });
+    else if ((filename.ends_with(".h5") || filename.ends_with(".hdf5")) &&
+             options.base)
     {
+        // in place: copying the file first would defeat the purpose
+        auto lock = internal::hdf5_lock();
         auto file =
-            HighFive::File(std::string(filename), HighFive::File::ReadWrite |
-                                                      HighFive::File::Create |
-                                                      HighFive::File::Truncate);
-        internal::write_hdf5(file, "/", tome, schema);
+            HighFive::File(std::string(filename), HighFive::File::ReadWrite);
+        internal::update_hdf5(file, "/", tome, *options.base, schema);
     }
+    else if (filename.ends_with(".h5") || filename.ends_with(".hdf5"))
+        write_via_temp_file(filename, [&](std::string const &temp) {
+            auto lock = internal::hdf5_lock();
+            auto file = HighFive::File(temp, HighFive::File::ReadWrite |
+                                                 HighFive::File::Create |
+                                                 HighFive::File::Truncate);
+            internal::write_hdf5(file, "/", tome, schema);
+        });
+    else if (filename.ends_with(".scb"))
+        write_via_temp_file(filename, [&](std::string const &temp) {
+            internal::write_scb(temp, tome, schema);
+        });
     else
         throw std::runtime_error("unknown file ending when writing a file");
 }
@@ -47,25 +175,39 @@ void scribe::write_file(std::string_view filename, Tome const &tome,
 void scribe::read_json_string(Tome &tome, std::string_view json,
                               Schema const &schema)
 {
-    auto j = nlohmann::json::parse(json, nullptr, true, true);
-    internal::read_json(&tome, j, schema);
+    internal::read_json_stream(&tome, json, schema);
+    internal::seal(tome);
 }
 
 void scribe::write_json_string(std::string &s, Tome const &tome,
-                               Schema const &schema)
+                               Schema const &schema,
+                               WriteOptions const &options)
 {
-    nlohmann::json j;
-    internal::write_json(j, tome, schema);
-    s = j.dump(4);
+    s.clear();
+    internal::write_json_stream([&](std::string_view block) { s += block; },
+                                tome, schema, options.indent);
 }
 
 void scribe::validate_file(std::string_view filename, Schema const &s)
 {
     if (filename.ends_with(".json"))
     {
-        auto j = nlohmann::json::parse(std::ifstream(std::string(filename)),
-                                       nullptr, true, true);
-        internal::read_json(nullptr, j, s);
+        auto file = std::ifstream(std::string(filename));
+        if (!file)
+            throw ReadError("could not open file " + std::string(filename));
+        internal::read_json_stream(nullptr, file, s);
+    }
+    else if (auto format = binary_format(filename); format)
+    {
+        auto file = std::ifstream(std::string(filename), std::ios::binary);
+        if (!file)
+            throw ReadError("could not open file " + std::string(filename));
+        internal::read_binary_stream(nullptr, file, s, *format);
+    }
+    else if (filename.ends_with(".scb"))
+    {
+        auto file = ScbFile(filename);
+        internal::read_scb(nullptr, file, s);
     }
     else
         throw std::runtime_error("unknown file ending when validating a file");
@@ -73,6 +215,10 @@ void scribe::validate_file(std::string_view filename, Schema const &s)
 
 scribe::Schema scribe::guess_schema(Tome const &tome)
 {
+    // avoid loading lazy values if possible
+    if (auto schema = tome.lazy_schema(); schema)
+        return *schema;
+
     return tome.visit<Schema>(
         overloaded{[](bool_t) { return Schema::boolean(); },
                    [](int8_t) { return Schema::number(NumType::INT8); },
@@ -92,18 +238,18 @@ scribe::Schema scribe::guess_schema(Tome const &tome)
                        return Schema::number(NumType::COMPLEX_FLOAT64);
                    },
                    [](string_t) { return Schema::string(); },
-                   [](Tome::dict_type t) {
+                   [](Tome::dict_type const &t) {
                        DictSchema dict_schema;
                        for (auto const &[key, value] : t)
                        {
                            ItemSchema item_schema;
-                           item_schema.key = key;
+                           item_schema.key = key.str();
                            item_schema.schema = guess_schema(value);
                            dict_schema.items.push_back(item_schema);
                        }
                        return Schema(std::move(dict_schema));
                    },
-                   [](Tome::array_type a) {
+                   [](Tome::array_type const &a) {
                        ArraySchema array_schema;
                        array_schema.shape = std::vector<int64_t>();
                        for (auto dim : a.shape())
@@ -113,5 +259,13 @@ scribe::Schema scribe::guess_schema(Tome const &tome)
                        else
                            array_schema.elements = Schema::any();
                        return Schema(std::move(array_schema));
+                   },
+                   []<NumericArrayType A>(A const &a) {
+                       using T = typename A::value_type;
+                       ArraySchema array_schema;
+                       array_schema.elements = Schema::number(num_type_of<T>());
+                       array_schema.shape = std::vector<int64_t>(
+                           a.shape().begin(), a.shape().end());
+                       return Schema(std::move(array_schema));
                    }});
 }
@@ -1,10 +1,21 @@
 #include "catch2/catch_test_macros.hpp"
 
+#include "codegen_test.h" // generated from 'codegen_schema.json'
 #include "fmt/format.h"
+#include "highfive/highfive.hpp"
 #include "scribe/codegen.h"
+#include <filesystem>
+#include <fstream>
 
 using scribe::Schema;
 
+namespace {
+std::string temp_filename(std::string_view name)
+{
+    return (std::filesystem::temp_directory_path() / name).string();
+}
+} // namespace
+
 TEST_CASE("codegen", "[codegen]")
 {
     auto schema = Schema::from_json(R"(
@@ -25,5 +36,112 @@ TEST_CASE("codegen", "[codegen]")
     }
     )"_json);
 
-    CHECK_NOTHROW(generate_cpp(schema));
-}
\ No newline at end of file
+    auto source = generate_cpp(schema);
+    CHECK(source.find("void read(") != std::string::npos);
+    CHECK(source.find("void write(") != std::string::npos);
+}
+
+TEST_CASE("codegen storage hints", "[codegen]")
+{
+    auto schema = Schema::from_json(R"(
+    {
+        "type": "dict",
+        "items": [
+            {
+                "key": "a",
+                "type": "array",
+                "elements": {"type": "float32"},
+                "hdf5": {"chunk_size": [16], "deflate": 2, "fletcher32": true},
+                "json": {"encoding": "base64"}
+            },
+            {
+                "key": "b",
+                "type": "array",
+                "elements": {"type": "float32"}
+            }
+        ]
+    }
+    )"_json);
+
+    auto source = generate_cpp(schema);
+    CHECK(source.find("auto hints = scribe::StorageHints();\n"
+                      "        hints.hdf5.chunk_size = "
+                      "std::vector<int64_t>{16};\n"
+                      "        hints.hdf5.deflate = 2;\n"
+                      "        hints.hdf5.fletcher32 = true;\n"
+                      "        hints.json.base64 = true;\n"
+                      "        write(data.a, writer, \"a\", hints);\n") !=
+          std::string::npos);
+    CHECK(source.find("write(data.b, writer, \"b\");") != std::string::npos);
+}
+
+TEST_CASE("generated code round trip", "[codegen]")
+{
+    auto data = codegen_test();
+    data.name = "round trip";
+    data.count = 42;
+    data.flag = true;
+    data.values = scribe::Array<double>::from_shape({4, 3});
+    for (size_t i = 0; i < data.values.size(); ++i)
+        data.values.storage()[i] = 0.25 * double(i);
+    data.phases = scribe::Array<std::complex<double>>::from_shape({2});
+    data.phases.storage()[0] = {1.0, -1.0};
+    data.phases.storage()[1] = {0.5, 2.0};
+    data.params.x = 1.5f;
+
+    auto check = [&](codegen_test const &other) {
+        CHECK(other.name == data.name);
+        CHECK(other.count == data.count);
+        CHECK(other.flag == data.flag);
+        CHECK(other.values == data.values);
+        CHECK(other.phases == data.phases);
+        CHECK(other.params.x == data.params.x);
+    };
+
+    SECTION("json")
+    {
+        auto filename = temp_filename("scribe_test_codegen.json");
+        scribe::write_file(filename, data);
+
+        // base64 as requested by the schema
+        auto j = nlohmann::json::parse(std::ifstream(filename));
+        CHECK(j["values"]["dtype"] == "float64");
+        CHECK(j["values"]["shape"] == nlohmann::json({4, 3}));
+        CHECK(j["phases"].is_array());
+
+        auto other = codegen_test();
+        scribe::read_file(other, filename);
+        check(other);
+
+        data.count.reset();
+        scribe::write_file(filename, data);
+        scribe::read_file(other, filename);
+        check(other);
+
+        std::filesystem::remove(filename);
+    }
+
+    SECTION("hdf5")
+    {
+        auto filename = temp_filename("scribe_test_codegen.h5");
+        scribe::write_file(filename, data);
+
+        // chunked and compressed as requested by the schema
+        {
+            auto file = HighFive::File(filename, HighFive::File::ReadOnly);
+            auto props = file.getDataSet("/values").getCreatePropertyList();
+            REQUIRE(H5Pget_layout(props.getId()) == H5D_CHUNKED);
+            hsize_t chunk[2];
+            REQUIRE(H5Pget_chunk(props.getId(), 2, chunk) == 2);
+            CHECK(chunk[0] == 2);
+            CHECK(chunk[1] == 3);
+            CHECK(H5Pget_nfilters(props.getId()) == 2);
+        }
+
+        auto other = codegen_test();
+        scribe::read_file(other, filename);
+        check(other);
+
+        std::filesystem::remove(filename);
+    }
+}
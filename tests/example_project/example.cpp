@@ -4,9 +4,9 @@
 
 int main(int argc, char **argv)
 {
-    if (argc != 2)
+    if (argc != 2 && argc != 3)
     {
-        std::cerr << "Usage: " << argv[0] << " <file.json>\n";
+        std::cerr << "Usage: " << argv[0] << " <file.json> [<output file>]\n";
         return 1;
     }
     mystruct data;
@@ -30,4 +30,7 @@ int main(int argc, char **argv)
     for (auto &elem : data.field5)
         std::cout << elem << " ";
     std::cout << "\n";
-}
\ No newline at end of file
+
+    if (argc == 3)
+        scribe::write_file(argv[2], data);
+}
@@ -0,0 +1,777 @@
+#include "catch2/catch_test_macros.hpp"
+
+#include "fmt/format.h"
+#include "highfive/highfive.hpp"
+#include "scribe/async.h"
+#include "scribe/io_hdf5.h"
+#include "scribe/tome.h"
+#include <filesystem>
+#include <future>
+
+using scribe::Schema;
+using scribe::Tome;
+
+namespace {
+std::string temp_filename(std::string_view name)
+{
+    return (std::filesystem::temp_directory_path() / name).string();
+}
+
+// numeric array whose elements live in (shared) memory it does not own, as
+// for arrays read from a .scb file
+scribe::Array<double> external_array(std::vector<double> values,
+                                     std::vector<size_t> shape)
+{
+    auto buffer = std::make_shared<std::vector<double>>(std::move(values));
+    auto strides = std::vector<ptrdiff_t>(shape.size());
+    xt::compute_strides(shape, xt::layout_type::row_major, strides);
+    return scribe::Array<double>(scribe::internal::ArrayStorage<double>(
+                                     buffer->data(), buffer->size(), buffer),
+                                 std::move(shape), std::move(strides));
+}
+} // namespace
+
+TEST_CASE("hdf5 storage hints", "[hdf5]")
+{
+    auto schema = Schema::from_json(R"(
+    {
+        "type": "dict",
+        "items": [
+            {
+                "key": "field",
+                "type": "array",
+                "shape": [4, 6],
+                "elements": {
+                    "type": "float64"
+                },
+                "hdf5": {
+                    "chunk_size": [2, -1],
+                    "deflate": 4,
+                    "shuffle": true,
+                    "fletcher32": true
+                }
+            }
+        ]
+    }
+    )"_json);
+
+    SECTION("schema round-trip")
+    {
+        auto j = schema.to_json();
+        auto const &hints = j["items"][0]["hdf5"];
+        REQUIRE(hints["chunk_size"] == nlohmann::json({2, -1}));
+        REQUIRE(hints["deflate"] == 4);
+        REQUIRE(hints["shuffle"] == true);
+        REQUIRE(hints["fletcher32"] == true);
+        REQUIRE(!hints.contains("szip"));
+    }
+
+    SECTION("invalid hints")
+    {
+        REQUIRE_THROWS(Schema::from_json(R"(
+        {
+            "type": "array",
+            "shape": [4, 6],
+            "elements": {"type": "float64"},
+            "hdf5": {"chunk_size": [2]}
+        }
+        )"_json));
+        REQUIRE_THROWS(Schema::from_json(R"(
+        {
+            "type": "array",
+            "elements": {"type": "float64"},
+            "hdf5": {"deflate": 12}
+        }
+        )"_json));
+    }
+
+    SECTION("chunked and compressed dataset")
+    {
+        auto filename = temp_filename("scribe_test_storage_hints.h5");
+
+        Tome tome;
+        tome["field"] = Tome::array_from_shape({4, 6});
+        for (int i = 0; i < 4; i++)
+            for (int j = 0; j < 6; j++)
+                tome["field"].as_array()(i, j) = 0.5 * (i * 6 + j);
+        write_file(filename, tome, schema);
+
+        {
+            auto file = HighFive::File(filename, HighFive::File::ReadOnly);
+            auto props = file.getDataSet("/field").getCreatePropertyList();
+            REQUIRE(H5Pget_layout(props.getId()) == H5D_CHUNKED);
+            hsize_t chunk[2];
+            REQUIRE(H5Pget_chunk(props.getId(), 2, chunk) == 2);
+            REQUIRE(chunk[0] == 2);
+            REQUIRE(chunk[1] == 6);
+            REQUIRE(H5Pget_nfilters(props.getId()) == 3);
+        }
+
+        Tome tome2;
+        read_file(tome2, filename, schema);
+        auto const &a = tome2["field"].as_numeric_array<double>();
+        REQUIRE(a.shape() == std::vector<size_t>{4, 6});
+        for (int i = 0; i < 4; i++)
+            for (int j = 0; j < 6; j++)
+                REQUIRE(a(i, j) == 0.5 * (i * 6 + j));
+
+        std::filesystem::remove(filename);
+    }
+}
+
+namespace {
+template <class T> void check_numeric_roundtrip(std::string_view type)
+{
+    auto schema = Schema::from_json(nlohmann::json{
+        {"type", "dict"},
+        {"items",
+         {{{"key", "data"},
+           {"type", "array"},
+           {"shape", {2, 3}},
+           {"elements", {{"type", type}}}}}}});
+    auto filename = temp_filename("scribe_test_numeric_roundtrip.h5");
+
+    auto a = scribe::Array<T>::from_shape({2, 3});
+    for (size_t i = 0; i < a.size(); ++i)
+        a.storage()[i] = static_cast<T>(i + 1);
+    Tome tome;
+    tome["data"] = Tome::array(a);
+    write_file(filename, tome, schema);
+
+    Tome tome2;
+    read_file(tome2, filename, schema);
+    REQUIRE(tome2["data"].as_numeric_array<T>() == a);
+
+    std::filesystem::remove(filename);
+}
+} // namespace
+
+TEST_CASE("hdf5 numeric arrays", "[hdf5]")
+{
+    SECTION("compact arrays of all types")
+    {
+        check_numeric_roundtrip<scribe::int8_t>("int8");
+        check_numeric_roundtrip<scribe::int16_t>("int16");
+        check_numeric_roundtrip<scribe::int32_t>("int32");
+        check_numeric_roundtrip<scribe::int64_t>("int64");
+        check_numeric_roundtrip<scribe::uint8_t>("uint8");
+        check_numeric_roundtrip<scribe::uint16_t>("uint16");
+        check_numeric_roundtrip<scribe::uint32_t>("uint32");
+        check_numeric_roundtrip<scribe::uint64_t>("uint64");
+        check_numeric_roundtrip<scribe::float32_t>("float32");
+        check_numeric_roundtrip<scribe::float64_t>("float64");
+        check_numeric_roundtrip<scribe::complex_float32_t>("complex_float32");
+        check_numeric_roundtrip<scribe::complex_float64_t>("complex_float64");
+    }
+
+    SECTION("element type has to match the schema")
+    {
+        auto schema = Schema::from_json(R"(
+        {
+            "type": "dict",
+            "items": [
+                {
+                    "key": "data",
+                    "type": "array",
+                    "elements": {"type": "float32"}
+                }
+            ]
+        }
+        )"_json);
+        Tome tome;
+        tome["data"] = Tome::array(std::vector<double>{1.0, 2.0});
+        auto filename = temp_filename("scribe_test_type_mismatch.h5");
+        REQUIRE_THROWS_AS(write_file(filename, tome, schema),
+                          scribe::ValidationError);
+        std::filesystem::remove(filename);
+    }
+
+    SECTION("generic array of numbers")
+    {
+        auto schema = Schema::from_json(R"(
+        {
+            "type": "dict",
+            "items": [
+                {
+                    "key": "data",
+                    "type": "array",
+                    "shape": [-1],
+                    "elements": {"type": "int32"}
+                }
+            ]
+        }
+        )"_json);
+        Tome tome;
+        tome["data"] = Tome::array(std::vector<Tome>{1, 2, 3});
+        auto filename = temp_filename("scribe_test_generic_array.h5");
+        write_file(filename, tome, schema);
+
+        Tome tome2;
+        read_file(tome2, filename, schema);
+        REQUIRE(tome2["data"].get<std::vector<int>>() ==
+                std::vector<int>{1, 2, 3});
+        std::filesystem::remove(filename);
+    }
+}
+
+TEST_CASE("hdf5 arrays of external memory", "[hdf5]")
+{
+    auto schema = Schema::from_json(R"(
+    {
+        "type": "dict",
+        "items": [
+            {
+                "key": "a",
+                "type": "array",
+                "shape": [2, 3],
+                "elements": {"type": "float64"},
+                "hdf5": {"chunk_size": [1, -1], "deflate": 1}
+            },
+            {
+                "key": "b",
+                "type": "array",
+                "elements": {"type": "float64"}
+            }
+        ]
+    }
+    )"_json);
+    auto filename = temp_filename("scribe_test_external_arrays.h5");
+
+    Tome tome;
+    tome["a"] = Tome::array(external_array({1, 2, 3, 4, 5, 6}, {2, 3}));
+    tome["b"] = Tome::array(external_array({0.5, -0.5}, {2}));
+    write_file(filename, tome, schema);
+    REQUIRE(std::as_const(tome)["a"].as_numeric_array<double>()
+                .storage()
+                .is_view());
+
+    Tome tome2;
+    read_file(tome2, filename, schema);
+    REQUIRE(tome2 == tome);
+
+    // HDF5 reads into arrays of their own
+    auto const &b = std::as_const(tome2)["b"].as_numeric_array<double>();
+    REQUIRE(!b.storage().is_view());
+    REQUIRE(b(1) == -0.5);
+
+    std::filesystem::remove(filename);
+}
+
+TEST_CASE("hdf5 scalars", "[hdf5]")
+{
+    auto schema = Schema::from_json(R"(
+    {
+        "type": "dict",
+        "items": [
+            {"key": "a", "type": "int32"},
+            {"key": "b", "type": "float32"},
+            {"key": "c", "type": "complex_float64"}
+        ]
+    }
+    )"_json);
+    auto filename = temp_filename("scribe_test_scalars.h5");
+    Tome tome;
+    tome["a"] = int32_t(-5);
+    tome["b"] = 0.5; // converted to the type given by the schema
+    tome["c"] = std::complex<double>(1.0, 2.0);
+    write_file(filename, tome, schema);
+
+    Tome tome2;
+    read_file(tome2, filename, schema);
+    REQUIRE(tome2["a"].as<int32_t>() == -5);
+    REQUIRE(tome2["b"].as<float>() == 0.5f);
+    REQUIRE(tome2["c"].as<std::complex<double>>() ==
+            std::complex<double>(1.0, 2.0));
+
+    tome["a"] = int64_t(1) << 40;
+    REQUIRE_THROWS_AS(write_file(filename, tome, schema),
+                      scribe::ValidationError);
+    std::filesystem::remove(filename);
+}
+
+TEST_CASE("hdf5 partial reads", "[hdf5]")
+{
+    auto schema = Schema::from_json(R"(
+    {
+        "type": "dict",
+        "items": [
+            {
+                "key": "field",
+                "type": "array",
+                "shape": [4, 6],
+                "elements": {"type": "int32"}
+            }
+        ]
+    }
+    )"_json);
+    auto filename = temp_filename("scribe_test_partial_reads.h5");
+    auto a = scribe::Array<int32_t>::from_shape({4, 6});
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 6; j++)
+            a(i, j) = 10 * i + j;
+    Tome tome;
+    tome["field"] = Tome::array(a);
+    write_file(filename, tome, schema);
+
+    SECTION("into a Tome")
+    {
+        Tome slice;
+        read_file(slice, filename, "/field",
+                  scribe::Hyperslab{{1, 2}, {2, 3}, {2, 1}});
+        auto const &b = slice.as_numeric_array<int32_t>();
+        REQUIRE(b.shape() == std::vector<size_t>{2, 3});
+        for (int i = 0; i < 2; i++)
+            for (int j = 0; j < 3; j++)
+                REQUIRE(b(i, j) == a(1 + 2 * i, 2 + j));
+    }
+
+    SECTION("using the typed reader")
+    {
+        auto reader = scribe::Hdf5Reader(filename);
+        scribe::Array<int32_t> b;
+        reader.read(b, "field", scribe::Hyperslab{{3, 0}, {1, 6}, {}});
+        REQUIRE(b.shape() == std::vector<size_t>{1, 6});
+        for (int j = 0; j < 6; j++)
+            REQUIRE(b(0, j) == a(3, j));
+    }
+
+    SECTION("out of bounds")
+    {
+        Tome slice;
+        REQUIRE_THROWS_AS(read_file(slice, filename, "/field",
+                                    scribe::Hyperslab{{3, 0}, {2, 6}, {}}),
+                          scribe::ReadError);
+        REQUIRE_THROWS_AS(read_file(slice, filename, "/field",
+                                    scribe::Hyperslab{{0}, {1}, {}}),
+                          scribe::ReadError);
+
+        // would wrap around when computing the last index naively
+        size_t huge = size_t(1) << 63;
+        auto slab = scribe::Hyperslab{{1, 0}, {3, 1}, {huge, 1}};
+        REQUIRE_THROWS_AS(read_file(slice, filename, "/field", slab),
+                          scribe::ReadError);
+    }
+
+    std::filesystem::remove(filename);
+}
+
+TEST_CASE("hdf5 lazy reading", "[hdf5]")
+{
+    auto filename = temp_filename("scribe_test_lazy.h5");
+    {
+        auto file = HighFive::File(filename, HighFive::File::ReadWrite |
+                                                 HighFive::File::Create |
+                                                 HighFive::File::Truncate);
+        file.createDataSet("/a", std::vector<double>{1.0, 2.0, 3.0});
+        file.createDataSet("/b/c", int32_t(42));
+        file.createDataSet("/d", std::vector<int32_t>{7});
+    }
+
+    Tome tome;
+    read_file(tome, filename, Schema::any(), {.lazy = true});
+    REQUIRE(tome.is_lazy());
+    REQUIRE(!tome.is_loaded());
+
+    // metadata is enough to guess the schema
+    auto schema = guess_schema(tome["b"]);
+    REQUIRE(schema.to_json()["items"][0]["type"] == "int32");
+    REQUIRE(tome.is_loaded());
+    REQUIRE(!tome["a"].is_loaded());
+    REQUIRE(!tome["b"]["c"].is_loaded());
+
+    // access loads the data
+    auto const &a = tome["a"].as_numeric_array<double>();
+    REQUIRE(a.shape() == std::vector<size_t>{3});
+    REQUIRE(a(2) == 3.0);
+    REQUIRE(tome["a"].is_loaded());
+    REQUIRE(tome["b"]["c"].get<int>() == 42);
+
+    // only rank-0 datasets are scalars, single elements stay arrays
+    REQUIRE(tome["d"].as_numeric_array<int32_t>().shape() ==
+            std::vector<size_t>{1});
+
+    // eviction unloads, next access loads again
+    tome.evict();
+    REQUIRE(!tome.is_loaded());
+    REQUIRE(tome["b"]["c"].get<int>() == 42);
+
+    std::filesystem::remove(filename);
+}
+
+TEST_CASE("hdf5 parallel reads", "[hdf5]")
+{
+    auto schema = Schema::from_json(R"(
+    {
+        "type": "dict",
+        "items": [
+            {"key": "a", "type": "array", "elements": {"type": "float64"}},
+            {"key": "b", "type": "array", "elements": {"type": "int32"}},
+            {
+                "key": "c",
+                "type": "array",
+                "shape": [100, 10],
+                "elements": {"type": "float32"},
+                "hdf5": {"chunk_size": [10, -1], "deflate": 1}
+            },
+            {
+                "key": "sub",
+                "type": "dict",
+                "items": [
+                    {"key": "d", "type": "int64"},
+                    {
+                        "key": "e",
+                        "type": "array",
+                        "elements": {"type": "complex_float64"}
+                    }
+                ]
+            }
+        ]
+    }
+    )"_json);
+    auto filename = temp_filename("scribe_test_parallel.h5");
+
+    Tome tome;
+    auto a = scribe::Array<double>::from_shape({1000});
+    auto b = scribe::Array<int32_t>::from_shape({20, 30});
+    auto c = scribe::Array<float>::from_shape({100, 10});
+    auto e = scribe::Array<std::complex<double>>::from_shape({7});
+    for (size_t i = 0; i < a.size(); ++i)
+        a.data()[i] = 0.5 * i;
+    for (size_t i = 0; i < b.size(); ++i)
+        b.data()[i] = -int32_t(i);
+    for (size_t i = 0; i < c.size(); ++i)
+        c.data()[i] = 0.25f * i;
+    for (size_t i = 0; i < e.size(); ++i)
+        e.data()[i] = std::complex<double>(i, -1.0 * i);
+    tome["a"] = Tome::array(a);
+    tome["b"] = Tome::array(b);
+    tome["c"] = Tome::array(c); // chunked+compressed -> read by HDF5 itself
+    tome["sub"]["d"] = int64_t(7);
+    tome["sub"]["e"] = Tome::array(e);
+    write_file(filename, tome, schema);
+
+    SECTION("with schema")
+    {
+        Tome tome2;
+        read_file(tome2, filename, schema, {.num_threads = 4});
+        REQUIRE(tome2["a"].as_numeric_array<double>() == a);
+        REQUIRE(tome2["b"].as_numeric_array<int32_t>() == b);
+        REQUIRE(tome2["c"].as_numeric_array<float>() == c);
+        REQUIRE(tome2["sub"]["d"].as<int64_t>() == 7);
+        REQUIRE(tome2["sub"]["e"].as_numeric_array<std::complex<double>>() ==
+                e);
+    }
+
+    SECTION("without schema")
+    {
+        Tome tome2;
+        read_file(tome2, filename, Schema::any(), {.num_threads = 3});
+        REQUIRE(tome2["a"].as_numeric_array<double>() == a);
+        REQUIRE(tome2["c"].as_numeric_array<float>() == c);
+        REQUIRE(tome2["sub"]["e"].as_numeric_array<std::complex<double>>() ==
+                e);
+    }
+
+    SECTION("using the typed reader")
+    {
+        auto reader = scribe::Hdf5Reader(filename, 2);
+        scribe::Array<double> a2;
+        scribe::Array<float> c2;
+        reader.read(a2, "a");
+        reader.read(c2, "c");
+        reader.finish();
+        REQUIRE(a2 == a);
+        REQUIRE(c2 == c);
+    }
+
+    std::filesystem::remove(filename);
+}
+
+TEST_CASE("hdf5 arrays stored with a different type", "[hdf5]")
+{
+    auto filename = temp_filename("scribe_test_converted.h5");
+    auto narrow = Schema::from_json(R"(
+    {
+        "type": "dict",
+        "items": [
+            {"key": "a", "type": "array", "elements": {"type": "int32"}}
+        ]
+    }
+    )"_json);
+
+    // stored as int64, read as int32: values are checked, not clamped
+    for (int threads : {1, 4})
+    {
+        Tome tome;
+        tome["a"] = Tome::array(std::vector<int64_t>{1, -2, 3});
+        write_file(filename, tome, Schema::any());
+        Tome tome2;
+        read_file(tome2, filename, narrow, {.num_threads = threads});
+        auto const &a = std::as_const(tome2)["a"].as_numeric_array<int32_t>();
+        REQUIRE(a.size() == 3);
+        REQUIRE(a(1) == -2);
+
+        tome["a"] = Tome::array(std::vector<int64_t>{1, int64_t(1) << 40});
+        write_file(filename, tome, Schema::any());
+        REQUIRE_THROWS_AS(
+            read_file(tome2, filename, narrow, {.num_threads = threads}),
+            scribe::ValidationError);
+
+        auto reader = scribe::Hdf5Reader(filename, threads);
+        scribe::Array<int32_t> a2;
+        REQUIRE_THROWS_AS(reader.read(a2, "a"), scribe::ValidationError);
+    }
+
+    std::filesystem::remove(filename);
+}
+
+TEST_CASE("hdf5 async writes", "[hdf5]")
+{
+    auto filename = temp_filename("scribe_test_async.h5");
+    auto other = temp_filename("scribe_test_async_other.h5");
+    Tome tome;
+    tome["x"] = Tome::array(std::vector<double>{1, 2, 3});
+    write_file(other, tome, Schema::any());
+
+    auto &x = tome["x"].as_numeric_array<double>();
+    {
+        auto writer = scribe::AsyncWriter(4);
+        std::vector<std::future<void>> done;
+        for (int i = 0; i < 4; ++i)
+        {
+            done.push_back(writer.write(filename, tome, Schema::any()));
+
+            // while the writer is busy: modify the tome through a reference
+            // from before the copy, and read another HDF5 file
+            x(0) = i + 2;
+            Tome tome2;
+            read_file(tome2, other, Schema::any());
+            REQUIRE(tome2["x"].as_numeric_array<double>()(0) == 1);
+        }
+        for (auto &f : done)
+            REQUIRE_NOTHROW(f.get());
+    }
+
+    Tome tome3;
+    read_file(tome3, filename, Schema::any());
+    REQUIRE(tome3["x"].as_numeric_array<double>()(0) == 4);
+    std::filesystem::remove(filename);
+    std::filesystem::remove(other);
+}
+
+TEST_CASE("hdf5 object index", "[hdf5]")
+{
+    auto filename = temp_filename("scribe_test_index.h5");
+    {
+        auto file = HighFive::File(filename, HighFive::File::ReadWrite |
+                                                 HighFive::File::Create |
+                                                 HighFive::File::Truncate);
+        file.createDataSet("/a", std::vector<double>{1.0, 2.0, 3.0});
+        file.createDataSet("/b/c", int32_t(42));
+        file.createDataSet("/b/s", std::string("foo"));
+        file.createSoftLink("/link", file.getDataSet("/a"));
+    }
+
+    auto file = HighFive::File(filename, HighFive::File::ReadOnly);
+    auto root = file.getGroup("/");
+    auto b = file.getGroup("/b");
+    auto index = scribe::internal::Hdf5Index(file);
+
+    auto const *a = index.find(root, "a", "/a");
+    REQUIRE(a);
+    REQUIRE(a->type == HighFive::ObjectType::Dataset);
+    REQUIRE(a->num_type == scribe::NumType::FLOAT64);
+    REQUIRE(a->shape == std::vector<size_t>{3});
+    REQUIRE(a->offset.has_value());
+    REQUIRE(index.find(root, "b", "/b")->type == HighFive::ObjectType::Group);
+    REQUIRE(index.find(b, "c", "/b/c")->shape.empty());
+    REQUIRE(index.find(b, "s", "/b/s")->is_string);
+    REQUIRE(!index.find(b, "x", "/b/x"));
+
+    // not seen by the visit, described on first access
+    REQUIRE(index.find(root, "link", "/link")->num_type ==
+            scribe::NumType::FLOAT64);
+
+    std::filesystem::remove(filename);
+}
+
+TEST_CASE("hdf5 append", "[hdf5]")
+{
+    auto schema = Schema::from_json(R"(
+    {
+        "type": "dict",
+        "items": [
+            {"key": "name", "type": "string"},
+            {
+                "key": "energy",
+                "type": "array",
+                "shape": [-1],
+                "elements": {"type": "float64"}
+            },
+            {
+                "key": "field",
+                "type": "array",
+                "shape": [-1, 3],
+                "elements": {"type": "int32"},
+                "hdf5": {"chunk_size": [4, -1]}
+            }
+        ]
+    }
+    )"_json);
+    auto filename = temp_filename("scribe_test_append.h5");
+    std::filesystem::remove(filename);
+
+    {
+        auto out = scribe::Appender(filename, schema);
+        Tome meta;
+        meta["name"] = "test";
+        out.append(meta);
+
+        // single rows
+        for (int step = 0; step < 5; ++step)
+        {
+            auto row = scribe::Array<int32_t>::from_shape({3});
+            for (int j = 0; j < 3; ++j)
+                row(j) = step * 3 + j;
+            Tome x;
+            x["energy"] = 0.5 * step;
+            x["field"] = Tome::array(row);
+            out.append(x);
+        }
+        out.flush();
+
+        // multiple rows at once
+        Tome x;
+        x["energy"] = Tome::array(std::vector<double>{2.5, 3.0});
+        out.append(x);
+
+        Tome bad;
+        bad["name"] = "again";
+        REQUIRE_THROWS_AS(out.append(bad), scribe::WriteError);
+        bad = Tome();
+        bad["field"] = Tome::array(scribe::Array<int32_t>::from_shape({2}));
+        REQUIRE_THROWS_AS(out.append(bad), scribe::ValidationError);
+        bad["field"] = Tome::array(scribe::Array<double>::from_shape({3}));
+        REQUIRE_THROWS_AS(out.append(bad), scribe::ValidationError);
+    }
+
+    {
+        auto file = HighFive::File(filename, HighFive::File::ReadOnly);
+        auto dataset = file.getDataSet("/field");
+        REQUIRE(dataset.getSpace().getMaxDimensions()[0] ==
+                HighFive::DataSpace::UNLIMITED);
+        auto props = dataset.getCreatePropertyList();
+        hsize_t chunk[2];
+        REQUIRE(H5Pget_chunk(props.getId(), 2, chunk) == 2);
+        REQUIRE(chunk[0] == 4);
+        REQUIRE(chunk[1] == 3);
+    }
+
+    Tome tome;
+    read_file(tome, filename, schema);
+    REQUIRE(tome["name"].as_string() == "test");
+    auto const &energy = tome["energy"].as_numeric_array<double>();
+    REQUIRE(energy.shape() == std::vector<size_t>{7});
+    for (size_t i = 0; i < 7; ++i)
+        REQUIRE(energy(i) == 0.5 * i);
+    auto const &field = tome["field"].as_numeric_array<int32_t>();
+    REQUIRE(field.shape() == std::vector<size_t>{5, 3});
+    for (int i = 0; i < 5; ++i)
+        for (int j = 0; j < 3; ++j)
+            REQUIRE(field(i, j) == i * 3 + j);
+
+    // re-opening continues the existing datasets
+    {
+        auto out = scribe::Appender(filename, schema);
+        Tome x;
+        x["energy"] = 3.5;
+        out.append(x);
+    }
+    read_file(tome, filename, schema);
+    REQUIRE(tome["energy"].shape() == std::vector<size_t>{8});
+    REQUIRE(tome["energy"].as_numeric_array<double>()(7) == 3.5);
+
+    std::filesystem::remove(filename);
+}
+
+TEST_CASE("hdf5 incremental writes", "[hdf5]")
+{
+    auto schema = Schema::from_json(R"(
+    {
+        "type": "dict",
+        "items": [
+            {
+                "key": "geometry",
+                "type": "array",
+                "shape": [-1],
+                "elements": {"type": "float64"}
+            },
+            {
+                "key": "field",
+                "type": "array",
+                "shape": [-1],
+                "elements": {"type": "float64"}
+            },
+            {
+                "key": "params",
+                "type": "dict",
+                "items": [{"key": "n", "type": "int64"}]
+            },
+            {"key": "extra", "type": "string", "optional": true}
+        ]
+    }
+    )"_json);
+    auto filename = temp_filename("scribe_test_incremental.h5");
+
+    Tome tome;
+    tome["geometry"] = Tome::array(std::vector<double>{1, 2, 3});
+    tome["field"] = Tome::array(std::vector<double>{0, 0});
+    tome["params"]["n"] = Tome::integer(int64_t(1));
+    write_file(filename, tome, schema);
+    auto base = tome;
+
+    // modify the file behind our back, to see what is rewritten. Second
+    // names of datasets only see the update if it happens in place.
+    {
+        auto file = HighFive::File(filename, HighFive::File::ReadWrite);
+        file.getDataSet("/geometry").write(std::vector<double>{7, 8, 9});
+        for (auto path : {"/field", "/params/n"})
+            REQUIRE(H5Lcreate_hard(file.getId(), path, file.getId(),
+                                   (std::string(path) + "_link").c_str(),
+                                   H5P_DEFAULT, H5P_DEFAULT) >= 0);
+    }
+
+    tome["field"].as_numeric_array<double>()(1) = 5;
+    tome["params"]["n"] = Tome::integer(int64_t(2));
+    tome["extra"] = "hello";
+    write_file(filename, tome, schema, {.base = &base});
+
+    {
+        auto file = HighFive::File(filename, HighFive::File::ReadWrite);
+        auto field = file.getDataSet("/field_link").read<std::vector<double>>();
+        REQUIRE(field[1] == 5);
+        REQUIRE(file.getDataSet("/params/n_link").read<int64_t>() == 2);
+        file.unlink("field_link");
+        file.getGroup("params").unlink("n_link");
+    }
+
+    Tome tome2;
+    read_file(tome2, filename, schema);
+    REQUIRE(tome2["geometry"].as_numeric_array<double>()(0) == 7);
+    REQUIRE(tome2["field"].as_numeric_array<double>()(1) == 5);
+    REQUIRE(tome2["params"]["n"].as<int64_t>() == 2);
+    REQUIRE(tome2["extra"].as_string() == "hello");
+
+    // changed shape and removed items
+    base = tome;
+    tome["field"] = Tome::array(std::vector<double>{1, 2, 3, 4});
+    tome.as_dict().erase("extra");
+    write_file(filename, tome, schema, {.base = &base});
+
+    read_file(tome2, filename, schema);
+    REQUIRE(tome2["geometry"].as_numeric_array<double>()(0) == 7);
+    REQUIRE(tome2["field"].shape() == std::vector<size_t>{4});
+    REQUIRE(!tome2.as_dict().contains("extra"));
+
+    std::filesystem::remove(filename);
+}
@@ -1,11 +1,57 @@
 #include "catch2/catch_test_macros.hpp"
 
 #include "fmt/format.h"
+#include "scribe/async.h"
+#include "scribe/io_json.h"
 #include "scribe/tome.h"
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <sstream>
 
 using scribe::Schema;
 using scribe::Tome;
 
+namespace {
+std::string temp_filename(std::string_view name)
+{
+    return (std::filesystem::temp_directory_path() / name).string();
+}
+
+// numeric array whose elements live in (shared) memory it does not own, as
+// for arrays read from a .scb file
+scribe::Array<double> external_array(std::vector<double> values,
+                                     std::vector<size_t> shape)
+{
+    auto buffer = std::make_shared<std::vector<double>>(std::move(values));
+    auto strides = std::vector<ptrdiff_t>(shape.size());
+    xt::compute_strides(shape, xt::layout_type::row_major, strides);
+    return scribe::Array<double>(scribe::internal::ArrayStorage<double>(
+                                     buffer->data(), buffer->size(), buffer),
+                                 std::move(shape), std::move(strides));
+}
+
+// same as the code generated by 'scribe codegen'
+struct Checkpoint
+{
+    int64_t step;
+    scribe::Array<double> x;
+};
+void read(Checkpoint &data, scribe::Reader auto &reader)
+{
+    using scribe::read;
+    read(data.step, reader, "step");
+    read(data.x, reader, "x");
+}
+void write(Checkpoint const &data, scribe::Writer auto &writer)
+{
+    using scribe::write;
+    write(data.step, writer, "step");
+    write(data.x, writer, "x");
+}
+} // namespace
+
 TEST_CASE("reading a tome from json", "[tome]")
 {
     SECTION("basic example")
@@ -84,9 +130,10 @@ TEST_CASE("reading a tome from json", "[tome]")
         REQUIRE(tome.shape().size() == 2);
         REQUIRE(tome.shape()[0] == 2);
         REQUIRE(tome.shape()[1] == 3);
-        REQUIRE(tome.as_array()(0, 0).is_integer());
-        REQUIRE(tome.as_array()(0, 0).get<int>() == 1);
-        REQUIRE(tome.as_array()(1, 2).get<int>() == 6);
+        // arrays of numbers are read into compact arrays
+        REQUIRE(tome.is_numeric_array());
+        REQUIRE(tome.as_numeric_array<int32_t>()(0, 0) == 1);
+        REQUIRE(tome.as_numeric_array<int32_t>()(1, 2) == 6);
 
         REQUIRE_THROWS(read_json_string(tome, j2, schema));
     }
@@ -120,4 +167,895 @@ TEST_CASE("reading a tome from json", "[tome]")
         REQUIRE_THROWS(read_json_string(tome, j2, schema));
         REQUIRE_THROWS(read_json_string(tome, j3, schema));
     }
-}
\ No newline at end of file
+}
+TEST_CASE("streaming json reader", "[tome]")
+{
+    auto schema = Schema::from_json(R"(
+    {
+        "type": "dict",
+        "items": [
+            {"key": "name", "type": "string"},
+            {"key": "z", "type": "complex_float64"},
+            {"key": "flag", "type": "bool", "optional": true},
+            {"key": "extra", "type": "any", "optional": true},
+            {
+                "key": "points",
+                "type": "array",
+                "shape": [-1],
+                "elements": {
+                    "type": "dict",
+                    "items": [
+                        {
+                            "key": "x",
+                            "type": "array",
+                            "shape": [2, 2],
+                            "elements": {"type": "float64"}
+                        }
+                    ]
+                }
+            }
+        ]
+    }
+    )"_json);
+
+    std::string j = R"(
+    {
+        "name": "foo", // comments are allowed
+        "z": [1.5, -2],
+        "points": [
+            {"x": [[1, 2], [3, 4]]},
+            {"x": [[5, 6], [7, 8.5]]}
+        ]
+    }
+    )";
+
+    SECTION("same result as reading from a document")
+    {
+        Tome tome, tome2;
+        scribe::internal::read_json_stream(&tome, j, schema);
+        scribe::internal::read_json(
+            &tome2, nlohmann::json::parse(j, nullptr, true, true), schema);
+        REQUIRE(fmt::format("{}", tome) == fmt::format("{}", tome2));
+        REQUIRE(tome["z"].get<std::complex<double>>() ==
+                std::complex<double>(1.5, -2.0));
+        REQUIRE(tome["points"].shape() == std::vector<size_t>{2});
+        REQUIRE(tome["points"][1]["x"].as_numeric_array<double>()(1, 1) ==
+                8.5);
+    }
+
+    SECTION("validation only")
+    {
+        // values of AnySchema are skipped when only validating
+        std::string j2 = R"({"name": "", "z": [0, 0], "points": [],
+                             "extra": {"a": [1, {"b": null}]}})";
+        REQUIRE_NOTHROW(scribe::internal::read_json_stream(nullptr, j, schema));
+        REQUIRE_NOTHROW(
+            scribe::internal::read_json_stream(nullptr, j2, schema));
+    }
+
+    SECTION("invalid input")
+    {
+        auto check = [&](std::string const &json) {
+            REQUIRE_THROWS_AS(
+                scribe::internal::read_json_stream(nullptr, json, schema),
+                scribe::ValidationError);
+        };
+        check(R"({"name": "foo", "z": [1, 2], "points": [], "bar": 1})");
+        check(R"({"name": "foo", "z": [1, 2]})");
+        check(R"({"name": "foo", "z": [1, 2, 3], "points": []})");
+        check(R"({"name": "foo", "z": [1, 2], "points": [{"x": [[1, 2]]}]})");
+        check(R"({"name": "foo", "z": [1, 2], "points": [{"x": [1, 2]}]})");
+        check(R"({"name": null, "z": [1, 2], "points": []})");
+        REQUIRE_THROWS_AS(
+            scribe::internal::read_json_stream(nullptr, "{\"name\":", schema),
+            scribe::ReadError);
+    }
+}
+
+TEST_CASE("compact numeric arrays in json", "[tome]")
+{
+    auto schema = Schema::from_json(R"(
+    {
+        "type": "dict",
+        "items": [
+            {
+                "key": "a",
+                "type": "array",
+                "shape": [2, -1],
+                "elements": {"type": "uint8"}
+            },
+            {
+                "key": "b",
+                "type": "array",
+                "shape": [-1],
+                "elements": {"type": "complex_float32"}
+            }
+        ]
+    }
+    )"_json);
+    std::string j = R"({"a": [[1, 2, 3], [4, 5, 6]], "b": [[1, 2], 3]})";
+
+    for (bool stream : {false, true})
+    {
+        Tome tome;
+        if (stream)
+            scribe::internal::read_json_stream(&tome, j, schema);
+        else
+            scribe::internal::read_json(&tome, nlohmann::json::parse(j),
+                                        schema);
+        auto const &a = tome["a"].as_numeric_array<uint8_t>();
+        REQUIRE(a.shape() == std::vector<size_t>{2, 3});
+        REQUIRE(a(1, 0) == 4);
+        auto const &b = tome["b"].as_numeric_array<std::complex<float>>();
+        REQUIRE(b.shape() == std::vector<size_t>{2});
+        REQUIRE(b(0) == std::complex<float>(1, 2));
+        REQUIRE(b(1) == std::complex<float>(3, 0));
+
+        // round trip
+        std::string s;
+        write_json_string(s, tome, schema);
+        Tome tome2;
+        read_json_string(tome2, s, schema);
+        REQUIRE(tome2["a"].as_numeric_array<uint8_t>() == a);
+        REQUIRE(tome2["b"].as_numeric_array<std::complex<float>>() == b);
+    }
+
+    REQUIRE_THROWS_AS(scribe::internal::read_json_stream(
+                          nullptr, R"({"a": [[1, 2], [3, 256]], "b": []})",
+                          schema),
+                      scribe::ValidationError);
+    REQUIRE_THROWS_AS(scribe::internal::read_json_stream(
+                          nullptr, R"({"a": [[1, 2], [3, 4.5]], "b": []})",
+                          schema),
+                      scribe::ValidationError);
+
+    // writing checks the shape and (after conversion) every single element
+    Tome tome;
+    tome["b"] = Tome::array(std::vector<std::complex<float>>{});
+    tome["a"] = Tome::array(std::vector<uint8_t>{1, 2, 3});
+    std::string s;
+    REQUIRE_THROWS_AS(write_json_string(s, tome, schema),
+                      scribe::ValidationError);
+    auto a = scribe::Array<int32_t>::from_shape({2, 2});
+    std::ranges::copy(std::vector<int32_t>{1, 2, 3, 255}, a.data());
+    tome["a"] = Tome::array(a);
+    write_json_string(s, tome, schema);
+    REQUIRE(nlohmann::json::parse(s)["a"] ==
+            nlohmann::json::parse("[[1, 2], [3, 255]]"));
+    a.data()[3] = 256;
+    tome["a"] = Tome::array(a);
+    REQUIRE_THROWS_AS(write_json_string(s, tome, schema),
+                      scribe::ValidationError);
+    a.data()[3] = -1;
+    tome["a"] = Tome::array(a);
+    REQUIRE_THROWS_AS(write_json_string(s, tome, schema),
+                      scribe::ValidationError);
+    auto real = scribe::Array<double>::from_shape({2, 1});
+    real.data()[0] = 1;
+    real.data()[1] = 4.5;
+    tome["a"] = Tome::array(real);
+    REQUIRE_THROWS_AS(write_json_string(s, tome, schema),
+                      scribe::ValidationError);
+}
+
+TEST_CASE("writing numbers to json", "[tome]")
+{
+    auto schema = Schema::from_json(R"(
+    {
+        "type": "dict",
+        "items": [
+            {"key": "a", "type": "int32"},
+            {"key": "b", "type": "float32"},
+            {"key": "c", "type": "uint8"}
+        ]
+    }
+    )"_json);
+    Tome tome;
+    tome["a"] = int32_t(-5);
+    tome["b"] = 0.5f;
+    tome["c"] = uint8_t(200);
+
+    auto expected = R"({"a": -5, "b": 0.5, "c": 200})"_json;
+    std::string s;
+    write_json_string(s, tome, schema);
+    REQUIRE(nlohmann::json::parse(s) == expected);
+    write_json_string(s, tome, Schema::any());
+    REQUIRE(nlohmann::json::parse(s) == expected);
+
+    tome["c"] = int32_t(-1);
+    REQUIRE_THROWS_AS(write_json_string(s, tome, schema),
+                      scribe::ValidationError);
+
+    // unsigned values above INT64_MAX must not wrap around to negative ones
+    auto big = Tome::integer(std::numeric_limits<uint64_t>::max());
+    write_json_string(s, big, Schema::number(scribe::NumType::UINT64));
+    REQUIRE(nlohmann::json::parse(s) == std::numeric_limits<uint64_t>::max());
+    REQUIRE_THROWS_AS(
+        write_json_string(s, big, Schema::number(scribe::NumType::INT64)),
+        scribe::ValidationError);
+}
+
+TEST_CASE("validation of large dicts", "[tome]")
+{
+    // more than 64 keys -> required-key mask spans multiple words
+    auto schema_json = nlohmann::json{{"type", "dict"}, {"items", {}}};
+    nlohmann::json data = nlohmann::json::object();
+    for (int i = 0; i < 150; ++i)
+    {
+        auto key = fmt::format("key{}", i);
+        schema_json["items"].push_back(
+            {{"key", key}, {"type", "int32"}, {"optional", i % 2 == 0}});
+        data[key] = i;
+    }
+    auto schema = Schema::from_json(schema_json);
+
+    auto plan = scribe::ValidationPlan(schema);
+    REQUIRE(plan.find_key(plan.root(), "key99") == 99);
+    REQUIRE(plan.find_key(plan.root(), "foo") == -1);
+
+    Tome tome;
+    REQUIRE_NOTHROW(scribe::internal::read_json(&tome, data, schema));
+    REQUIRE(tome["key149"].as<int32_t>() == 149);
+    REQUIRE_NOTHROW(
+        scribe::internal::read_json_stream(nullptr, data.dump(), schema));
+
+    // keys in any order, duplicates: the last one wins
+    std::string reversed = "{";
+    for (int i = 149; i >= 0; --i)
+        reversed += fmt::format("\"key{}\": {}, ", i, i);
+    reversed += "\"key7\": 8}";
+    Tome tome2;
+    scribe::internal::read_json_stream(&tome2, reversed, schema);
+    REQUIRE(tome2["key0"].as<int32_t>() == 0);
+    REQUIRE(tome2["key7"].as<int32_t>() == 8);
+    REQUIRE(std::as_const(tome2).as_dict().begin()->first == "key0");
+    REQUIRE(std::as_const(tome2).size() == 150);
+
+    data.erase("key140"); // optional
+    REQUIRE_NOTHROW(scribe::internal::read_json(nullptr, data, schema));
+    data.erase("key131"); // required
+    REQUIRE_THROWS_AS(scribe::internal::read_json(nullptr, data, schema),
+                      scribe::ValidationError);
+    REQUIRE_THROWS_AS(
+        scribe::internal::read_json_stream(nullptr, data.dump(), schema),
+        scribe::ValidationError);
+}
+
+TEST_CASE("reading json into an arena", "[tome]")
+{
+    auto schema = Schema::from_json(R"(
+    {
+        "type": "dict",
+        "items": [
+            {"key": "a", "type": "int32"},
+            {
+                "key": "b",
+                "type": "dict",
+                "items": [{"key": "c", "type": "string"}]
+            },
+            {
+                "key": "v",
+                "type": "array",
+                "shape": [3],
+                "elements": {"type": "float64"}
+            }
+        ]
+    }
+    )"_json);
+    std::string j = R"({"a": 1, "b": {"c": "hello"}, "v": [1, 2, 3]})";
+
+    // keeps track of the memory currently allocated through it
+    struct CountingResource : std::pmr::memory_resource
+    {
+        size_t allocations = 0;
+        size_t live_bytes = 0;
+
+        void *do_allocate(size_t bytes, size_t alignment) override
+        {
+            ++allocations;
+            live_bytes += bytes;
+            return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+        }
+        void do_deallocate(void *p, size_t bytes, size_t alignment) override
+        {
+            live_bytes -= bytes;
+            std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+        }
+        bool do_is_equal(memory_resource const &other) const noexcept override
+        {
+            return this == &other;
+        }
+    };
+
+    auto arena = CountingResource();
+    {
+        Tome tome;
+        scribe::internal::read_json_stream(&tome, j, schema, &arena);
+        REQUIRE(tome.as_dict().memory() == &arena);
+        REQUIRE(tome["b"].as_dict().memory() == &arena);
+        REQUIRE(tome["b"]["c"].as_string() == "hello");
+        REQUIRE(tome["v"].as_numeric_array<double>()(2) == 3);
+
+        // two dicts (node and items) and the array node
+        REQUIRE(arena.allocations >= 5);
+
+        // copies do not depend on the arena
+        auto allocations = arena.allocations;
+        Tome copy = tome;
+        copy["b"]["c"] = "world";
+        copy["v"].as_numeric_array<double>()(0) = 0;
+        REQUIRE(copy.as_dict().memory() == nullptr);
+        REQUIRE(copy["b"].as_dict().memory() == nullptr);
+        REQUIRE(copy["a"].as<int32_t>() == 1);
+        REQUIRE(arena.allocations == allocations);
+    }
+    REQUIRE(arena.live_bytes == 0);
+
+    // long dict keys can use the arena, short ones never allocate
+    {
+        auto allocations = arena.allocations;
+        auto short_key = scribe::DictKey("short", &arena);
+        REQUIRE(arena.allocations == allocations);
+        auto long_key = scribe::DictKey("a key longer than 15 chars", &arena);
+        REQUIRE(arena.allocations > allocations);
+        REQUIRE(long_key == "a key longer than 15 chars");
+
+        scribe::KeyPool pool(&arena);
+        REQUIRE(pool.intern("another long dict key") ==
+                "another long dict key");
+    }
+    REQUIRE(arena.live_bytes == 0);
+}
+
+TEST_CASE("dict keys are shared between records", "[tome]")
+{
+    auto schema = Schema::from_json(R"(
+    {
+        "type": "array",
+        "shape": [2],
+        "elements": {
+            "type": "dict",
+            "items": [
+                {"key": "x", "type": "float64"},
+                {"key": "temperature_kelvin", "type": "float64"}
+            ]
+        }
+    }
+    )"_json);
+    std::string j = R"([{"x": 1, "temperature_kelvin": 2},
+                        {"temperature_kelvin": 4, "x": 3}])";
+
+    Tome tome;
+    scribe::internal::read_json_stream(&tome, j, schema);
+    auto const &a = tome.as_array()(0).as_dict();
+    auto const &b = tome.as_array()(1).as_dict();
+    REQUIRE(a.begin()->first == "temperature_kelvin");
+    REQUIRE(a.begin()->first.same(b.begin()->first));
+    REQUIRE(b.at("x").as<double>() == 3);
+
+    // short keys are stored inline, never shared
+    REQUIRE(!a.find("x")->first.same(b.find("x")->first));
+    REQUIRE(a.find("x")->first == b.find("x")->first);
+
+    scribe::KeyPool pool;
+    auto long_key = std::string("a_rather_long_key");
+    REQUIRE(pool.intern(long_key).same(pool.intern(long_key.c_str())));
+    REQUIRE(!pool.intern(long_key).same(scribe::DictKey(long_key)));
+    REQUIRE(pool.size() == 1);
+
+    // keys convert to 'std::string_view' and can be formatted
+    std::string_view view = a.begin()->first;
+    REQUIRE(view == "temperature_kelvin");
+    REQUIRE(fmt::format("{:>3}", a.find("x")->first) == "  x");
+}
+
+TEST_CASE("json output formatting", "[tome]")
+{
+    Tome tome;
+    tome["a"] = int32_t(1);
+    tome["b"] = Tome::array(std::vector<double>{0.1, 2});
+    tome["c"] = 0.1f;
+    tome["d"] = "x\"\n";
+    tome["e"] = Tome::dict();
+
+    std::string s;
+    write_json_string(s, tome, Schema::any(), {.indent = -1});
+    REQUIRE(s == R"({"a":1,"b":[0.1,2.0],"c":0.1,"d":"x\"\n","e":{}})");
+
+    write_json_string(s, tome["b"], Schema::any(), {.indent = 2});
+    REQUIRE(s == "[\n  0.1,\n  2.0\n]");
+
+    // shortest representation still reads back to the exact same value
+    auto schema = Schema::from_json(R"({"type": "float32"})"_json);
+    Tome x = 0.3f;
+    write_json_string(s, x, schema);
+    REQUIRE(s == "0.3");
+    Tome y;
+    read_json_string(y, s, schema);
+    REQUIRE(y.as<float>() == 0.3f);
+}
+
+TEST_CASE("cbor and msgpack files", "[tome]")
+{
+    auto schema = Schema::from_json(R"(
+    {
+        "type": "dict",
+        "items": [
+            {"key": "n", "type": "int64"},
+            {"key": "x", "type": "float32"},
+            {"key": "name", "type": "string"},
+            {
+                "key": "field",
+                "type": "array",
+                "shape": [-1, 100],
+                "elements": {"type": "float64"}
+            },
+            {
+                "key": "z",
+                "type": "array",
+                "shape": [2],
+                "elements": {"type": "complex_float32"}
+            },
+            {
+                "key": "words",
+                "type": "array",
+                "shape": [-1],
+                "elements": {"type": "string"}
+            }
+        ]
+    }
+    )"_json);
+
+    auto field = scribe::Array<double>::from_shape({10, 100});
+    for (size_t i = 0; i < field.size(); ++i)
+        field.data()[i] = 1.0 / (i + 1);
+    field.data()[1] = std::numeric_limits<double>::quiet_NaN();
+    Tome tome;
+    tome["n"] = -(int64_t(1) << 40);
+    tome["x"] = 0.1f;
+    tome["name"] = "hello";
+    tome["field"] = Tome::array(field);
+    tome["z"] = Tome::array(std::vector<std::complex<float>>{{1, 2}, {3, 4}});
+    tome["words"] = Tome::array(std::vector<Tome>{"foo", "bar"});
+
+    for (auto ending : {".cbor", ".msgpack"})
+    {
+        auto filename = temp_filename(std::string("scribe_test") + ending);
+        write_file(filename, tome, schema);
+
+        // numbers are packed, not written element by element
+        REQUIRE(std::filesystem::file_size(filename) < field.size() * 8 + 200);
+
+        Tome tome2;
+        read_file(tome2, filename, schema);
+        REQUIRE(tome2["n"].as<int64_t>() == -(int64_t(1) << 40));
+        REQUIRE(tome2["x"].as<float>() == 0.1f);
+        REQUIRE(tome2["name"].as_string() == "hello");
+        auto const &field2 = tome2["field"].as_numeric_array<double>();
+        REQUIRE(field2.shape() == field.shape());
+        REQUIRE(std::isnan(field2.data()[1]));
+        REQUIRE(field2.data()[999] == field.data()[999]);
+        REQUIRE(tome2["z"].as_numeric_array<std::complex<float>>().data()[1] ==
+                std::complex<float>(3, 4));
+        REQUIRE(tome2["words"][1].as_string() == "bar");
+        REQUIRE_NOTHROW(validate_file(filename, schema));
+
+        // same file, but expecting integers in 'field'
+        auto wrong_json = schema.to_json();
+        wrong_json["items"][3]["elements"]["type"] = "int32";
+        auto wrong = Schema::from_json(wrong_json);
+        REQUIRE_THROWS_AS(validate_file(filename, wrong),
+                          scribe::ValidationError);
+        std::filesystem::remove(filename);
+    }
+
+    SECTION("element-by-element arrays")
+    {
+        // as written by other libraries
+        auto j = R"({"a": [[1, 2, 3], [4, 5, 6]]})"_json;
+        auto s = Schema::from_json(R"(
+        {
+            "type": "dict",
+            "items": [{
+                "key": "a",
+                "type": "array",
+                "shape": [2, 3],
+                "elements": {"type": "uint16"}
+            }]
+        }
+        )"_json);
+        auto filename = temp_filename("scribe_test.msgpack");
+        auto bytes = nlohmann::json::to_msgpack(j);
+        std::ofstream(filename, std::ios::binary)
+            .write(reinterpret_cast<char const *>(bytes.data()), bytes.size());
+
+        Tome t;
+        read_file(t, filename, s);
+        REQUIRE(t["a"].as_numeric_array<uint16_t>() ==
+                scribe::Array<uint16_t>({{1, 2, 3}, {4, 5, 6}}));
+        std::filesystem::remove(filename);
+    }
+
+    SECTION("cbor features not used by scribe")
+    {
+        // indefinite-length map, array and string, half-precision float and
+        // a tagged integer (tag 1, epoch time)
+        auto s = Schema::from_json(R"(
+        {
+            "type": "dict",
+            "items": [
+                {
+                    "key": "a",
+                    "type": "array",
+                    "shape": [2],
+                    "elements": {"type": "float64"}
+                },
+                {"key": "t", "type": "int64"},
+                {"key": "s", "type": "string"}
+            ]
+        }
+        )"_json);
+        char const cbor[] =
+            "\xbf\x61\x61\x9f\x01\xf9\x41\x00\xff\x61\x74\xc1\x1a"
+            "\x00\x01\x00\x00\x61\x73\x7f\x62\x66\x6f\x61\x6f\xff\xff";
+        auto bytes = std::string(cbor, sizeof(cbor) - 1);
+        auto read = [&](Tome *tome, std::string const &data) {
+            std::istringstream in(data);
+            scribe::internal::read_binary_stream(
+                tome, in, s, scribe::internal::BinaryFormat::CBOR);
+        };
+
+        Tome t;
+        read(&t, bytes);
+        REQUIRE(t["a"].as_numeric_array<double>().data()[1] == 2.5);
+        REQUIRE(t["t"].as<int64_t>() == 65536);
+        REQUIRE(t["s"].as_string() == "foo");
+
+        REQUIRE_THROWS_AS(read(nullptr, bytes.substr(0, 20)),
+                          scribe::ReadError);
+        REQUIRE_THROWS_AS(read(nullptr, bytes + '\0'), scribe::ReadError);
+    }
+}
+
+TEST_CASE("unsigned integers above INT64_MAX", "[tome]")
+{
+    using scribe::NumType;
+    using scribe::ValidationError;
+    auto max = std::numeric_limits<uint64_t>::max();
+    auto scalar = Schema::number(NumType::UINT64);
+    auto array = Schema::from_json(R"(
+    {"type": "array", "shape": [-1], "elements": {"type": "uint64"}}
+    )"_json);
+    auto as_int64 = Schema::from_json(R"(
+    {"type": "array", "shape": [-1], "elements": {"type": "int64"}}
+    )"_json);
+    auto j = nlohmann::json::parse("[0, 18446744073709551615]");
+
+    SECTION("json")
+    {
+        for (bool stream : {true, false})
+        {
+            auto read = [&](Tome *tome, nlohmann::json const &value,
+                            Schema const &schema) {
+                if (stream)
+                    scribe::internal::read_json_stream(tome, value.dump(),
+                                                       schema);
+                else
+                    scribe::internal::read_json(tome, value, schema);
+            };
+            Tome tome;
+            read(&tome, j[1], scalar);
+            REQUIRE(tome.as<uint64_t>() == max);
+            read(&tome, j, array);
+            REQUIRE(tome.as_numeric_array<uint64_t>().data()[1] == max);
+            REQUIRE_THROWS_AS(read(&tome, j[1], Schema::number(NumType::INT64)),
+                              ValidationError);
+            REQUIRE_THROWS_AS(read(&tome, j, as_int64), ValidationError);
+        }
+    }
+
+    SECTION("cbor")
+    {
+        auto cbor_format = scribe::internal::BinaryFormat::CBOR;
+        auto read = [&](Tome *tome, std::string const &bytes,
+                        Schema const &schema) {
+            std::istringstream in(bytes);
+            scribe::internal::read_binary_stream(tome, in, schema,
+                                                 cbor_format);
+        };
+
+        // element by element
+        auto cbor = nlohmann::json::to_cbor(j);
+        auto elements = std::string(cbor.begin(), cbor.end());
+        Tome tome;
+        read(&tome, elements, array);
+        REQUIRE(tome.as_numeric_array<uint64_t>().data()[1] == max);
+
+        // typed array, as written by scribe
+        std::string typed;
+        scribe::internal::write_binary_stream(
+            [&](std::string_view block) { typed += block; }, tome, array,
+            cbor_format);
+        Tome tome2;
+        read(&tome2, typed, array);
+        REQUIRE(tome2.as_numeric_array<uint64_t>().data()[1] == max);
+
+        // converted to another element type
+        auto as_double = Schema::from_json(R"(
+        {"type": "array", "shape": [-1], "elements": {"type": "float64"}}
+        )"_json);
+        read(&tome2, typed, as_double);
+        REQUIRE(tome2.as_numeric_array<double>().data()[1] == double(max));
+        REQUIRE_THROWS_AS(read(nullptr, elements, as_int64), ValidationError);
+        REQUIRE_THROWS_AS(read(nullptr, typed, as_int64), ValidationError);
+    }
+}
+
+TEST_CASE("failed writes leave existing files untouched", "[tome]")
+{
+    auto schema = Schema::from_json(R"(
+    {
+        "type": "dict",
+        "items": [
+            {"key": "name", "type": "string"},
+            {"key": "n", "type": "uint8"}
+        ]
+    }
+    )"_json);
+    Tome tome;
+    tome["name"] = "hello";
+    tome["n"] = 1;
+
+    for (auto ending : {".json", ".cbor", ".msgpack"})
+    {
+        auto filename = temp_filename(std::string("scribe_test_fail") + ending);
+        write_file(filename, tome, schema);
+        auto size = std::filesystem::file_size(filename);
+
+        // "name" is already written when "n" turns out to be invalid
+        auto invalid = tome;
+        invalid["n"] = 1000;
+        REQUIRE_THROWS_AS(write_file(filename, invalid, schema),
+                          scribe::ValidationError);
+        REQUIRE(std::filesystem::file_size(filename) == size);
+        REQUIRE(!std::filesystem::exists(filename + ".tmp"));
+
+        Tome tome2;
+        read_file(tome2, filename, schema);
+        REQUIRE(tome2["n"].get<int>() == 1);
+        std::filesystem::remove(filename);
+    }
+}
+
+TEST_CASE("arrays of external memory in json", "[tome]")
+{
+    auto schema = Schema::from_json(R"(
+    {
+        "type": "dict",
+        "items": [
+            {
+                "key": "a",
+                "type": "array",
+                "shape": [2, 3],
+                "elements": {"type": "float64"}
+            },
+            {
+                "key": "b",
+                "type": "array",
+                "elements": {"type": "float64"},
+                "json": {"encoding": "base64"}
+            }
+        ]
+    }
+    )"_json);
+    Tome tome;
+    tome["a"] = Tome::array(external_array({1, 2, 3, 4, 5, 6}, {2, 3}));
+    tome["b"] = Tome::array(external_array({0.5, -0.5}, {2}));
+    auto const &a = std::as_const(tome)["a"].as_numeric_array<double>();
+    REQUIRE(a.storage().is_view());
+
+    std::string s;
+    write_json_string(s, tome, schema);
+    REQUIRE(a.storage().is_view()); // writing does not copy
+    Tome tome2;
+    read_json_string(tome2, s, schema);
+    REQUIRE(tome2 == tome);
+
+    // reading into the tome replaces the arrays, the memory is untouched
+    auto old = tome;
+    tome2["a"].as_numeric_array<double>()(0, 0) = 10;
+    write_json_string(s, tome2, schema);
+    read_json_string(tome, s, schema);
+    REQUIRE(std::as_const(tome)["a"].as_numeric_array<double>()(0, 0) == 10);
+    REQUIRE(std::as_const(old)["a"].as_numeric_array<double>()(0, 0) == 1);
+}
+
+TEST_CASE("base64 arrays in json", "[tome]")
+{
+    SECTION("codec")
+    {
+        auto roundtrip = [](std::string const &s) {
+            auto text = std::string((s.size() + 2) / 3 * 4, '?');
+            scribe::internal::base64_encode(std::as_bytes(std::span(s)),
+                                            text.data());
+            auto back =
+                std::string(scribe::internal::base64_decoded_size(text), '?');
+            scribe::internal::base64_decode(
+                text, std::as_writable_bytes(std::span(back)));
+            REQUIRE(back == s);
+            return text;
+        };
+        // test vectors of RFC 4648
+        REQUIRE(roundtrip("") == "");
+        REQUIRE(roundtrip("f") == "Zg==");
+        REQUIRE(roundtrip("fo") == "Zm8=");
+        REQUIRE(roundtrip("foo") == "Zm9v");
+        REQUIRE(roundtrip("foob") == "Zm9vYg==");
+        REQUIRE(roundtrip("fooba") == "Zm9vYmE=");
+        REQUIRE(roundtrip("foobar") == "Zm9vYmFy");
+
+        auto decode = [](std::string_view text) {
+            auto out =
+                std::string(scribe::internal::base64_decoded_size(text), '?');
+            scribe::internal::base64_decode(
+                text, std::as_writable_bytes(std::span(out)));
+        };
+        REQUIRE_THROWS_AS(decode("Zg="), scribe::ReadError);
+        REQUIRE_THROWS_AS(decode("Zm9v!A=="), scribe::ReadError);
+        REQUIRE_THROWS_AS(decode("Z=9v"), scribe::ReadError);
+
+        // long enough for the SIMD paths, with all byte values and tails
+        for (size_t n : {12, 16, 24, 28, 47, 48, 100, 255, 256, 1000})
+        {
+            auto s = std::string(n, '\0');
+            for (size_t i = 0; i < n; ++i)
+                s[i] = char(i * 37 + n);
+            auto text = roundtrip(s);
+            REQUIRE(text.find_first_not_of(
+                        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+                        "0123456789+/=") == std::string::npos);
+            for (size_t i : {size_t(0), text.size() / 2, text.size() - 5})
+            {
+                auto bad = text;
+                bad[i] = '-';
+                REQUIRE_THROWS_AS(decode(bad), scribe::ReadError);
+                bad[i] = char(0xc3);
+                REQUIRE_THROWS_AS(decode(bad), scribe::ReadError);
+            }
+        }
+        REQUIRE(roundtrip(std::string(48, '\xff')) == std::string(64, '/'));
+        REQUIRE(roundtrip(std::string(48, '\xfb')).starts_with("+/v7+/v7"));
+    }
+
+    auto schema = Schema::from_json(R"(
+    {
+        "type": "dict",
+        "items": [
+            {
+                "key": "field",
+                "type": "array",
+                "shape": [-1, 3],
+                "elements": {"type": "float64"},
+                "json": {"encoding": "base64"}
+            },
+            {
+                "key": "z",
+                "type": "array",
+                "shape": [2],
+                "elements": {"type": "complex_float32"},
+                "json": {"encoding": "base64"}
+            }
+        ]
+    }
+    )"_json);
+    REQUIRE(schema.to_json()["items"][0]["json"]["encoding"] == "base64");
+
+    auto field = scribe::Array<double>::from_shape({4, 3});
+    for (size_t i = 0; i < field.size(); ++i)
+        field.data()[i] = 1.0 / (i + 1);
+    field.data()[2] = std::numeric_limits<double>::quiet_NaN();
+    Tome tome;
+    tome["field"] = Tome::array(field);
+    tome["z"] = Tome::array(std::vector<std::complex<float>>{{1, 2}, {3, 4}});
+
+    std::string s;
+    write_json_string(s, tome, schema, {.indent = -1});
+    REQUIRE(s.find(R"("z":{"dtype":"complex_float32","shape":[2],)"
+                   R"("data":"AACAPwAAAEAAAEBAAACAQA=="})") !=
+            std::string::npos);
+
+    // bit-exact, with both the streaming and the DOM-based reader
+    Tome tome2, tome3;
+    read_json_string(tome2, s, schema);
+    scribe::internal::read_json(&tome3, nlohmann::json::parse(s), schema);
+    for (auto const *t : {&tome2, &tome3})
+    {
+        auto const &field2 = (*t)["field"].as_numeric_array<double>();
+        REQUIRE(field2.shape() == field.shape());
+        REQUIRE(std::isnan(field2.data()[2]));
+        REQUIRE(field2.data()[11] == field.data()[11]);
+        REQUIRE((*t)["z"].as_numeric_array<std::complex<float>>().data()[1] ==
+                std::complex<float>(3, 4));
+    }
+
+    // typed reader understands the same form
+    auto field4 = scribe::Array<double>();
+    scribe::internal::read_json_array(field4,
+                                      nlohmann::json::parse(s)["field"]);
+    REQUIRE(field4.data()[11] == field.data()[11]);
+
+    // type and size have to match exactly
+    Tome tome5;
+    REQUIRE_THROWS_AS(
+        read_json_string(tome5,
+                         R"({"field": {"dtype": "float32", "shape": [0, 3],
+                             "data": ""}, "z": [[1, 2], [3, 4]]})",
+                         schema),
+        scribe::ValidationError);
+    REQUIRE_THROWS_AS(
+        read_json_string(tome5,
+                         R"({"field": {"dtype": "float64", "shape": [1, 3],
+                             "data": "AAAA"}, "z": [[1, 2], [3, 4]]})",
+                         schema),
+        scribe::ValidationError);
+}
+
+TEST_CASE("asynchronous writes", "[tome]")
+{
+    auto schema = Schema::from_json(R"(
+    {
+        "type": "dict",
+        "items": [
+            {
+                "key": "x",
+                "type": "array",
+                "shape": [-1],
+                "elements": {"type": "float64"}
+            }
+        ]
+    }
+    )"_json);
+    auto filename = temp_filename("scribe_test_async.json");
+
+    Tome tome;
+    tome["x"] = Tome::array(std::vector<double>{1, 2, 3});
+    std::future<void> done, failed;
+    {
+        auto writer = scribe::AsyncWriter();
+        done = writer.write(filename, tome, schema);
+
+        // changes after handing over the tome do not affect the file
+        tome["x"].as_numeric_array<double>()(0) = 4;
+
+        failed = writer.write(temp_filename("scribe_test_async.unknown"),
+                              tome, schema);
+        writer.wait();
+        REQUIRE(failed.wait_for(std::chrono::seconds(0)) ==
+                std::future_status::ready);
+    }
+    REQUIRE_NOTHROW(done.get());
+    REQUIRE_THROWS_AS(failed.get(), std::runtime_error);
+
+    Tome tome2;
+    read_file(tome2, filename, schema);
+    REQUIRE(tome2["x"].as_numeric_array<double>()(0) == 1);
+    REQUIRE(tome2["x"].as_numeric_array<double>()(2) == 3);
+    std::filesystem::remove(filename);
+
+    // typed overload, for generated types
+    auto checkpoint = Checkpoint{7, scribe::Array<double>({1.5, 2.5})};
+    {
+        auto writer = scribe::AsyncWriter();
+        done = writer.write(filename, checkpoint);
+
+        // the writer has its own copy
+        checkpoint.step = 8;
+    }
+    REQUIRE_NOTHROW(done.get());
+
+    Checkpoint checkpoint2;
+    scribe::read_file(checkpoint2, filename);
+    REQUIRE(checkpoint2.step == 7);
+    REQUIRE(checkpoint2.x == scribe::Array<double>({1.5, 2.5}));
+    std::filesystem::remove(filename);
+}
@@ -0,0 +1,162 @@
+// Tests of MPI-parallel HDF5 I/O. Run as 'mpirun -np 4 ./scribe_mpi_tests'
+// (any number of ranks works, including 1). Most MPI libraries leak some
+// memory on purpose, so 'ASAN_OPTIONS=detect_leaks=0' might be necessary.
+
+#include "catch2/catch_session.hpp"
+#include "catch2/catch_test_macros.hpp"
+
+#include "scribe/io_mpi.h"
+#include "scribe/tome.h"
+#include <filesystem>
+
+using scribe::MpiHdf5File;
+using scribe::Schema;
+using scribe::Tome;
+
+namespace {
+int mpi_rank()
+{
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    return rank;
+}
+
+int mpi_size()
+{
+    int size;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    return size;
+}
+
+// same on all ranks
+std::string temp_filename(std::string_view name)
+{
+    return (std::filesystem::temp_directory_path() / name).string();
+}
+} // namespace
+
+TEST_CASE("mpi distributed arrays", "[mpi]")
+{
+    // each rank owns 3 rows of a (3*size, 5) array
+    auto schema = Schema::from_json(R"(
+    {
+        "type": "array",
+        "shape": [-1, 5],
+        "elements": {"type": "float64"}
+    }
+    )"_json);
+    auto params_schema = Schema::from_json(R"(
+    {
+        "type": "dict",
+        "items": [{"key": "ranks", "type": "int32"}]
+    }
+    )"_json);
+    auto filename = temp_filename("scribe_test_mpi.h5");
+    size_t rank = mpi_rank();
+    size_t size = mpi_size();
+    auto value = [](size_t i, size_t j) { return 100.0 * i + j; };
+
+    {
+        auto file = MpiHdf5File(filename, MpiHdf5File::Mode::Write);
+
+        Tome params;
+        params["ranks"] = int32_t(size);
+        file.write("/params", params, params_schema);
+
+        auto block = scribe::Array<double>::from_shape({3, 5});
+        for (size_t i = 0; i < 3; ++i)
+            for (size_t j = 0; j < 5; ++j)
+                block(i, j) = value(3 * rank + i, j);
+        file.write_block("/field", schema, block, {3 * rank, 0});
+
+        // empty blocks are fine
+        auto empty = scribe::Array<double>::from_shape({0, 5});
+        file.write_block("/empty", schema, empty, {0, 0});
+    }
+
+    SECTION("read back blocks of another rank")
+    {
+        auto file = MpiHdf5File(filename, MpiHdf5File::Mode::Read);
+        size_t other = (rank + 1) % size;
+        scribe::Array<double> block;
+        file.read_block(block, "/field", schema,
+                        scribe::Hyperslab{{3 * other, 1}, {3, 4}, {}});
+        REQUIRE(block.shape() == std::vector<size_t>{3, 4});
+        for (size_t i = 0; i < 3; ++i)
+            for (size_t j = 0; j < 4; ++j)
+                REQUIRE(block(i, j) == value(3 * other + i, j + 1));
+
+        Tome params;
+        file.read(params, "/params", Schema::any());
+        REQUIRE(params["ranks"].get<int>() == int(size));
+    }
+
+    SECTION("read the whole array serially")
+    {
+        if (rank == 0)
+        {
+            Tome tome;
+            read_file(tome, filename, Schema::any());
+            auto const &a = tome["field"].as_numeric_array<double>();
+            REQUIRE(a.shape() == std::vector<size_t>{3 * size, 5});
+            for (size_t i = 0; i < 3 * size; ++i)
+                for (size_t j = 0; j < 5; ++j)
+                    REQUIRE(a(i, j) == value(i, j));
+            REQUIRE(tome["empty"].as_numeric_array<double>().shape() ==
+                    std::vector<size_t>{0, 5});
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+
+    SECTION("errors are raised on all ranks")
+    {
+        auto file = MpiHdf5File(filename, MpiHdf5File::Mode::Read);
+        scribe::Array<double> block;
+
+        // only the last rank is out of bounds
+        size_t offset = rank + 1 == size ? 3 * size : 0;
+        REQUIRE_THROWS_AS(
+            file.read_block(block, "/field", schema,
+                            scribe::Hyperslab{{offset, 0}, {1, 5}, {}}),
+            scribe::ReadError);
+
+        // wrong element type
+        scribe::Array<float> wrong;
+        auto slab = scribe::Hyperslab{{0, 0}, {1, 5}, {}};
+        REQUIRE_THROWS_AS(file.read_block(wrong, "/field", schema, slab),
+                          scribe::ValidationError);
+    }
+
+    SECTION("invalid replicated data fails on all ranks")
+    {
+        auto other = temp_filename("scribe_test_mpi_invalid.h5");
+        {
+            auto file = MpiHdf5File(other, MpiHdf5File::Mode::Write);
+
+            // only the last rank is out of range of int32
+            Tome params;
+            params["ranks"] = rank + 1 == size ? int64_t(1) << 40 : 1;
+            REQUIRE_THROWS_AS(file.write("/params", params, params_schema),
+                              scribe::ValidationError);
+
+            // nothing was written, so the file is still usable
+            params["ranks"] = int32_t(size);
+            file.write("/params", params, params_schema);
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+        if (rank == 0)
+            std::filesystem::remove(other);
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (rank == 0)
+        std::filesystem::remove(filename);
+}
+
+int main(int argc, char **argv)
+{
+    MPI_Init(&argc, &argv);
+    int result = Catch::Session().run(argc, argv);
+    MPI_Finalize();
+    return result;
+}
@@ -0,0 +1,198 @@
+#include "catch2/catch_test_macros.hpp"
+
+#include "scribe/io_scb.h"
+#include "scribe/tome.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+using scribe::Schema;
+using scribe::Tome;
+
+namespace {
+std::string temp_filename(std::string_view name)
+{
+    return (std::filesystem::temp_directory_path() / name).string();
+}
+} // namespace
+
+TEST_CASE("scb files", "[scb]")
+{
+    auto schema = Schema::from_json(R"(
+    {
+        "type": "dict",
+        "items": [
+            {"key": "flag", "type": "bool"},
+            {"key": "n", "type": "int32"},
+            {"key": "x", "type": "float32"},
+            {"key": "z", "type": "complex_float64"},
+            {"key": "name", "type": "string"},
+            {
+                "key": "field",
+                "type": "array",
+                "shape": [3, -1],
+                "elements": {"type": "float64"}
+            },
+            {
+                "key": "list",
+                "type": "array",
+                "elements": {"type": "uint8"}
+            },
+            {
+                "key": "words",
+                "type": "array",
+                "elements": {"type": "string"}
+            },
+            {
+                "key": "sub",
+                "type": "dict",
+                "items": [{"key": "m", "type": "int64", "optional": true}]
+            }
+        ]
+    }
+    )"_json);
+    auto filename = temp_filename("scribe_test.scb");
+
+    auto field = scribe::Array<double>::from_shape({3, 4});
+    for (size_t i = 0; i < field.size(); ++i)
+        field.data()[i] = 0.5 * i;
+    Tome tome;
+    tome["flag"] = true;
+    tome["n"] = int32_t(-7);
+    tome["x"] = 0.25; // converted to float32 by the schema
+    tome["z"] = std::complex<double>(1.0, -2.0);
+    tome["name"] = "hello";
+    tome["field"] = Tome::array(field);
+    tome["list"] = Tome::array(std::vector<Tome>{1, 2, 3});
+    tome["words"] = Tome::array(std::vector<Tome>{"foo", "bar"});
+    tome["sub"] = Tome::dict();
+    write_file(filename, tome, schema);
+
+    SECTION("read with schema")
+    {
+        Tome tome2;
+        read_file(tome2, filename, schema);
+        REQUIRE(tome2["flag"].as<bool>() == true);
+        REQUIRE(tome2["n"].as<int32_t>() == -7);
+        REQUIRE(tome2["x"].as<float>() == 0.25f);
+        REQUIRE(tome2["z"].as<std::complex<double>>() ==
+                std::complex<double>(1.0, -2.0));
+        REQUIRE(tome2["name"].as_string() == "hello");
+        REQUIRE(tome2["field"].as_numeric_array<double>() == field);
+        REQUIRE(tome2["list"].as_numeric_array<uint8_t>() ==
+                scribe::Array<uint8_t>({1, 2, 3}));
+        REQUIRE(tome2["words"][1].as_string() == "bar");
+        REQUIRE(tome2["sub"].as_dict().empty());
+        REQUIRE_NOTHROW(validate_file(filename, schema));
+    }
+
+    SECTION("read without schema")
+    {
+        Tome tome2;
+        read_file(tome2, filename, Schema::any());
+        REQUIRE(tome2["x"].as<float>() == 0.25f);
+        REQUIRE(tome2["field"].as_numeric_array<double>() == field);
+        REQUIRE(tome2["words"][0].as_string() == "foo");
+    }
+
+    SECTION("zero-copy views")
+    {
+        auto file = scribe::ScbFile(filename);
+        auto view = file.view<double>("/field");
+        REQUIRE(view.shape() == std::vector<size_t>{3, 4});
+        REQUIRE(view == field);
+        REQUIRE(reinterpret_cast<uintptr_t>(view.data()) % 64 == 0);
+        REQUIRE_THROWS_AS(file.view<float>("/field"), scribe::TomeTypeError);
+        REQUIRE_THROWS_AS(file.view<double>("/foo"), scribe::ReadError);
+        REQUIRE(file.schema().to_json() == schema.to_json());
+    }
+
+    SECTION("arrays refer to the mapped file")
+    {
+        Tome tome2;
+        read_file(tome2, filename, schema);
+        auto const &a =
+            std::as_const(tome2)["field"].as_numeric_array<double>();
+        REQUIRE(a.storage().is_view());
+        REQUIRE(reinterpret_cast<uintptr_t>(a.data()) % 64 == 0);
+        REQUIRE(a == field);
+
+        // modifying copies the data, other copies still refer to the file
+        auto copy = tome2;
+        tome2["field"].as_numeric_array<double>()(0, 0) = -1.0;
+        auto const &b =
+            std::as_const(tome2)["field"].as_numeric_array<double>();
+        REQUIRE(!b.storage().is_view());
+        REQUIRE(b(0, 0) == -1.0);
+        auto const &c = std::as_const(copy)["field"].as_numeric_array<double>();
+        REQUIRE(c.storage().is_view());
+        REQUIRE(c == field);
+
+        // arrays keep the mapping alive
+        scribe::Array<double> array;
+        {
+            auto file = scribe::ScbFile(filename);
+            array = file.array<double>("/field");
+        }
+        REQUIRE(std::as_const(array).storage().is_view());
+        REQUIRE(std::as_const(array) == field);
+    }
+
+    SECTION("validation")
+    {
+        auto wrong = Schema::from_json(R"(
+        {
+            "type": "dict",
+            "items": [
+                {
+                    "key": "field",
+                    "type": "array",
+                    "elements": {"type": "float32"}
+                }
+            ]
+        }
+        )"_json);
+        Tome tome2;
+        REQUIRE_THROWS_AS(read_file(tome2, filename, wrong),
+                          scribe::ValidationError);
+
+        tome["n"] = int64_t(1) << 40;
+        REQUIRE_THROWS_AS(write_file(filename, tome, schema),
+                          scribe::ValidationError);
+    }
+
+    SECTION("corrupt files")
+    {
+        std::ofstream(filename) << "not a scribe file, but long enough to "
+                                   "contain a full header of 64 bytes......";
+        Tome tome2;
+        REQUIRE_THROWS_AS(read_file(tome2, filename, schema),
+                          scribe::ReadError);
+    }
+
+    SECTION("oversized arrays")
+    {
+        // a shape whose size in bytes wraps around to a small number
+        std::stringstream buffer;
+        buffer << std::ifstream(filename, std::ios::binary).rdbuf();
+        auto content = buffer.str();
+        auto pos = content.find("\"shape\":[3,4]");
+        REQUIRE(pos != std::string::npos);
+        auto huge = std::string("\"shape\":[3,6148914691236517206]");
+        content.replace(pos, 13, huge);
+        uint64_t index_size;
+        std::memcpy(&index_size, content.data() + 24, 8);
+        index_size += huge.size() - 13;
+        std::memcpy(content.data() + 24, &index_size, 8);
+        std::ofstream(filename, std::ios::binary) << content;
+
+        Tome tome2;
+        REQUIRE_THROWS_AS(read_file(tome2, filename, Schema::any()),
+                          scribe::ReadError);
+        auto file = scribe::ScbFile(filename);
+        REQUIRE_THROWS_AS(file.view<double>("/field"), scribe::ReadError);
+    }
+
+    std::filesystem::remove(filename);
+}
@@ -2,6 +2,10 @@
 
 #include "fmt/format.h"
 #include "scribe/tome.h"
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <thread>
 
 using scribe::Schema;
 using scribe::Tome;
@@ -97,6 +101,307 @@ TEST_CASE("explicit-type constructors", "[tome]")
     SECTION("standard array 2d from data") {}
 }
 
+TEST_CASE("compact tome representation", "[tome]")
+{
+    // scalars and strings are stored inline, everything larger is boxed
+    STATIC_REQUIRE(sizeof(Tome) <= 5 * sizeof(void *));
+
+    auto a = Tome::array(std::vector<double>{1, 2, 3});
+    auto b = a; // shared until modified
+    b.as_numeric_array<double>()(0) = 4;
+    REQUIRE(a.as_numeric_array<double>()(0) == 1);
+    REQUIRE(b.is<scribe::float64_array_t>());
+
+    auto c = std::move(b);
+    REQUIRE(c.as_numeric_array<double>()(0) == 4);
+    REQUIRE(c.shape() == std::vector<size_t>{3});
+}
+
+TEST_CASE("array storage", "[tome]")
+{
+    using Storage = scribe::internal::ArrayStorage<double>;
+    auto buffer =
+        std::make_shared<std::vector<double>>(std::vector<double>{1, 2, 3});
+    std::weak_ptr<std::vector<double>> weak = buffer;
+
+    auto view = Storage(buffer->data(), buffer->size(), buffer);
+    auto const &cview = view;
+    REQUIRE(view.is_view());
+    REQUIRE(cview.data() == buffer->data());
+    REQUIRE(cview.size() == 3);
+
+    // copies share the memory and keep it alive
+    auto copy = view;
+    buffer.reset();
+    REQUIRE(!weak.expired());
+    REQUIRE(std::as_const(copy).data() == cview.data());
+
+    // the first non-const access copies, the memory is never written
+    copy[0] = -1;
+    REQUIRE(!copy.is_view());
+    REQUIRE(cview[0] == 1);
+    REQUIRE(copy == Storage{-1, 2, 3});
+
+    // moving transfers the view
+    auto moved = std::move(view);
+    REQUIRE(moved.is_view());
+    REQUIRE(!view.is_view());
+    REQUIRE(std::as_const(view).empty());
+    moved = Storage();
+    REQUIRE(weak.expired());
+
+    // as storage of an Array: const access does not copy
+    buffer = std::make_shared<std::vector<double>>(
+        std::vector<double>{1, 2, 3, 4, 5, 6});
+    auto array = scribe::Array<double>(
+        Storage(buffer->data(), buffer->size(), buffer),
+        std::vector<size_t>{2, 3}, std::vector<ptrdiff_t>{3, 1});
+    auto const &carray = array;
+    REQUIRE(carray(1, 2) == 6);
+    REQUIRE(carray.data() == buffer->data());
+
+    auto tome = Tome::array(array);
+    auto const &ctome = tome;
+    REQUIRE(ctome.as_numeric_array<double>().data() == buffer->data());
+    tome.as_numeric_array<double>()(0, 0) = 10;
+    REQUIRE(ctome.as_numeric_array<double>()(0, 0) == 10);
+    REQUIRE((*buffer)[0] == 1);
+    REQUIRE(carray.data() == buffer->data());
+
+    // arrays of Tomes still grow in place
+    auto list = Tome::array(std::vector<Tome>{1, 2});
+    list.push_back(Tome(3));
+    REQUIRE(std::as_const(list).size() == 3);
+}
+
+TEST_CASE("copy-on-write tome", "[tome]")
+{
+    auto built = Tome::dict();
+    built["x"] = Tome::array(std::vector<double>{1, 2, 3});
+    built["y"]["z"] = Tome::integer(int64_t(5));
+
+    // 'built' handed out references to its root and "y", so copying it
+    // copies those. The copy itself shares nothing with 'built' that could
+    // still be modified.
+    auto a = built;
+    REQUIRE(std::as_const(a)["x"].as_numeric_array<double>().data() ==
+            std::as_const(built)["x"].as_numeric_array<double>().data());
+    REQUIRE(&std::as_const(a)["y"]["z"] != &std::as_const(built)["y"]["z"]);
+
+    auto b = a;
+    auto const &ca = a;
+    auto const &cb = b;
+
+    // copies share everything until modified
+    REQUIRE(ca["x"].as_numeric_array<double>().data() ==
+            cb["x"].as_numeric_array<double>().data());
+    REQUIRE(&ca["y"]["z"] == &cb["y"]["z"]);
+
+    // modifying one copy only duplicates the modified path
+    b["x"].as_numeric_array<double>()(0) = 4;
+    REQUIRE(ca["x"].as_numeric_array<double>()(0) == 1);
+    REQUIRE(cb["x"].as_numeric_array<double>()(0) == 4);
+    REQUIRE(ca["x"].as_numeric_array<double>().data() !=
+            cb["x"].as_numeric_array<double>().data());
+    REQUIRE(&ca["y"]["z"] == &cb["y"]["z"]);
+
+    b["y"]["z"] = Tome::integer(int64_t(6));
+    REQUIRE(ca["y"]["z"].as<int64_t>() == 5);
+    REQUIRE(cb["y"]["z"].as<int64_t>() == 6);
+
+    // references obtained before a copy only modify the original
+    auto &z = a["y"]["z"];
+    auto &values = a["x"].as_numeric_array<double>();
+    auto c = a;
+    z = Tome::integer(int64_t(7));
+    values(2) = 8;
+    REQUIRE(ca["y"]["z"].as<int64_t>() == 7);
+    REQUIRE(ca["x"].as_numeric_array<double>()(2) == 8);
+    REQUIRE(std::as_const(c)["y"]["z"].as<int64_t>() == 5);
+    REQUIRE(std::as_const(c)["x"].as_numeric_array<double>()(2) == 3);
+
+    // so do references into a copy that was made of a modified Tome
+    auto &w = c["y"]["z"];
+    auto d = c;
+    w = Tome::integer(int64_t(9));
+    REQUIRE(std::as_const(d)["y"]["z"].as<int64_t>() == 5);
+
+    // default-constructed tomes are still empty dicts
+    Tome d;
+    REQUIRE(d.is_dict());
+    REQUIRE(std::as_const(d).size() == 0);
+}
+
+TEST_CASE("tome change tracking", "[tome]")
+{
+    Tome built;
+    built["x"] = Tome::array(std::vector<double>{1, 2, 3});
+    built["y"]["z"] = Tome::integer(int64_t(5));
+    built["s"] = "foo";
+    auto tome = built;
+    auto snapshot = tome;
+    auto const &a = tome;
+    auto const &b = snapshot;
+    REQUIRE(tome.unchanged_since(snapshot));
+
+    tome["x"].as_numeric_array<double>()(0) = 4;
+    REQUIRE(!tome.unchanged_since(snapshot));
+    REQUIRE(!a["x"].unchanged_since(b["x"]));
+    REQUIRE(a["y"].unchanged_since(b["y"]));
+    REQUIRE(a["s"].unchanged_since(b["s"]));
+
+    // replacing a subtree by equal, but unrelated data counts as change
+    Tome y;
+    y["z"] = Tome::integer(int64_t(5));
+    tome["y"] = y;
+    REQUIRE(!a["y"].unchanged_since(b["y"]));
+
+    // atomic values are compared by value
+    tome["s"] = "foo";
+    REQUIRE(a["s"].unchanged_since(b["s"]));
+    tome["s"] = "bar";
+    REQUIRE(!a["s"].unchanged_since(b["s"]));
+}
+
+TEST_CASE("concurrent loading of lazy tomes", "[tome]")
+{
+    struct Loader : scribe::TomeLoader
+    {
+        mutable std::atomic<int> count = 0;
+        Tome load() const override
+        {
+            ++count;
+            return Tome::array(std::vector<double>{1, 2, 3});
+        }
+    };
+    auto loader = std::make_shared<Loader>();
+    auto const tome = Tome::lazy(loader);
+
+    // all threads see the same (single) loaded value
+    std::vector<double const *> seen(8);
+    {
+        std::vector<std::jthread> threads;
+        for (size_t i = 0; i < seen.size(); ++i)
+            threads.emplace_back([&, i] {
+                seen[i] = tome.as_numeric_array<double>().data();
+            });
+    }
+    for (auto p : seen)
+        REQUIRE(p == seen[0]);
+    REQUIRE(seen[0][2] == 3);
+    REQUIRE(loader->count >= 1);
+    REQUIRE(tome.is_loaded());
+
+    // copies of a loaded value are loaded, moved-from values are not
+    auto copy = tome;
+    REQUIRE(copy.is_loaded());
+    auto moved = std::move(copy);
+    REQUIRE(moved.is_loaded());
+    moved.evict();
+    REQUIRE(!moved.is_loaded());
+    REQUIRE(moved == tome);
+}
+
+TEST_CASE("tome content hash", "[tome]")
+{
+    // reference values of XXH64
+    auto xxh = [](std::string_view s) {
+        return scribe::internal::xxhash64(std::as_bytes(std::span(s)));
+    };
+    REQUIRE(xxh("") == 0xEF46DB3751D8E999);
+    REQUIRE(xxh("abc") == 0x44BC2CF5AD770999);
+    REQUIRE(xxh("Nobody inspects the spammish repetition") ==
+            0xFBCEA83C8A378BF1);
+
+    Tome tome;
+    tome["x"] = Tome::array(std::vector<double>{1, 2, 3});
+    tome["y"]["z"] = Tome::integer(int64_t(5));
+    auto copy = tome;
+    auto h = tome.hash();
+    REQUIRE(copy.hash() == h);
+
+    // equal content built independently hashes the same
+    Tome other;
+    other["y"]["z"] = Tome::integer(int64_t(5));
+    other["x"] = Tome::array(std::vector<double>{1, 2, 3});
+    REQUIRE(other.hash() == h);
+
+    // types are part of the hash
+    other["y"]["z"] = Tome::integer(int32_t(5));
+    REQUIRE(other.hash() != h);
+
+    // modifying a subtree resets the cached hashes along its path
+    tome["y"]["z"] = Tome::integer(int64_t(6));
+    REQUIRE(tome.hash() != h);
+    tome["y"]["z"] = Tome::integer(int64_t(5));
+    REQUIRE(tome.hash() == h);
+
+    // consistent with 'operator==': signed zeros and NaNs hash equally
+    auto nan = std::numeric_limits<double>::quiet_NaN();
+    REQUIRE(Tome(0.0).hash() == Tome(-0.0).hash());
+    REQUIRE(Tome(nan).hash() == Tome(-nan).hash());
+    REQUIRE(Tome::array(std::vector<double>{-0.0, nan}).hash() ==
+            Tome::array(std::vector<double>{0.0, -nan}).hash());
+    REQUIRE(Tome(1.0).hash() != Tome(-1.0).hash());
+}
+
+TEST_CASE("tome diff", "[tome]")
+{
+    Tome a;
+    a["x"] = Tome::array(std::vector<double>{1, 2, 3});
+    a["y"]["z"] = Tome::integer(int64_t(5));
+    a["s"] = "foo";
+    auto b = a;
+    REQUIRE(scribe::diff(a, b).empty());
+    REQUIRE(a == b);
+
+    b["x"].as_numeric_array<double>().data()[1] = 2.0000001;
+    REQUIRE(a != b);
+    auto d = scribe::diff(a, b);
+    REQUIRE(d.size() == 1);
+    CHECK(d[0].path == "/x");
+    CHECK(d[0].what == "1 of 3 elements differ (first at [1]: 2 vs 2.0000001)");
+    REQUIRE(scribe::diff(a, b, {.tolerance = 1e-6}).empty());
+
+    b["y"]["z"] = Tome::integer(int32_t(5));
+    b["y"]["w"] = true;
+    b.as_dict().erase("s");
+    d = scribe::diff(a, b, {.tolerance = 1e-6});
+    REQUIRE(d.size() == 3);
+    CHECK(d[0].path == "/s");
+    CHECK(d[0].what == "only in first");
+    CHECK(d[1].path == "/y/w");
+    CHECK(d[1].what == "only in second");
+    CHECK(d[2].path == "/y/z");
+    CHECK(d[2].what == "type int64 vs int32");
+    REQUIRE(scribe::diff(a, b, {.max_differences = 1}).size() == 1);
+
+    REQUIRE(scribe::diff(Tome::real(1.0), Tome::real(2.0))[0].path == "/");
+    REQUIRE(Tome::real(0.0) == Tome::real(-0.0));
+    REQUIRE(Tome::real(NAN) == Tome::real(NAN));
+
+    // modifying through a reference obtained before hashing does not leave
+    // an outdated hash behind
+    Tome c, e;
+    c["x"] = Tome::array(std::vector<double>{1, 2, 3});
+    e["x"] = Tome::array(std::vector<double>{1, 2, 3});
+    auto &ref = c["x"].as_numeric_array<double>();
+    REQUIRE(c.hash() == e.hash());
+    ref.data()[0] = 4;
+    REQUIRE(c.hash() != e.hash());
+    REQUIRE(c != e);
+    REQUIRE(scribe::diff(c, e).size() == 1);
+    REQUIRE(scribe::diff(c, e, {.use_hash = false}).size() == 1);
+
+    // same for a reference obtained after hashing
+    e.hash();
+    auto &ref2 = e["x"].as_numeric_array<double>();
+    ref2.data()[0] = 4;
+    REQUIRE(scribe::diff(c, e).empty());
+    ref2.data()[1] = 5;
+    REQUIRE(scribe::diff(c, e).size() == 1);
+}
+
 TEST_CASE("explicit type checking in tome", "[tome]")
 {
     SECTION("integers")
@@ -272,3 +577,46 @@ TEST_CASE("custom types to/from tome", "[tome]")
     REQUIRE(p2.x == p.x);
     REQUIRE(p2.y == p.y);
 }
+
+TEST_CASE("flat dict", "[tome]")
+{
+    scribe::FlatDict<int> dict = {{"c", 3}, {"a", 1}, {"b", 2}, {"a", 4}};
+    REQUIRE(dict.size() == 3);
+    REQUIRE(dict.at("a") == 1);
+
+    // iteration is sorted by key, independent of insertion order
+    std::string keys;
+    for (auto const &[key, value] : dict)
+        keys += key.str();
+    REQUIRE(keys == "abc");
+
+    std::string_view key = "d";
+    dict[key] = 5;
+    REQUIRE(dict.contains("d"));
+    REQUIRE(!dict.contains("e"));
+    REQUIRE(dict.find("e") == dict.end());
+    REQUIRE(dict.try_emplace("d", 6).second == false);
+    REQUIRE(dict.at("d") == 5);
+    REQUIRE_THROWS_AS(dict.at("e"), std::out_of_range);
+    REQUIRE(dict.erase("b") == 1);
+    REQUIRE(dict.erase("b") == 0);
+    REQUIRE(dict.size() == 3);
+
+    // inserting items does not move the others
+    auto &c = dict.at("c");
+    for (int i = 0; i < 100; ++i)
+        dict[std::to_string(i)] = i;
+    REQUIRE(&dict.at("c") == &c);
+    Tome tome;
+    tome["x"] = Tome::integer(int64_t(1));
+    tome["y"] = tome["x"];
+    REQUIRE(std::as_const(tome)["y"].as<int64_t>() == 1);
+
+    // bulk insertion in any order, sorted once at the end
+    scribe::FlatDict<int> bulk;
+    for (int i = 9; i >= 0; --i)
+        bulk.append_unsorted(std::to_string(i)) = i;
+    bulk.sort();
+    REQUIRE(bulk.begin()->first == "0");
+    REQUIRE(bulk.at("7") == 7);
+}